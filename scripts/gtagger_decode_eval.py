@@ -0,0 +1,180 @@
+#!/usr/bin/env python
+
+# Compares the accuracy and the throughput of the nersuite_gtagger
+# decoders (-decode beam/greedy-bidir/left-to-right) on held-out data.
+# The seconds and tokens/sec are those of the decoding: the startup time
+# (a run on an empty input, loading the models) is measured apart.
+
+from __future__ import with_statement
+from __future__ import print_function
+
+import sys
+import os
+import subprocess
+import tempfile
+import time
+
+options = None
+
+# Columns (word, POS, chunk) of the supported formats
+FORMAT_COLUMNS = {
+    # word, base form, POS, chunk and NE tags, as output by the GENIA tagger
+    "genia"   : (0, 2, 3),
+    # word, POS and IOB2 chunk tags (CoNLL-2000)
+    "conll"   : (0, 1, 2),
+    # output of nersuite_gtagger (begin, end, word, base form, POS, chunk)
+    "gtagger" : (2, 4, 5),
+}
+
+DEFAULT_DECODERS = "beam:1,beam:5,greedy-bidir,left-to-right"
+
+def argparser():
+    import argparse
+    ap=argparse.ArgumentParser(description="Compare the accuracy and throughput of the nersuite_gtagger decoders on held-out data.")
+    ap.add_argument("-d", "--model-dir", required=True, help="GENIA tagger model directory (nersuite_gtagger -d).")
+    ap.add_argument("-g", "--gtagger", default="nersuite_gtagger", help="nersuite_gtagger command (default: from PATH).")
+    ap.add_argument("-f", "--format", default="genia", choices=sorted(FORMAT_COLUMNS.keys()), help="Format of the held-out file (default: genia).")
+    ap.add_argument("-D", "--decoders", default=DEFAULT_DECODERS, help="Comma-separated decoders, beam:N for a beam of width N (default: %s)." % DEFAULT_DECODERS)
+    ap.add_argument("-t", "--threads", default=1, type=int, help="nersuite_gtagger -threads (default: 1).")
+    ap.add_argument("-o", "--options", default="", help="Other nersuite_gtagger options for every run, as one argument (e.g. -o \"-tagdic models/pos.tagdic\").")
+    ap.add_argument("-r", "--repeat", default=1, type=int, help="Runs per decoder; the fastest is reported (default: 1).")
+    ap.add_argument("file", help="Held-out file, one token per line and an empty line after each sentence.")
+    return ap
+
+def join_option_values(args, names):
+    """Attach the value of the given options to them ("-o" "-x" -> "-o=-x").
+
+    argparse takes a value beginning with "-" for another option, and the
+    values of -o are nersuite_gtagger options.
+    """
+
+    joined, i = [], 0
+    while i < len(args):
+        if args[i] in names and i+1 < len(args):
+            joined.append("%s=%s" % (args[i], args[i+1]))
+            i += 2
+        else:
+            joined.append(args[i])
+            i += 1
+    return joined
+
+def read_sentences(fn, columns):
+    """Read the (word, POS, chunk) triples of the sentences of a file.
+
+    Args:
+        fn (string): file name.
+        columns (tuple): indices of the word, POS and chunk columns.
+    Returns:
+        list of lists of (word, POS, chunk) tuples.
+    """
+
+    sentences, sentence = [], []
+    with open(fn) as f:
+        for linenum, line in enumerate(f):
+            fields = line.split()
+            if not fields:
+                if sentence:
+                    sentences.append(sentence)
+                    sentence = []
+                continue
+            if len(fields) <= max(columns):
+                raise ValueError("too few columns on line %d of %s" % (linenum+1, fn))
+            sentence.append(tuple(fields[c] for c in columns))
+    if sentence:
+        sentences.append(sentence)
+    return sentences
+
+def write_gtagger_input(sentences, out):
+    """Write the sentences as nersuite_gtagger input (begin, end, word)."""
+
+    offset = 0
+    for sentence in sentences:
+        for word, _, _ in sentence:
+            out.write("%d\t%d\t%s\n" % (offset, offset+len(word), word))
+            offset += len(word) + 1
+        out.write("\n")
+
+def parse_decoder(spec):
+    """Parse "beam:N" or a decoder name into nersuite_gtagger options."""
+
+    if spec.startswith("beam:"):
+        return ["-decode", "beam", "-beam", spec[len("beam:"):]]
+    return ["-decode", spec]
+
+def time_command(cmd):
+    """Run a command options.repeat times.
+
+    Returns:
+        (output of the last run, elapsed seconds of the fastest run).
+    """
+
+    best, output = None, None
+    with open(os.devnull, "w") as devnull:
+        for _ in range(options.repeat):
+            start = time.time()
+            output = subprocess.check_output(cmd, stderr=devnull)
+            elapsed = time.time() - start
+            if best is None or elapsed < best:
+                best = elapsed
+    if not isinstance(output, str):
+        output = output.decode("utf-8")
+    return output, best
+
+def run_decoder(spec, input_fn, empty_fn):
+    """Run nersuite_gtagger with a decoder.
+
+    The time of a run on an empty input (loading the models and the
+    dictionaries) is subtracted, so that only the decoding is compared.
+
+    Returns:
+        (output lines, decoding seconds, startup seconds).
+    """
+
+    cmd = [options.gtagger, "-d", options.model_dir, "-threads", str(options.threads)] + \
+        options.options.split() + parse_decoder(spec)
+    output, elapsed = time_command(cmd + ["-f", input_fn])
+    _, startup = time_command(cmd + ["-f", empty_fn])
+    return output.split("\n"), max(elapsed - startup, 1e-6), startup
+
+def score(sentences, lines):
+    """Token accuracies of the POS and chunk columns of nersuite_gtagger output."""
+
+    gold = [t for s in sentences for t in s]
+    predicted = [l.split("\t") for l in lines if l.strip()]
+    if len(predicted) != len(gold):
+        raise ValueError("%d tokens tagged, %d expected" % (len(predicted), len(gold)))
+    pos = sum(1 for g, p in zip(gold, predicted) if g[1] == p[4])
+    chunk = sum(1 for g, p in zip(gold, predicted) if g[2] == p[5])
+    return float(pos) / len(gold), float(chunk) / len(gold)
+
+def main(argv):
+    global options
+    options = argparser().parse_args(join_option_values(argv[1:], ("-o", "--options")))
+
+    sentences = read_sentences(options.file, FORMAT_COLUMNS[options.format])
+    n_tokens = sum(len(s) for s in sentences)
+    if n_tokens == 0:
+        print("ERROR: no tokens in %s" % options.file, file=sys.stderr)
+        return 1
+
+    fd, input_fn = tempfile.mkstemp(suffix=".tok")
+    empty_fd, empty_fn = tempfile.mkstemp(suffix=".tok")
+    os.close(empty_fd)
+    try:
+        with os.fdopen(fd, "w") as out:
+            write_gtagger_input(sentences, out)
+
+        print("%d sentences, %d tokens" % (len(sentences), n_tokens))
+        print("%-16s %8s %8s %10s %12s %10s" % ("decoder", "POS", "chunk", "seconds", "tokens/sec", "startup"))
+        for spec in options.decoders.split(","):
+            lines, elapsed, startup = run_decoder(spec, input_fn, empty_fn)
+            pos, chunk = score(sentences, lines)
+            print("%-16s %7.2f%% %7.2f%% %10.2f %12.0f %10.2f" % (spec, 100*pos, 100*chunk, elapsed, n_tokens/elapsed, startup))
+    finally:
+        os.remove(input_fn)
+        os.remove(empty_fn)
+
+    return 0
+
+if __name__ == "__main__":
+    sys.exit(main(sys.argv))
@@ -55,12 +55,27 @@ namespace cdbpp
 enum {
     // Version number.
     VERSION = 1,
+    // Version number of the format with 64-bit offsets.
+    VERSION_OFFSET64 = 2,
     // The number of hash tables.
     NUM_TABLES = 256,
     // A constant for byte-order checking.
     BYTEORDER_CHECK = 0x62445371,
 };
 
+// The number of queries resolved together by cdbpp_base::get_batch().
+static const size_t BATCH_WINDOW = 16;
+
+// Prefetch a memory location into the cache (no-op if not supported).
+#if defined(__GNUC__)
+#define CDBPP_PREFETCH(p)   __builtin_prefetch(p)
+#elif defined(_MSC_VER)
+#include <xmmintrin.h>
+#define CDBPP_PREFETCH(p)   _mm_prefetch((const char*)(p), _MM_HINT_T0)
+#else
+#define CDBPP_PREFETCH(p)
+#endif
+
 
 
 
@@ -149,10 +164,25 @@ struct tableref_t
     uint32_t    num;        // Number of elements in the hash table.
 };
 
+struct tableref64_t
+{
+    uint64_t    offset;     // Offset to a hash table.
+    uint64_t    num;        // Number of elements in the hash table.
+};
+
+// The format with 64-bit offsets has a 24-byte chunk header (the 16 bytes
+// of the 32-bit format followed by the 64-bit chunk size), and its buckets
+// are 12 bytes long (32-bit hash value and 64-bit offset).
+static uint64_t get_data_begin(bool offset64 = false)
+{
+    return offset64 ?
+        (24 + sizeof(tableref64_t) * NUM_TABLES) :
+        (16 + sizeof(tableref_t) * NUM_TABLES);
+}
 
-static uint32_t get_data_begin()
+static size_t get_bucket_size(bool offset64 = false)
 {
-    return (16 + sizeof(tableref_t) * NUM_TABLES);
+    return sizeof(uint32_t) + (offset64 ? sizeof(uint64_t) : sizeof(uint32_t));
 }
 
 
@@ -182,13 +212,13 @@ protected:
     struct bucket
     {
         uint32_t    hash;       // Hash value of the record.
-        uint32_t    offset;     // Offset address to the actual record.
+        uint64_t    offset;     // Offset address to the actual record.
 
         bucket() : hash(0), offset(0)
         {
         }
 
-        bucket(uint32_t h, uint32_t o) : hash(h), offset(o)
+        bucket(uint32_t h, uint64_t o) : hash(h), offset(o)
         {
         }
     };
@@ -197,9 +227,10 @@ protected:
     typedef std::vector<bucket> hashtable;
 
 protected:
-    std::ofstream&  m_os;               // Output stream.
-    uint32_t        m_begin;
-    uint32_t        m_cur;
+    std::ostream&   m_os;               // Output stream.
+    uint64_t        m_begin;
+    uint64_t        m_cur;
+    bool            m_offset64;         // Use the format with 64-bit offsets.
     hashtable       m_ht[NUM_TABLES];   // Hash tables.
 
 public:
@@ -207,13 +238,39 @@ public:
      * Constructs an object.
      *  @param  os          The output stream to which this class write the
      *                      database. This stream must be opened in the
-     *                      binary mode (\c std::ios_base::binary).
+     *                      binary mode (\c std::ios_base::binary), and
+     *                      can also be a \c std::ostringstream.
+     *  @param  offset64    If this is set to \c true, the database is
+     *                      written with 64-bit offsets, so that it can
+     *                      exceed 4GB. Readers detect the format from the
+     *                      chunk header.
      */
-    builder_base(std::ofstream& os) : m_os(os)
+    builder_base(std::ostream& os, bool offset64 = false)
+        : m_os(os), m_offset64(offset64)
     {
         m_begin = m_os.tellp();
-        m_cur = get_data_begin();
-        m_os.seekp(m_begin + m_cur);
+        m_cur = get_data_begin(m_offset64);
+
+        // Reserve the chunk header, which is written when closing. A
+        // string stream cannot seek past its end.
+        for (uint64_t i = 0;i < m_cur;++i) {
+            m_os.put(0);
+        }
+    }
+
+    /**
+     * Tests if a database needs 64-bit offsets.
+     *  @param  num         The number of records.
+     *  @param  kvsize      The total size of the keys and values.
+     *  @return bool        \c true if the database would exceed 4GB with
+     *                      32-bit offsets, \c false otherwise.
+     */
+    static bool needs_offset64(size_t num, uint64_t kvsize)
+    {
+        // Each record has two size fields and two buckets.
+        uint64_t size = get_data_begin(false) + kvsize +
+            (uint64_t)num * (sizeof(uint32_t) * 2 + get_bucket_size(false) * 2);
+        return (size > 0xFFFFFFFFULL);
     }
 
     /**
@@ -251,16 +308,28 @@ public:
 
         // Increment the current position.
         m_cur += sizeof(uint32_t) + ksize + sizeof(uint32_t) + vsize;
+        if (!m_offset64 && m_cur > 0xFFFFFFFFULL) {
+            throw builder_exception("The database exceeds 4GB; use 64-bit offsets");
+        }
     }
 
 protected:
     void close()
     {
         // Check the consistency of the stream offset.
-        if (m_begin + m_cur != (uint32_t)m_os.tellp()) {
+        if (m_begin + m_cur != (uint64_t)m_os.tellp()) {
             throw builder_exception("Inconsistent stream offset");
         }
 
+        // Check that the hash tables can be addressed.
+        uint64_t end = m_cur;
+        for (size_t i = 0;i < NUM_TABLES;++i) {
+            end += get_bucket_size(m_offset64) * 2 * m_ht[i].size();
+        }
+        if (!m_offset64 && end > 0xFFFFFFFFULL) {
+            throw builder_exception("The database exceeds 4GB; use 64-bit offsets");
+        }
+
         // Store the hash tables. At this moment, the file pointer refers to
         // the offset succeeding the last key/value pair.
         for (size_t i = 0;i < NUM_TABLES;++i) {
@@ -270,7 +339,7 @@ protected:
             if (!ht.empty()) {
                 // An actual table will have the double size; half elements
                 // in the table are kept empty.
-                int n = ht.size() * 2;
+                size_t n = ht.size() * 2;
 
                 // Allocate the actual table.
                 bucket* dst = new bucket[n];
@@ -278,7 +347,7 @@ protected:
                 // Put hash elements to the table with the open-address method.
                 typename hashtable::const_iterator it;
                 for (it = ht.begin();it != ht.end();++it) {
-                    int k = (it->hash >> 8) % n;
+                    size_t k = (it->hash >> 8) % n;
 
                     // Find a vacant element.
                     while (dst[k].offset != 0) {
@@ -291,9 +360,13 @@ protected:
                 }
 
                 // Write out the new table.
-                for (int k = 0;k < n;++k) {
+                for (size_t k = 0;k < n;++k) {
                     write_uint32(dst[k].hash);
-                    write_uint32(dst[k].offset);
+                    if (m_offset64) {
+                        write_uint64(dst[k].offset);
+                    } else {
+                        write_uint32((uint32_t)dst[k].offset);
+                    }
                 }
 
                 // Free the table.
@@ -302,27 +375,36 @@ protected:
         }
 
         // Store the current position.
-        uint32_t offset = (uint32_t)m_os.tellp();
+        uint64_t offset = (uint64_t)m_os.tellp();
 
         // Rewind the stream position to the beginning.
         m_os.seekp(m_begin);
 
-        // Write the file header.
+        // Write the file header. The 32-bit chunk size of the format with
+        // 64-bit offsets is zero; the actual size follows the byte order.
         char chunkid[4] = {'C','D','B','+'};
         m_os.write(chunkid, 4);
-        write_uint32(offset - m_begin);
-        write_uint32(VERSION);
+        write_uint32(m_offset64 ? 0 : (uint32_t)(offset - m_begin));
+        write_uint32(m_offset64 ? VERSION_OFFSET64 : VERSION);
         write_uint32(BYTEORDER_CHECK);
+        if (m_offset64) {
+            write_uint64(offset - m_begin);
+        }
 
         // Write references to hash tables. At this moment, dbw->cur points
         // to the offset succeeding the last key/data pair. 
         for (size_t i = 0;i < NUM_TABLES;++i) {
-            // Offset to the hash table (or zero for non-existent tables).
-            write_uint32(m_ht[i].empty() ? 0 : m_cur);
-            // Bucket size is double to the number of elements.
-            write_uint32(m_ht[i].size() * 2);
+            // Offset to the hash table (or zero for non-existent tables),
+            // and bucket size, which is double to the number of elements.
+            if (m_offset64) {
+                write_uint64(m_ht[i].empty() ? 0 : m_cur);
+                write_uint64(m_ht[i].size() * 2);
+            } else {
+                write_uint32(m_ht[i].empty() ? 0 : (uint32_t)m_cur);
+                write_uint32((uint32_t)(m_ht[i].size() * 2));
+            }
             // Advance the offset counter.
-            m_cur += sizeof(uint32_t) * 2 * m_ht[i].size() * 2;
+            m_cur += get_bucket_size(m_offset64) * m_ht[i].size() * 2;
         }
 
         // Seek to the last position.
@@ -333,6 +415,11 @@ protected:
     {
         m_os.write(reinterpret_cast<const char *>(&value), sizeof(value));
     }
+
+    inline void write_uint64(uint64_t value)
+    {
+        m_os.write(reinterpret_cast<const char *>(&value), sizeof(value));
+    }
 };
 
 
@@ -356,17 +443,12 @@ template <typename hash_function>
 class cdbpp_base
 {
 protected:
-    struct bucket_t
-    {
-        uint32_t    hash;           // Hash value of the record.
-        uint32_t    offset;         // Offset address to the actual record.
-    };
-
-
+    // Buckets are read field by field, as their size depends on the format
+    // (see get_bucket_size()).
     struct hashtable_t
     {
-        uint32_t        num;            // Number of elements in the table.
-        const bucket_t* buckets;        // Buckets (array of bucket).
+        uint64_t        num;            // Number of elements in the table.
+        const uint8_t*  buckets;        // Buckets (array of bucket).
     };
 
 
@@ -374,6 +456,8 @@ protected:
     const uint8_t*  m_buffer;           // Pointer to the memory block.
     size_t          m_size;             // Size of the memory block.
     bool            m_own;              // 
+    bool            m_offset64;         // The format with 64-bit offsets.
+    size_t          m_bucket_size;      // Size of a bucket.
 
     hashtable_t     m_ht[NUM_TABLES];   // Hash tables.
     size_t          m_n;
@@ -383,7 +467,8 @@ public:
      * Constructs an object.
      */
     cdbpp_base()
-        : m_buffer(NULL), m_size(0), m_own(false), m_n(0)
+        : m_buffer(NULL), m_size(0), m_own(false),
+          m_offset64(false), m_bucket_size(get_bucket_size(false)), m_n(0)
     {
     }
 
@@ -395,7 +480,8 @@ public:
      *                      delete[] when the database is closed.
      */
     cdbpp_base(const void *buffer, size_t size, bool own)
-        : m_buffer(NULL), m_size(0), m_own(false), m_n(0)
+        : m_buffer(NULL), m_size(0), m_own(false),
+          m_offset64(false), m_bucket_size(get_bucket_size(false)), m_n(0)
     {
         this->open(buffer, size, own);
     }
@@ -406,7 +492,8 @@ public:
      *                      a database.
      */
     cdbpp_base(std::ifstream& ifs)
-        : m_buffer(NULL), m_size(0), m_own(false), m_n(0)
+        : m_buffer(NULL), m_size(0), m_own(false),
+          m_offset64(false), m_bucket_size(get_bucket_size(false)), m_n(0)
     {
         this->open(ifs);
     }
@@ -448,6 +535,16 @@ public:
         return (m_n == 0);
     }
 
+    /**
+     * Tests if the database has 64-bit offsets.
+     *  @return bool        \c true if the database has the format with
+     *                      64-bit offsets, \c false otherwise.
+     */
+    bool offset64() const
+    {
+        return m_offset64;
+    }
+
     /**
      * Opens the database from an input stream.
      *  @param  ifs         The input stream from which this library reads
@@ -455,7 +552,7 @@ public:
      */
     size_t open(std::ifstream& ifs)
     {
-        char chunk[4], size[4];
+        char chunk[4], size[4], version[4], byteorder[4], size64[8];
         std::istream::pos_type offset = ifs.tellg();
 
         do {
@@ -476,21 +573,36 @@ public:
                 break;
             }
 
+            // Read the version, and the 64-bit size if it has one.
+            ifs.read(version, 4);
+            ifs.read(byteorder, 4);
+            if (ifs.fail()) {
+                break;
+            }
+            uint64_t chunk_size = read_uint32(reinterpret_cast<uint8_t*>(size));
+            if (read_uint32(reinterpret_cast<uint8_t*>(version)) == VERSION_OFFSET64) {
+                ifs.read(size64, 8);
+                if (ifs.fail()) {
+                    break;
+                }
+                chunk_size = read_uint64(reinterpret_cast<uint8_t*>(size64));
+            }
+
             // Allocate a memory block for the chunk.
-            uint32_t chunk_size = read_uint32(reinterpret_cast<uint8_t*>(size));
-            uint8_t* block = new uint8_t[chunk_size];
+            uint8_t* block = new uint8_t[(size_t)chunk_size];
 
             // Read the memory image from the stream.
             ifs.seekg(offset, std::ios_base::beg);
             if (ifs.fail()) {
                 break;
             }
-            ifs.read(reinterpret_cast<char*>(block), chunk_size);
+            ifs.read(reinterpret_cast<char*>(block), (std::streamsize)chunk_size);
             if (ifs.fail()) {
+                delete[] block;
                 break;
             }
 
-            return this->open(block, chunk_size, true);
+            return this->open(block, (size_t)chunk_size, true);
 
         } while (0);
 
@@ -510,7 +622,7 @@ public:
         const uint8_t *p = reinterpret_cast<const uint8_t*>(buffer);
 
         // Make sure that the size of the chunk is larger than the minimum size.
-        if (size < get_data_begin()) {
+        if (size < get_data_begin(false)) {
             throw cdbpp_exception("The memory image is smaller than a chunk header.");
         }
 
@@ -521,7 +633,7 @@ public:
         p += 4;
 
         // Read the chunk header.
-        uint32_t csize = read_uint32(p);
+        uint64_t csize = read_uint32(p);
         p += sizeof(uint32_t);
         uint32_t version = read_uint32(p);
         p += sizeof(uint32_t);
@@ -532,6 +644,18 @@ public:
         if (byteorder != BYTEORDER_CHECK) {
             throw cdbpp_exception("Inconsistent byte order");
         }
+        // Check the version, which tells the size of offsets.
+        if (version != VERSION && version != VERSION_OFFSET64) {
+            throw cdbpp_exception("Unsupported version");
+        }
+        bool offset64 = (version == VERSION_OFFSET64);
+        if (offset64) {
+            if (size < get_data_begin(true)) {
+                throw cdbpp_exception("The memory image is smaller than a chunk header.");
+            }
+            csize = read_uint64(p);
+            p += sizeof(uint64_t);
+        }
         // Check the chunk size.
         if (size < csize) {
             throw cdbpp_exception("The memory image is smaller than a chunk size.");
@@ -541,15 +665,27 @@ public:
         m_buffer = reinterpret_cast<const uint8_t*>(buffer);
         m_size = size;
         m_own = own;
+        m_offset64 = offset64;
+        m_bucket_size = get_bucket_size(offset64);
 
         // Set pointers to the hash tables.
         m_n = 0;
-        const tableref_t* ref = reinterpret_cast<const tableref_t*>(p);
         for (size_t i = 0;i < NUM_TABLES;++i) {
-            if (ref[i].offset) {
+            uint64_t offset, num;
+            if (offset64) {
+                offset = read_uint64(p);
+                num = read_uint64(p + sizeof(uint64_t));
+                p += sizeof(tableref64_t);
+            } else {
+                offset = read_uint32(p);
+                num = read_uint32(p + sizeof(uint32_t));
+                p += sizeof(tableref_t);
+            }
+
+            if (offset) {
                 // Set the buckets.
-                m_ht[i].buckets = reinterpret_cast<const bucket_t*>(m_buffer + ref[i].offset);
-                m_ht[i].num = ref[i].num;
+                m_ht[i].buckets = m_buffer + offset;
+                m_ht[i].num = num;
             } else {
                 // An empty hash table.
                 m_ht[i].buckets = NULL;
@@ -557,7 +693,7 @@ public:
             }
 
             // The number of records is the half of the table size.
-            m_n += (ref[i].num / 2);
+            m_n += (size_t)(num / 2);
         }
 
         return (size_t)csize;
@@ -587,16 +723,110 @@ public:
     const void* get(const void *key, size_t ksize, size_t* vsize) const
     {
         uint32_t hv = hash_function()(key, ksize);
+        return find(key, ksize, hv, vsize);
+    }
+
+    /**
+     * A query of a batch lookup (see get_batch()).
+     */
+    struct query_t
+    {
+        const void* key;            // The pointer to the key.
+        size_t      ksize;          // The size of the key.
+        const void* value;          // [out] The pointer to the value, or NULL.
+        size_t      vsize;          // [out] The size of the value.
+    };
+
+    /**
+     * Finds several keys in the database.
+     *  The result is the same as calling get() for each query, but the
+     *  queries are resolved BATCH_WINDOW at a time: the hash tables and
+     *  then the records of a window are prefetched before any of them is
+     *  compared, so that the cache misses of the queries overlap.
+     *  @param  queries     The array of queries.
+     *  @param  n           The number of queries.
+     */
+    void get_batch(query_t* queries, size_t n) const
+    {
+        uint32_t hvs[BATCH_WINDOW];
+
+        for (size_t beg = 0;beg < n;beg += BATCH_WINDOW) {
+            size_t m = (n - beg < BATCH_WINDOW) ? n - beg : BATCH_WINDOW;
+            query_t* qs = queries + beg;
+
+            // Hash the keys and prefetch their buckets.
+            for (size_t i = 0;i < m;++i) {
+                hvs[i] = hash_function()(qs[i].key, qs[i].ksize);
+                const hashtable_t* ht = &m_ht[hvs[i] % NUM_TABLES];
+                if (ht->num && ht->buckets != NULL) {
+                    CDBPP_PREFETCH(ht->buckets + ((hvs[i] >> 8) % ht->num) * m_bucket_size);
+                }
+            }
+
+            // Prefetch the record of the first bucket having the hash value.
+            for (size_t i = 0;i < m;++i) {
+                const hashtable_t* ht = &m_ht[hvs[i] % NUM_TABLES];
+                if (ht->num && ht->buckets != NULL) {
+                    uint64_t num = ht->num;
+                    uint64_t k = (hvs[i] >> 8) % num;
+                    const uint8_t* p = NULL;
+                    uint64_t offset;
+                    while ((void)(p = ht->buckets + k * m_bucket_size), (offset = read_offset(p)) != 0) {
+                        if (read_uint32(p) == hvs[i]) {
+                            CDBPP_PREFETCH(m_buffer + offset);
+                            break;
+                        }
+                        k = (k+1) % num;
+                    }
+                }
+            }
+
+            // Compare the keys.
+            for (size_t i = 0;i < m;++i) {
+                qs[i].value = find(qs[i].key, qs[i].ksize, hvs[i], &qs[i].vsize);
+            }
+        }
+    }
+
+    /**
+     * Calls a function for each record in the database.
+     *  The records are visited in the order of the hash tables.
+     *  @param  func        The function object, called as
+     *                      func(key, ksize, value, vsize).
+     */
+    template <class func_t>
+    void for_each(func_t& func) const
+    {
+        for (size_t i = 0;i < NUM_TABLES;++i) {
+            const hashtable_t* ht = &m_ht[i];
+            for (uint64_t k = 0;k < ht->num;++k) {
+                uint64_t offset = read_offset(ht->buckets + k * m_bucket_size);
+                if (offset) {
+                    const uint8_t *q = m_buffer + offset;
+                    uint32_t ksize = read_uint32(q);
+                    const uint8_t *key = q + sizeof(uint32_t);
+                    q = key + ksize;
+                    uint32_t vsize = read_uint32(q);
+                    func(key, (size_t)ksize, q + sizeof(uint32_t), (size_t)vsize);
+                }
+            }
+        }
+    }
+
+protected:
+    const void* find(const void *key, size_t ksize, uint32_t hv, size_t* vsize) const
+    {
         const hashtable_t* ht = &m_ht[hv % NUM_TABLES];
 
         if (ht->num && ht->buckets != NULL) {
-            int n = ht->num;
-            int k = (hv >> 8) % n;
-            const bucket_t* p = NULL;
-
-            while (p = &ht->buckets[k], p->offset) {
-                if (p->hash == hv) {
-                    const uint8_t *q = m_buffer + p->offset;
+            uint64_t n = ht->num;
+            uint64_t k = (hv >> 8) % n;
+            const uint8_t* p = NULL;
+            uint64_t offset;
+
+            while ((void)(p = ht->buckets + k * m_bucket_size), (offset = read_offset(p)) != 0) {
+                if (read_uint32(p) == hv) {
+                    const uint8_t *q = m_buffer + offset;
                     if (read_uint32(q) == ksize &&
                         memcmp(key, q + sizeof(uint32_t), ksize) == 0) {
                         q += sizeof(uint32_t) + ksize;
@@ -616,11 +846,25 @@ public:
         return NULL;
     }
 
-protected:
     inline uint32_t read_uint32(const uint8_t* p) const
     {
         return *reinterpret_cast<const uint32_t*>(p);
     }
+
+    inline uint64_t read_uint64(const uint8_t* p) const
+    {
+        uint64_t value;
+        std::memcpy(&value, p, sizeof(value));
+        return value;
+    }
+
+    // Read the offset of a bucket (the offset follows the hash value).
+    inline uint64_t read_offset(const uint8_t* bucket) const
+    {
+        return m_offset64 ?
+            read_uint64(bucket + sizeof(uint32_t)) :
+            read_uint32(bucket + sizeof(uint32_t));
+    }
 };
 
 /// CDB++ builder with MurmurHash2.
@@ -646,7 +890,9 @@ between keys and their values. The database provides several features:
   Daniel J. Bernstein.
 - <b>Low footprint.</b> A CDB++ database consists of a chunk header (16 bytes),
   hash tables (2048 bytes and 16 bytes per record), and actual records (8 bytes
-  plus key/value size per record).
+  plus key/value size per record). A database larger than 4GB can be written
+  with 64-bit offsets (24-byte chunk header, 4096 bytes and 24 bytes per record
+  for the hash tables).
 - <b>Fast hash function.</b> CDB++ incorporates the fast and
   collision-resistant hash function for strings
   (<a href="http://murmurhash.googlepages.com/">MurmurHash 2.0</a>)
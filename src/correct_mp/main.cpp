@@ -10,6 +10,7 @@ using namespace std;
 #include "../nersuite_common/string_utils.h"
 #include "../nersuite_common/text_loader.h"
 #include "../nersuite_common/option_parser.h"
+#include "../nersuite_common/output_writer.h"
 #include "seg_rep_changer.h"
 #include "mp_corrector.h"
 
@@ -18,16 +19,19 @@ typedef		vector< string >		V1_STR;
 typedef		vector< V1_STR >		V2_STR;
 
 
-void print_data( const V2_STR &one_sent );
 void print_usage( char* argv[] );
 
 
 
 int main( int argc, char* argv[] )
 {
+	// Sentences are read from cin alone: unsynchronized, it tells SentenceReader
+	// how much input is waiting, which is then taken in one read
+	std::ios::sync_with_stdio( false );
 
 	// 1. Parse command line arguments
 	NER::OPTION_PARSER	opt_parser;
+	opt_parser.add_flag( "-line-buffered" );
 	opt_parser.parse( argc-1, &argv[1] );
 
 	// 1.1. Get mandatory arguments 
@@ -43,6 +47,20 @@ int main( int argc, char* argv[] )
 	// 1.2. Get optional arguments
 	string   multidoc_separator = "";
 	bool     multidoc_mode = opt_parser.get_value("-multidoc", multidoc_separator);
+	string   line_buffered_opt;
+	bool     line_buffered = opt_parser.get_value("-line-buffered", line_buffered_opt);
+	NER::DataFormat  in_format = NER::FORMAT_TSV, out_format = NER::FORMAT_TSV;
+	string   format_opt;
+	if( (opt_parser.get_value("-if", format_opt) && !NER::parse_data_format(format_opt, in_format)) ||
+	    (opt_parser.get_value("-of", format_opt) && !NER::parse_data_format(format_opt, out_format)) )
+	{
+		print_usage( argv );
+		return -1;
+	}
+	if( in_format == NER::FORMAT_BINARY )
+		NER::set_binary_stdio( stdin );
+	if( out_format == NER::FORMAT_BINARY )
+		NER::set_binary_stdio( stdout );
 	
 
 	// 2. Handle NEs having mismatched parentheses
@@ -52,10 +70,12 @@ int main( int argc, char* argv[] )
 	V2_STR            one_sent;
 	MP_CORRECTOR      mp_corrector;
 	SEG_REP_CHANGER   sp_changer;
+	NER::OutputWriter out( cout, line_buffered, out_format );
+	NER::SentenceReader reader( cin, in_format );
 
-	while( !cin.eof() ) {
+	while( !reader.eof() ) {
 		// 0. Read a sentence
-		int   sent_len = NER::get_sent( cin, one_sent, multidoc_separator, separator_read );
+		int   sent_len = NER::get_sent( reader, one_sent, multidoc_separator, separator_read );
 
 		// 1. Skip blank lines
 		if( sent_len == 0 ) {
@@ -64,7 +84,7 @@ int main( int argc, char* argv[] )
 
 		// 2. Pass it through the output stream if it is comment
 		if( separator_read == true ) {
-			print_data( one_sent );
+			out.write_comment( one_sent );
 			continue;
 		}
 
@@ -76,8 +96,9 @@ int main( int argc, char* argv[] )
 		// 3.3. Recover to the IOB2 rep.
 		sp_changer.IOBES_to_IOB2(one_sent, ne_col);										
 		// 3.4. Print it
-		print_data( one_sent );
+		out.write_sent( one_sent );
 	}
+	out.end_document();
 
 	cerr << endl;
 	cerr << "The number of removed NEs: " << removed_NEs << endl;
@@ -86,28 +107,18 @@ int main( int argc, char* argv[] )
 }
 
 
-void print_data( const V2_STR &one_sent )
-{
-	for( V2_STR::const_iterator i_row = one_sent.begin(); i_row != one_sent.end(); ++i_row ) {
-		for( V1_STR::const_iterator i_col = i_row->begin(); i_col != i_row->end(); ++i_col ) {
-			cout << *(i_col);
-			if( (i_col + 1) != i_row->end() )
-				cout << "\t";
-		}
-		cout << endl;
-	}
-	cout << endl;
-}
-
-
-
 void print_usage( char* argv[] ) 
 {
-	cerr << "Usage: " << argv[0] << " -TOK_COL [#column] -NE_COL [#column]  -multidoc [SEP] <  input file" << endl;
+	cerr << "Usage: " << argv[0] << " -TOK_COL [#column] -NE_COL [#column]  -multidoc [SEP]  [-line-buffered]  [-if FORMAT]  [-of FORMAT] <  input file" << endl;
 	cerr << "   Mandatory arguments. " << endl;
 	cerr << "        -TOK_COL #column : the column index in which tokens appear (begins at 0)" <<endl; 
 	cerr << "        -NE_COL #column  : the column index in which named entities appear (begins at 0)" <<endl; 
 	cerr << "   Optional arguments. " << endl;
 	cerr << "        -multidoc [SEP]  : lines beginning with SEP will be passed to the output without any" << endl;
 	cerr << "                             modification if given" << endl;
+	cerr << "        -line-buffered   : flush the output at the end of every line, not only of every" << endl;
+	cerr << "                             document" << endl;
+	cerr << "        -if FORMAT       : format of the input, 'tsv' (default) or 'binary' (NERsuite" << endl;
+	cerr << "                             binary format)" << endl;
+	cerr << "        -of FORMAT       : format of the output, 'tsv' (default) or 'binary'" << endl;
 }	
@@ -39,9 +39,14 @@ void print_usage()
 {
 	cerr <<
 		"usage: nersuite_dic_compiler [options] <Text_dictionary_filename> <CDB++_DB_filename>\n"
+		"       nersuite_dic_compiler -merge <Base_CDB++_DB_filename> <Delta_CDB++_DB_filename> [...] <CDB++_DB_filename>\n"
 		"  Text dictionary should be a text file containing dictionary entries,\n"
 		"  one per line with the following tab-separated format:\n"
 		"    Named_Entity <tab> Class1 <tab> Class2 <tab> Class3 ...\n"
+		"  A delta DB is compiled from a text file of additions with the same options\n"
+		"  as its base DB.  nersuite_dic_tagger can use it as BASE_DB+DELTA_DB, and\n"
+		"  -merge folds deltas into a new DB as if it was compiled from the\n"
+		"  concatenated text files.\n"
 		"  Options:\n"
 		"    -n <type_of_normalization> : Normalization type for dictionary matching\n"
 		"       can be \"none\" or any combination of \"c\", \"n\", \"s\", \"t\"\n"
@@ -49,7 +54,9 @@ void print_usage()
 		"       c: Case insensitive (convert all letters to lowercase)\n"
 		"       cn: Case AND Number insensitive (convert all numbers to \'0\')\n"
 		"       cns: Case AND Number AND Symbol insensitive (convert all symbols to \'_\')\n"
-		"       t: Use token-base matching\n";
+		"       t: Use token-base matching\n"
+		"    -f <n> : Build a character n-gram index for approximate matching\n"
+		"       (see the -s option of nersuite_dic_tagger; n=3 is recommended)\n";
 }
 
 int main(int argc, char *argv[])
@@ -57,6 +64,30 @@ int main(int argc, char *argv[])
 	NER::OPTION_PARSER opt_parser;
 	opt_parser.parse(argc, argv);
 	const vector<const char*>& args = opt_parser.get_args();
+
+	string base_db;
+	if (opt_parser.get_value("-merge", base_db))
+	{
+		if (base_db == "" || args.size() < 3)
+		{
+			print_usage();
+			exit(1);
+		}
+
+		try
+		{
+			vector<string>	deltas(args.begin() + 1, args.end() - 1);
+			NER::Dictionary dc(args.back());
+			dc.merge(base_db.c_str(), deltas);
+		}
+		catch (const exception& ex)
+		{
+			cerr << ex.what();
+			return 1;
+		}
+		return 0;
+	}
+
 	if (args.size() != 3)
 	{
 		print_usage();
@@ -91,10 +122,22 @@ int main(int argc, char *argv[])
 		}
 	}
 
+	int	ngram_size = 0;
+	string ngram_option;
+	if (opt_parser.get_value("-f", ngram_option))
+	{
+		ngram_size = atoi(ngram_option.c_str());
+		if (ngram_size <= 0)
+		{
+			cerr << "Unrecognized -f parameter value \"" << ngram_option << "\"" << endl;
+			exit(1);
+		}
+	}
+
 	try
 	{
 		NER::Dictionary dc(args[2]);
-		dc.build(args[1], normalize_type);
+		dc.build(args[1], normalize_type, ngram_size);
 	}
 	catch (const exception& ex)
 	{
@@ -29,27 +29,35 @@
 */
 #include <list>
 #include <iostream>
+#include <fstream>
+#include <sstream>
 #include <exception>
 #include <algorithm>
+#include <cstdlib>
 #include "../nersuite_common/dictionary.h"
 #include "../nersuite_common/option_parser.h"
 #include "../nersuite_common/text_loader.h"
 #include "../nersuite_common/string_utils.h"
 #include "../nersuite_common/nersuite_exception.h"
+#include "../nersuite_common/output_writer.h"
 #include "sentence_tagger.h"
 
 using namespace std;
 
-void print(vector<string> &item);
+void delete_dictionaries(vector<const NER::Dictionary*> &dicts);
+NER::Dictionary* create_dictionary(const string &db_spec);
 
 void print_usage()
 {
 	cerr <<
-		"usage: nersuite_dic_tagger [options] CDB++_DB_filename < standard input \n"
+		"usage: nersuite_dic_tagger [options] CDB++_DB_filename [CDB++_DB_filename ...] < standard input \n"
+		"    Dictionary-class columns are appended for each DB in the given order.\n"
+		"    A DB given as BASE_DB+DELTA_DB[+DELTA_DB...] is used with the delta DBs\n"
+		"    layered over the base DB (see nersuite_dic_compiler -merge).\n"
 		"    Options:\n"
 		"    -n <type_of_normalization> : Normalization type for dictionary matching\n"
 		"       can be \"none\" or any combination of \"c\", \"n\", \"s\", \"t\".\n"
-		"       Defaults to normalization used when compiling DB (recommended).\n"
+		"       Defaults to normalization used when compiling each DB (recommended).\n"
 		"       none: No normalization\n"
 		"       c: Case insensitive (convert all letters to lowercase)\n"
 		"       cn: Case AND Number insensitive (convert all numbers to \'0\')\n"
@@ -66,9 +74,36 @@ void print_usage()
 		"       longest: tag longest of leftmost matches (default)\n"
 		"       all: tag all matches\n"
 		"\n"
+		"    -s <threshold> : Similarity threshold for approximate matching (default 1,\n"
+		"       exact matching only).  A sequence with no exact match is tagged with\n"
+		"       the classes of the most similar entry if the similarity is at least\n"
+		"       the threshold (e.g. 0.8).  Requires DBs compiled with the -f option.\n"
+		"\n"
+		"    -m <similarity_measure> : Similarity measure for approximate matching.\n"
+		"       cosine: cosine similarity of character n-grams (default)\n"
+		"       jaccard: Jaccard similarity of character n-grams\n"
+		"\n"
+		"    -c <column_format>: Format of the dictionary-class columns.\n"
+		"       dense: one column per class, \"O\" unless matched (default)\n"
+		"       sparse: one column listing the matches as COLUMN:TAG separated\n"
+		"          by '|', e.g. \"0:B-Gene|3:I-Chemical\", or \"O\" if none.\n"
+		"          nersuite reads both formats.  All DBs must be given to one run.\n"
+		"\n"
+		"    -cache <entries> : Cache the lookups of up to <entries> recent keys\n"
+		"       in each DB (default 0, no cache).  Cache hit rates are reported\n"
+		"       to standard error.\n"
+		"\n"
 		"    -multidoc SEPARATOR : look for lines beginning with the separator string \n"
 		"       SEPARATOR in input and echo the same on output.\n"
 		"\n"
+		"    -line-buffered : flush the output at the end of every line, not only\n"
+		"       of every document.\n"
+		"\n"
+		"    -if <format>, -of <format> : Format of the input and of the output.\n"
+		"       tsv: tab-separated text (default)\n"
+		"       binary: NERsuite binary format, for passing sentences between the\n"
+		"          NERsuite tools without formatting and parsing them as text\n"
+		"\n"
 		"    Line format of the input file: \n"
 		"         [1st col.] - the byte position of the first letter of a token. \n"
 		"         [2nd col.] - the byte position one past the last letter of a token. \n"
@@ -130,7 +165,12 @@ bool parse_pos_filter_string(string filter_string,
 
 int main(int argc, char* argv[])
 {
+	// Sentences are read from cin alone: unsynchronized, it tells SentenceReader
+	// how much input is waiting, which is then taken in one read
+	std::ios::sync_with_stdio(false);
+
 	NER::OPTION_PARSER opt_parser;
+	opt_parser.add_flag("-line-buffered");
 	opt_parser.parse(argc, argv);
 	const vector<const char*>& args = opt_parser.get_args();
 	if (args.size() < 2)
@@ -189,30 +229,123 @@ int main(int argc, char* argv[])
 		exit(1);
 	}
 
-	string	multidoc_separator = "";
-	bool	multidoc_mode = opt_parser.get_value("-multidoc", multidoc_separator);
+	double	similarity_threshold = 1.0;
+	string	threshold_option;
+	if (opt_parser.get_value("-s", threshold_option))
+	{
+		similarity_threshold = atof(threshold_option.c_str());
+		if (similarity_threshold <= 0.0 || similarity_threshold > 1.0)
+		{
+			cerr << "Unrecognized -s parameter value \"" << threshold_option << "\"" << endl;
+			exit(1);
+		}
+	}
 
-	try
+	string measure_option = "cosine";
+	opt_parser.get_value("-m", measure_option);
+	int similarity_measure;
+	if ( measure_option == "cosine" )
+	{
+		similarity_measure = NER::SimilarityCosine;
+	}
+	else if ( measure_option == "jaccard" )
+	{
+		similarity_measure = NER::SimilarityJaccard;
+	}
+	else
 	{
-		NER::Dictionary dict(args[1]);
-		dict.open();
+		cerr << "Unrecognized -m parameter value \"" << measure_option << "\"" << endl;
+		exit(1);
+	}
+
+	string column_option = "dense";
+	opt_parser.get_value("-c", column_option);
+	bool sparse_output;
+	if ( column_option == "dense" )
+	{
+		sparse_output = false;
+	}
+	else if ( column_option == "sparse" )
+	{
+		sparse_output = true;
+	}
+	else
+	{
+		cerr << "Unrecognized -c parameter value \"" << column_option << "\"" << endl;
+		exit(1);
+	}
 
-		// If no normalization specified, set according to DB
-		if ( normalize_type == NER::NormalizationUnknown )
+	int		cache_entries = 0;
+	string	cache_option;
+	if (opt_parser.get_value("-cache", cache_option))
+	{
+		cache_entries = atoi(cache_option.c_str());
+		if (cache_entries < 0 || cache_option.find_first_not_of("0123456789") != string::npos)
 		{
-			normalize_type = dict.get_normalization_type();
+			cerr << "Unrecognized -cache parameter value \"" << cache_option << "\"" << endl;
+			exit(1);
 		}
+	}
 
-		// Check for mismatch in normalization type
-		if ( dict.get_normalization_type() != NER::NormalizationUnknown &&
-		     dict.get_normalization_type() != normalize_type)
+	string	multidoc_separator = "";
+	bool	multidoc_mode = opt_parser.get_value("-multidoc", multidoc_separator);
+
+	string	line_buffered_option;
+	bool	line_buffered = opt_parser.get_value("-line-buffered", line_buffered_option);
+
+	NER::DataFormat	in_format = NER::FORMAT_TSV, out_format = NER::FORMAT_TSV;
+	string	format_option;
+	if (opt_parser.get_value("-if", format_option) && !NER::parse_data_format(format_option, in_format))
+	{
+		cerr << "Unrecognized -if parameter value \"" << format_option << "\"" << endl;
+		exit(1);
+	}
+	if (opt_parser.get_value("-of", format_option) && !NER::parse_data_format(format_option, out_format))
+	{
+		cerr << "Unrecognized -of parameter value \"" << format_option << "\"" << endl;
+		exit(1);
+	}
+	if (in_format == NER::FORMAT_BINARY)
+		NER::set_binary_stdio(stdin);
+	if (out_format == NER::FORMAT_BINARY)
+		NER::set_binary_stdio(stdout);
+
+	vector<const NER::Dictionary*>	dicts;
+	vector<int>						normalize_types;
+
+	try
+	{
+		for (size_t i = 1; i < args.size(); ++i)
 		{
-			std::cerr << "Warning: given normalization (" << normalize_type << ") does not match DB normalization (" << dict.get_normalization_type() << "). Tagging performance may be decreased.\n";
+			NER::Dictionary	*dict = create_dictionary(args[i]);
+			dicts.push_back(dict);
+			dict->open();
+			dict->enable_cache(cache_entries);
+
+			// If no normalization specified, set according to DB
+			int		dict_normalize_type = normalize_type;
+			if ( dict_normalize_type == NER::NormalizationUnknown )
+			{
+				dict_normalize_type = dict->get_normalization_type();
+			}
+
+			// Check for mismatch in normalization type
+			if ( dict->get_normalization_type() != NER::NormalizationUnknown &&
+			     dict->get_normalization_type() != dict_normalize_type)
+			{
+				std::cerr << "Warning: given normalization (" << dict_normalize_type << ") does not match DB normalization (" << dict->get_normalization_type() << ") of " << args[i] << ". Tagging performance may be decreased.\n";
+			}
+			normalize_types.push_back(dict_normalize_type);
+
+			if ( similarity_threshold < 1.0 && !dict->has_ngram_index() )
+			{
+				std::cerr << "Warning: " << args[i] << " has no n-gram index. Only exact matches are tagged with this DB.\n";
+			}
 		}
-		
-		NER::SentenceTagger::set_normalize_type(normalize_type);
 
 		NER::SentenceTagger::set_overlap_resolution(overlap_resolution);
+		NER::SentenceTagger::set_approximate_matching(similarity_threshold, similarity_measure);
+		NER::SentenceTagger::set_sparse_output(sparse_output);
 
 		if ( pos_filter == "none" ) {
 			NER::SentenceTagger::set_POS_filter();  // no filters
@@ -224,57 +357,93 @@ int main(int argc, char* argv[])
 
 		// Tag input with a dictionary
 		NER::SentenceTagger	one_sent;
+		NER::OutputWriter	out(cout, line_buffered, out_format);
+		NER::SentenceReader	reader(cin, in_format);
 		
-		while (! cin.eof()) 
+		while (! reader.eof()) 
 		{
 			// 1. Skip if it is a blank line
-			if( one_sent.read(cin, multidoc_separator) == 0 ) {
+			if( one_sent.read(reader, multidoc_separator) == 0 ) {
 				continue;
 			}
 			
 			// 2. Print comment lines
 			if( multidoc_mode && one_sent.get_content_type() == 1 ) {
-				for( V2_STR::iterator irow = one_sent.begin(); irow != one_sent.end(); ++ irow) {
-					cout << irow->front() << endl;     // Comment is stored as a string at [0] position
-				}
-				cout << endl;
+				out.write_comment(one_sent.begin(), one_sent.end());     // Comment is stored as a string at [0] position
 				
 				continue;
 			}
 		  
 			// 3. Tag a sentence
-			one_sent.tag_nes(dict);     // Find the best NE candidate at the beginning of each word in a sentence
+			one_sent.tag_nes(dicts, normalize_types);     // Find the best NE candidate at the beginning of each word in a sentence
 
 			// 4. Print the output
 			if (!one_sent.empty())
 			{
-				for_each(one_sent.begin(), one_sent.end(), print);
-				cout << endl;
+				out.write_sent(one_sent.begin(), one_sent.end());
 			}
 		}
+		out.end_document();
+
+		// Report the cache hit rates
+		for (size_t i = 0; i < dicts.size() && cache_entries > 0; ++i)
+		{
+			NER::CacheStats	stats = dicts[i]->get_cache_stats();
+			cerr << "Cache of " << args[i + 1] << ": " << stats.hits << " hits in " << stats.lookups << " lookups";
+			if (stats.lookups > 0)
+			{
+				cerr << " (" << (100.0 * stats.hits / stats.lookups) << "%)";
+			}
+			cerr << endl;
+		}
 	}
 	catch (const cdbpp::cdbpp_exception& e)
 	{
 		// Abort if something went wrong...
 		std::cerr << "ERROR: " << e.what() << std::endl;
+		delete_dictionaries(dicts);
 		return 1;
 	}
 	catch (const NER::nersuite_exception& ex)
 	{
 		cerr << ex.what();
+		delete_dictionaries(dicts);
 		return 1;
 	}
+	delete_dictionaries(dicts);
 	return 0;
 }
 
-void print(vector<string> &item)
+void delete_dictionaries(vector<const NER::Dictionary*> &dicts)
 {
-	for(vector<string>::iterator itr1 = item.begin(); itr1 != item.end(); itr1++) {
-		cout << *itr1;
-		if((itr1 + 1) == item.end()) {
-			cout << endl;
-		}else {
-			cout << "\t";
-		}
+	for (vector<const NER::Dictionary*>::iterator itr = dicts.begin(); itr != dicts.end(); ++itr) {
+		delete *itr;
+	}
+	dicts.clear();
+}
+
+/* create a dictionary from a DB path, or BASE_DB+DELTA_DB[+...] */
+NER::Dictionary* create_dictionary(const string &db_spec)
+{
+	// A path containing '+' is taken as it is if the file exists
+	ifstream	ifs(db_spec.c_str());
+	if ( ifs.good() || db_spec.find('+') == string::npos )
+	{
+		return new NER::Dictionary(db_spec.c_str());
+	}
+
+	vector<string>	paths;
+	stringstream	spec_stream(db_spec);
+	string			path;
+	while ( getline(spec_stream, path, '+') ) // split by '+'
+	{
+		paths.push_back(path);
+	}
+
+	NER::Dictionary	*dict = new NER::Dictionary(paths[0].c_str());
+	for (size_t i = 1; i < paths.size(); ++i)
+	{
+		dict->add_delta(paths[i].c_str());
 	}
+	return dict;
 }
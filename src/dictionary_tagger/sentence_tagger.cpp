@@ -10,6 +10,9 @@ namespace NER
 	size_t SentenceTagger::max_ne_len = 10;
 	int SentenceTagger::normalize_type = NormalizeNone;
 	int SentenceTagger::overlap_resolution = OVL_TAG_LONGEST;
+	double SentenceTagger::similarity_threshold = 1.0;
+	int SentenceTagger::similarity_measure = SimilarityCosine;
+	bool SentenceTagger::sparse_output = false;
 
 	vector<string> SentenceTagger::require_exact_POS = vector<string>();
 	vector<string> SentenceTagger::require_prefix_POS = vector<string>();
@@ -23,34 +26,52 @@ namespace NER
 		v_ne.reserve(256);
 		v_idx.reserve(128);
 		m_ContentType = 0;
+		m_HitCols = 0;
 	}
 
 	size_t SentenceTagger::read(istream &is, const string &multidoc_separator)
 	{
-		m_Content.clear();		// clear the container
+		SentenceReader	reader(is, FORMAT_TSV, 0);
+		return read(reader, multidoc_separator);
+	}
+
+	size_t SentenceTagger::read(SentenceReader &reader, const string &multidoc_separator)
+	{
 		m_ContentType = 0;
 
-		string           line = "";
-		vector<string>   line_items;
+		if (reader.get_format() == FORMAT_BINARY)
+		{
+			bool	separator_read;
+			if (get_sent(reader, m_Content, multidoc_separator, separator_read) > 0)
+				set_content_type(separator_read ? 1 : 2);
+			return size();
+		}
+
+		size_t           n_lines = 0;
+		const char       *line;
+		size_t           len;
 
-		while (! is.eof()) 
+		while (! reader.eof()) 
 		{
-			getline(is, line);
+			reader.read_line(line, len);
 
 			// 1. Break if it reaches an empty line
-			if (line.empty())
+			if (len == 0)
 				break;
 
+			if (n_lines == m_Content.size())
+				m_Content.push_back(V1_STR());
+			V1_STR           &line_items = m_Content[n_lines++];
+
 			// 2. Deal with the comments  
-			if( multidoc_separator != "" && line.compare(0, multidoc_separator.length(), multidoc_separator) == 0 ) {
+			if( multidoc_separator != "" && multidoc_separator.compare(0, multidoc_separator.length(), line, min(len, multidoc_separator.length())) == 0 ) {
 				if( set_content_type( 1 ) == false ) {
 					exit(1);
 				}
 
 				// Save the line as it is
-				line_items.clear();
-				line_items.push_back( line );
-				m_Content.push_back( line_items );
+				line_items.resize(1);
+				line_items[0].assign(line, len);
 
 				continue;
 			}
@@ -60,34 +81,102 @@ namespace NER
 				exit(1);
 			}
 
-			tokenize(line_items, line, "\t");		// tokenize and
-			m_Content.push_back(line_items);		// save it
+			split_columns(line, len, line_items);		// tokenize and save it
 		}
+		m_Content.resize(n_lines);
 		
 		return size();
 	}
 
 	void SentenceTagger::tag_nes(const Dictionary& dict)
 	{
-		v_ne.clear();
-		v_idx.clear();
+		vector<const Dictionary*>	dicts(1, &dict);
+		vector<int>					normalize_types(1, normalize_type);
 
-		for (size_t i_row = 0; i_row < size(); ++i_row)
+		tag_nes(dicts, normalize_types);
+	}
+
+	void SentenceTagger::tag_nes(const vector<const Dictionary*>& dicts, const vector<int>& normalize_types)
+	{
+		// 1) Group the dictionaries by normalization type
+		size_t	n_groups = 0;
+		for (size_t i_dict = 0; i_dict < dicts.size(); ++i_dict)
 		{
-			vector<NE> nes;
+			size_t	g = 0;
+			while (g < n_groups && m_Groups[g].normalize_type != normalize_types[i_dict])
+			{
+				++g;
+			}
+			if (g == n_groups)
+			{
+				if (n_groups == m_Groups.size())
+				{
+					m_Groups.push_back(DictGroup());
+				}
+				m_Groups[g].normalize_type = normalize_types[i_dict];
+				m_Groups[g].members.clear();
+				++n_groups;
+			}
+			m_Groups[g].members.push_back(i_dict);
+		}
+		m_Groups.resize(n_groups);
 
-			if ( normalize_type & NormalizeToken )
+		// 2) Normalize each token once per group
+		for (vector<DictGroup>::iterator g = m_Groups.begin(); g != m_Groups.end(); ++g)
+		{
+			g->tokens.resize(size());
+			for (size_t i_row = 0; i_row < size(); ++i_row)
 			{
-				find_exact(i_row, nes, dict);
+				g->tokens[i_row] = Dictionary::normalize_key(m_Content[i_row][RAW_TOKEN_COL], g->normalize_type);
+			}
+			g->separator = Dictionary::normalize_key(" ", g->normalize_type);
+		}
+
+		// 3) Collect NE candidates of all dictionaries
+		compile_POS_filter();
+
+		v_nes.resize(dicts.size());
+		for (size_t i_dict = 0; i_dict < dicts.size(); ++i_dict)
+		{
+			v_nes[i_dict].clear();
+		}
+
+		for (vector<DictGroup>::const_iterator g = m_Groups.begin(); g != m_Groups.end(); ++g)
+		{
+			if ( g->normalize_type & NormalizeToken )
+			{
+				find_exact(*g, dicts);
 			}
 			else
 			{
-				find_longest(i_row, nes, dict);
+				find_longest(*g, dicts);
+			}
+		}
+
+		// 4) Tag the sentence with each dictionary in turn
+		if (sparse_output)
+		{
+			m_Hits.resize(size());
+			for (size_t i_row = 0; i_row < size(); ++i_row)
+			{
+				m_Hits[i_row].clear();
+			}
+			m_HitCols = 0;
+		}
+		for (size_t i_dict = 0; i_dict < dicts.size(); ++i_dict)
+		{
+			v_ne.swap(v_nes[i_dict]);
+			v_idx.clear();
+			resolve_collision();
+			mark_ne(*dicts[i_dict]);
+		}
+		if (sparse_output)
+		{
+			for (size_t i_row = 0; i_row < size(); ++i_row)
+			{
+				m_Content[i_row].push_back(format_dic_hits(m_Hits[i_row]));
 			}
-			v_ne.insert(v_ne.end(), nes.begin(), nes.end());
 		}
-		resolve_collision();
-		mark_ne(dict);
 	}
 
 	// Choose NEs to tag based on overlap resolution policy
@@ -108,15 +197,25 @@ namespace NER
 
 	void SentenceTagger::mark_ne(const Dictionary& dict)
 	{
-		int ori_n_col = (int) m_Content.front().size();
+		int ori_n_col;
 		size_t nclasses = dict.get_class_count();
 
 		// 1) Create dictionary check columns
-		for (V2_STR::iterator i_row = m_Content.begin(); i_row != m_Content.end(); ++i_row)
+		if (sparse_output)
+		{
+			// Columns are numbered across all dictionaries, and only hits are stored
+			ori_n_col = m_HitCols;
+			m_HitCols += (int) nclasses;
+		}
+		else
 		{
-			for (int k = 0; k < nclasses; ++k)
+			ori_n_col = (int) m_Content.front().size();
+			for (V2_STR::iterator i_row = m_Content.begin(); i_row != m_Content.end(); ++i_row)
 			{
-				i_row->push_back("O");
+				for (int k = 0; k < nclasses; ++k)
+				{
+					i_row->push_back("O");
+				}
 			}
 		}
 
@@ -124,18 +223,17 @@ namespace NER
 		for (vector<int>::const_iterator itr = v_idx.begin(); itr != v_idx.end(); ++itr) 
 		{
 			// Tag for all classes that this NE belongs to
-			for (list<string>::const_iterator cls_itr = v_ne[ *itr ].classes.begin();
-				cls_itr != v_ne[ *itr ].classes.end();
-				++cls_itr)
+			for (size_t i_cls = 0; i_cls < v_ne[ *itr ].n_classes; ++i_cls)
 			{
-				// 0) Get numeric class identifier and start position
-				const int cls_num = atoi(cls_itr->c_str());
+				// 0) Get numeric class identifier, its column and start position
+				const int cls_num = v_ne[ *itr ].classes[i_cls];
+				const int cls_col = ori_n_col + dict.get_class_column(cls_num);
 				int pos = v_ne[ *itr ].begin;
 
 				// Non-"O" tag indicates a preceding multi-token NE
 				// of the same class. Skip processing, giving preference
 				// to leftmost NEs within each class.
-				if ( m_Content[ pos ][ ori_n_col + cls_num ] != "O" )
+				if ( get_mark(pos, cls_col) != "O" )
 				{
 					continue;
 				}
@@ -144,16 +242,61 @@ namespace NER
 				const string&	sem_name = dict.get_class_name(cls_num);
 
 				// 2) Label the data
-				m_Content[ pos ][ ori_n_col + cls_num ] = "B-" + sem_name;
+				set_mark(pos, cls_col, "B-" + sem_name);
 
 				for (pos = pos + 1; pos <= v_ne[ *itr ].end; ++pos)
 				{
-					m_Content[ pos ][ ori_n_col + cls_num ] = "I-" + sem_name;
+					set_mark(pos, cls_col, "I-" + sem_name);
 				}
 			}
 		}
 	}
 
+	const string& SentenceTagger::get_mark(size_t row, int col) const
+	{
+		static const string	no_mark = "O";
+
+		if (!sparse_output)
+		{
+			return m_Content[row][col];
+		}
+
+		const DIC_HITS&	hits = m_Hits[row];
+		for (DIC_HITS::const_iterator i = hits.begin(); i != hits.end(); ++i)
+		{
+			if (i->first == col)
+			{
+				return i->second;
+			}
+		}
+		return no_mark;
+	}
+
+	void SentenceTagger::set_mark(size_t row, int col, const string& value)
+	{
+		if (!sparse_output)
+		{
+			m_Content[row][col] = value;
+			return;
+		}
+
+		// Keep the hits in column order
+		DIC_HITS&	hits = m_Hits[row];
+		DIC_HITS::iterator	i = hits.begin();
+		while (i != hits.end() && i->first < col)
+		{
+			++i;
+		}
+		if (i != hits.end() && i->first == col)
+		{
+			i->second = value;
+		}
+		else
+		{
+			hits.insert(i, make_pair(col, value));
+		}
+	}
+
 	bool SentenceTagger::find_range(size_t i_row, size_t& min_len, size_t& max_len) const
 	{
 		min_len = 0;
@@ -193,114 +336,277 @@ namespace NER
 		}
 	}
 
-	string SentenceTagger::make_key(size_t i_row, size_t key_len) const
+	void SentenceTagger::make_keys(size_t i_row, size_t max_len, const DictGroup& group)
 	{
-		string key = m_Content[i_row][RAW_TOKEN_COL];
+		// Build the longest key from the normalized tokens; every shorter
+		// key is a prefix of it, ending at m_KeyEnds[key_len]
+		m_Key.clear();
+		m_KeyEnds.assign(1, 0);
 
-		for (int idx = 1; idx < key_len; ++idx)
+		for (size_t idx = 0; idx < max_len; ++idx)
 		{
-			if (m_Content[i_row + idx][BEG_COL] != m_Content[i_row + idx - 1][END_COL])
+			if (idx > 0 && m_Content[i_row + idx][BEG_COL] != m_Content[i_row + idx - 1][END_COL])
 			{
-				key += " ";  // Space between two tokens
+				Dictionary::append_normalized_key(m_Key, group.separator, group.normalize_type);  // Space between two tokens
 			}
-			key += m_Content[i_row + idx][RAW_TOKEN_COL];
+			Dictionary::append_normalized_key(m_Key, group.tokens[i_row + idx], group.normalize_type);
+			m_KeyEnds.push_back(m_Key.length());
 		}
-
-		return key;
 	}
 
-	int SentenceTagger::find_exact(size_t i_row, vector<NE>& nes, const Dictionary& dict) const
+	void SentenceTagger::find_exact(const DictGroup& group, const vector<const Dictionary*>& dicts)
 	{
 		// Token-base matching --- try to match each single word of
 		// the sentence with single token in the dictionary
 
-		// Search dictionary
-		string key = m_Content[i_row][RAW_TOKEN_COL];
-
-		size_t count;
-		const int *value = dict.get_classes(key, normalize_type, &count);
-		if (value != NULL)
+		// Search dictionaries with the tokens normalized once for the group,
+		// all tokens of the sentence in one batch
+		m_Queries.resize(size());
+		for (vector<size_t>::const_iterator i_dict = group.members.begin(); i_dict != group.members.end(); ++i_dict)
 		{
-			NE ne;
-			ne.begin = i_row;
-			ne.end = i_row;
-			for (int i = 0; i < count; ++i)
+			const Dictionary&	dict = *dicts[*i_dict];
+
+			for (size_t i_row = 0; i_row < size(); ++i_row)
+			{
+				m_Queries[i_row].key = group.tokens[i_row].data();
+				m_Queries[i_row].key_len = group.tokens[i_row].length();
+			}
+			if (!m_Queries.empty())
+			{
+				dict.get_normalized_classes_batch(&m_Queries[0], m_Queries.size());
+			}
+
+			for (size_t i_row = 0; i_row < size(); ++i_row)
 			{
-				ne.classes.push_back(int2str(value[i]));
+				size_t count = m_Queries[i_row].count;
+				double sim = 1.0;
+				const int *value = m_Queries[i_row].classes;
+				if (value == NULL)
+				{
+					value = find_similar(dict, m_Queries[i_row].key, m_Queries[i_row].key_len, &count, &sim);
+				}
+				if (value != NULL)
+				{
+					NE ne;
+					ne.begin = i_row;
+					ne.end = i_row;
+					ne.classes = value;
+					ne.n_classes = count;
+					ne.sim = sim;
+					v_nes[*i_dict].push_back(ne);
+				}
 			}
-			ne.sim = 1.0;
-			nes.push_back(ne);
-			return 1;
 		}
-		return 0;
 	}
 
-	int SentenceTagger::find_longest(size_t i_row, vector<NE>& nes, const Dictionary& dict) const
+	void SentenceTagger::find_longest(const DictGroup& group, const vector<const Dictionary*>& dicts)
 	{
 		// Normal matching --- try to find the longest sequence of
 		// words that matches a dictionary entry
 
-		size_t	key_min_len, key_max_len;
-		
-		find_range(i_row, key_min_len, key_max_len);
+		// 1) Make the candidate keys of all rows
+		m_Rows.resize(size());
+		m_SentKeys.clear();
+		m_SentKeyEnds.clear();
+		for (size_t i_row = 0; i_row < size(); ++i_row)
+		{
+			RowKeys&	rk = m_Rows[i_row];
 
-		// Search dictionary, longer candidate first
-		size_t	key_len = key_max_len;
-		for (; key_len > key_min_len; --key_len)
+			find_range(i_row, rk.min_len, rk.max_len);
+			if (rk.max_len <= rk.min_len)
+			{
+				continue;
+			}
+
+			make_keys(i_row, rk.max_len, group);
+			rk.key_beg = m_SentKeys.length();
+			rk.key_head_len = Dictionary::key_head_length(m_Key.data(), m_Key.length());
+			rk.ends_beg = m_SentKeyEnds.size();
+			m_SentKeys += m_Key;
+			m_SentKeyEnds.insert(m_SentKeyEnds.end(), m_KeyEnds.begin(), m_KeyEnds.end());
+		}
+
+		for (vector<size_t>::const_iterator i_dict = group.members.begin(); i_dict != group.members.end(); ++i_dict)
 		{
-			// 1) Make a key
-			string key = make_key(i_row, key_len);
+			const Dictionary&	dict = *dicts[*i_dict];
 
-			// 2) Search Dictionary
-			size_t count;
-			const int *value = dict.get_classes(key, normalize_type, &count);
-			if (value != NULL)
+			// 2) Collect the candidates which can match, skipping those of a
+			// length no key beginning with the same head has
+			m_Queries.clear();
+			m_QueryIdx.assign(m_SentKeyEnds.size(), -1);
+			for (size_t i_row = 0; i_row < size(); ++i_row)
 			{
-				NE ne;
-				ne.begin = i_row;
-				ne.end = i_row + key_len - 1;	// Range is [begin, end]
-				for (int i = 0; i < count; ++i)
+				const RowKeys&	rk = m_Rows[i_row];
+				if (rk.max_len <= rk.min_len)
 				{
-					ne.classes.push_back(int2str(value[i]));
+					continue;
 				}
-				ne.sim = 1.0;
-				nes.push_back(ne);
-				if ( overlap_resolution == OVL_TAG_LONGEST )
+
+				const char*	key = m_SentKeys.data() + rk.key_beg;
+				size_t		cached_head_len = (size_t)(-1);
+				const int*	lengths = NULL;
+				size_t		n_lengths = 0;
+				for (size_t key_len = rk.max_len; key_len > rk.min_len; --key_len)
 				{
-					return key_len;  // Break when longest found
+					const size_t	nkey_len = m_SentKeyEnds[rk.ends_beg + key_len];
+
+					if (dict.has_key_length_index())
+					{
+						const size_t	head_len = (nkey_len < rk.key_head_len) ? nkey_len : rk.key_head_len;
+						if (cached_head_len != head_len)
+						{
+							cached_head_len = head_len;
+							lengths = dict.get_key_lengths(key, head_len, &n_lengths);
+						}
+						if (lengths == NULL || !binary_search(lengths, lengths + n_lengths, (int) nkey_len))
+						{
+							continue;
+						}
+					}
+
+					ClassQuery	query;
+					query.key = key;
+					query.key_len = nkey_len;
+					m_QueryIdx[rk.ends_beg + key_len] = (int) m_Queries.size();
+					m_Queries.push_back(query);
+				}
+			}
+
+			// 3) Search the Dictionary
+			if (!m_Queries.empty())
+			{
+				dict.get_normalized_classes_batch(&m_Queries[0], m_Queries.size());
+			}
+
+			// 4) Take the matches of each row, longer candidate first
+			for (size_t i_row = 0; i_row < size(); ++i_row)
+			{
+				const RowKeys&	rk = m_Rows[i_row];
+				if (rk.max_len <= rk.min_len)
+				{
+					continue;
+				}
+
+				for (size_t key_len = rk.max_len; key_len > rk.min_len; --key_len)
+				{
+					const int	q = m_QueryIdx[rk.ends_beg + key_len];
+
+					size_t count = 0;
+					double sim = 1.0;
+					const int *value = NULL;
+					if (q >= 0)
+					{
+						value = m_Queries[q].classes;
+						count = m_Queries[q].count;
+					}
+					if (value == NULL)
+					{
+						value = find_similar(dict, m_SentKeys.data() + rk.key_beg, m_SentKeyEnds[rk.ends_beg + key_len], &count, &sim);
+					}
+					if (value != NULL)
+					{
+						NE ne;
+						ne.begin = i_row;
+						ne.end = i_row + key_len - 1;	// Range is [begin, end]
+						ne.classes = value;
+						ne.n_classes = count;
+						ne.sim = sim;
+						v_nes[*i_dict].push_back(ne);
+						if ( overlap_resolution == OVL_TAG_LONGEST )
+						{
+							break;  // Done when longest found
+						}
+					}
 				}
 			}
 		}
-		return 0;
 	}
 
-	size_t SentenceTagger::find_min_length(size_t i_row) const
+	const int* SentenceTagger::find_similar(const Dictionary& dict, const char* nkey, size_t nkey_len, size_t* count, double* sim)
 	{
-		size_t end = i_row + max_ne_len;
+		if (similarity_threshold >= 1.0 || !dict.has_ngram_index())
+		{
+			return NULL;
+		}
 
-		if (end >= size())
+		// Take the classes of the most similar key
+		if (dict.get_similar_keys(nkey, nkey_len, similarity_measure, similarity_threshold, m_SimilarKeys) == 0)
 		{
-			end = size();
+			return NULL;
+		}
+		*sim = m_SimilarKeys.front().sim;
+		return dict.get_normalized_classes(m_SimilarKeys.front().key, m_SimilarKeys.front().key_len, count);
+	}
+
+	void SentenceTagger::compile_POS_filter()
+	{
+		if (!filter_require_POS && !filter_disallow_POS)
+		{
+			return;
 		}
 
-		for (size_t col = i_row ; col < end; ++col)
+		// 1) Classify the POS of each token once
+		m_POSFlags.assign(size(), 0);
+		for (size_t col = 0; col < size(); ++col)
 		{
+			const string&	pos = m_Content[col][POS_COL];
+
 			// exact match
-			if (find(require_exact_POS.begin(), require_exact_POS.end(),
-				 m_Content[col][POS_COL]) != require_exact_POS.end())
+			if (find(require_exact_POS.begin(), require_exact_POS.end(), pos) != require_exact_POS.end())
 			{
-				return col - i_row;
-			}			   
+				m_POSFlags[col] |= POS_REQUIRED;
+			}
 			// prefix match
-			for (vector<string>::iterator i = require_prefix_POS.begin();
-			     i != require_prefix_POS.end(); ++i)
+			for (vector<string>::const_iterator i = require_prefix_POS.begin();
+			     !(m_POSFlags[col] & POS_REQUIRED) && i != require_prefix_POS.end(); ++i)
 			{
-				if (m_Content[col][POS_COL].substr(0, (*i).length()) == *i)
+				if (pos.compare(0, (*i).length(), *i) == 0)
 				{
-					return col - i_row;
+					m_POSFlags[col] |= POS_REQUIRED;
+				}
+			}
+
+			// exact match
+			if (find(disallow_exact_POS.begin(), disallow_exact_POS.end(), pos) != disallow_exact_POS.end())
+			{
+				m_POSFlags[col] |= POS_DISALLOWED;
+			}
+			// prefix match
+			for (vector<string>::const_iterator i = disallow_prefix_POS.begin();
+			     !(m_POSFlags[col] & POS_DISALLOWED) && i != disallow_prefix_POS.end(); ++i)
+			{
+				if (pos.compare(0, (*i).length(), *i) == 0)
+				{
+					m_POSFlags[col] |= POS_DISALLOWED;
 				}
 			}
 		}
+
+		// 2) Find the next required / disallowed token of each row in a backward pass
+		m_NextRequired.resize(size() + 1);
+		m_NextDisallowed.resize(size() + 1);
+		m_NextRequired[size()] = size();
+		m_NextDisallowed[size()] = size();
+		for (size_t col = size(); col-- > 0; )
+		{
+			m_NextRequired[col] = (m_POSFlags[col] & POS_REQUIRED) ? col : m_NextRequired[col + 1];
+			m_NextDisallowed[col] = (m_POSFlags[col] & POS_DISALLOWED) ? col : m_NextDisallowed[col + 1];
+		}
+	}
+
+	size_t SentenceTagger::find_min_length(size_t i_row) const
+	{
+		size_t end = i_row + max_ne_len;
+
+		if (end >= size())
+		{
+			end = size();
+		}
+
+		if (m_NextRequired[i_row] < end)
+		{
+			return m_NextRequired[i_row] - i_row;
+		}
 		return (size_t)(-1);
 	}
 
@@ -313,23 +619,9 @@ namespace NER
 			end = size();
 		}
 
-		for (size_t col = i_row ; col < end; ++col)
+		if (m_NextDisallowed[i_row] < end)
 		{
-			// exact match
-			if (find(disallow_exact_POS.begin(), disallow_exact_POS.end(),
-				 m_Content[col][POS_COL]) != disallow_exact_POS.end())
-			{
-				return col - i_row;
-			}			   
-			// prefix match
-			for (vector<string>::iterator i = disallow_prefix_POS.begin();
-			     i != disallow_prefix_POS.end(); ++i)
-			{
-				if (m_Content[col][POS_COL].substr(0, (*i).length()) == *i)
-				{
-					return col - i_row;
-				}
-			}
+			return m_NextDisallowed[i_row] - i_row;
 		}
 		return end - i_row;
 	}
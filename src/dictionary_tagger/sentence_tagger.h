@@ -35,6 +35,7 @@
 #include <iostream>
 #include "../nersuite_common/dictionary.h"
 #include "../nersuite_common/ne.h"
+#include "../nersuite_common/text_loader.h"
 
 // Predefined column info.
 #define		BEG_COL			0
@@ -42,6 +43,10 @@
 #define		RAW_TOKEN_COL	2
 #define		POS_COL			4
 
+// POS filter flags of a token
+#define		POS_REQUIRED		0x01
+#define		POS_DISALLOWED		0x02
+
 // Overlap resolution policy constants
 #define		OVL_TAG_LONGEST		0
 #define		OVL_TAG_ALL		1
@@ -72,6 +77,9 @@ namespace NER
 		static size_t max_ne_len;
 		static int normalize_type;
 		static int overlap_resolution;
+		static double similarity_threshold;
+		static int similarity_measure;
+		static bool sparse_output;
 
 		// POS filter-related data (see set_POS_filter())
 		static std::vector<std::string> require_exact_POS;
@@ -89,6 +97,52 @@ namespace NER
 
 		std::vector<int>	v_idx;
 
+		// Dictionaries sharing a normalization type (see tag_nes())
+		struct DictGroup
+		{
+			int normalize_type;
+			std::vector<size_t> members;	// indices into the dictionary list
+
+			std::vector<std::string> tokens;	// normalized tokens of the sentence
+			std::string separator;				// normalized space between two tokens
+		};
+
+		std::vector<DictGroup>	m_Groups;
+		std::vector< std::vector<NE> >	v_nes;	// NE candidates of each dictionary
+
+		// POS filter compiled for the current sentence (see compile_POS_filter())
+		std::vector<unsigned char>	m_POSFlags;			// POS_REQUIRED / POS_DISALLOWED bits of each token
+		std::vector<size_t>	m_NextRequired;		// first row >= i with a required POS, or size()
+		std::vector<size_t>	m_NextDisallowed;	// first row >= i with a disallowed POS, or size()
+
+		// Reusable buffer for candidate keys starting at a row (see make_keys())
+		std::string			m_Key;
+		std::vector<size_t>	m_KeyEnds;		// m_KeyEnds[n]: length of the key made of n tokens
+
+		// Candidate keys of the whole sentence, looked up in one batch per dictionary
+		// (see find_longest()).  The keys starting at a row are prefixes of the longest one.
+		struct RowKeys
+		{
+			size_t min_len;			// candidates are (min_len, max_len] tokens long
+			size_t max_len;
+			size_t key_beg;			// offset of the longest key in m_SentKeys
+			size_t key_head_len;	// see Dictionary::key_head_length()
+			size_t ends_beg;		// m_SentKeyEnds[ends_beg + n]: length of the key made of n tokens
+		};
+		std::vector<RowKeys>	m_Rows;
+		std::string			m_SentKeys;
+		std::vector<size_t>	m_SentKeyEnds;
+
+		std::vector<ClassQuery>	m_Queries;
+		std::vector<int>	m_QueryIdx;		// m_SentKeyEnds index --> index into m_Queries, or -1
+
+		// Reusable buffer for approximate matching (see find_similar())
+		std::vector<SimilarKey>	m_SimilarKeys;
+
+		// Dictionary hits of each token in the sparse output (see set_sparse_output())
+		std::vector<DIC_HITS>	m_Hits;
+		int		m_HitCols;		// count of dictionary columns marked so far
+
 	public:
 		/**
 		* Constructs a SentenceTagger object
@@ -113,6 +167,27 @@ namespace NER
 		*/
 		static void set_overlap_resolution(int o) { overlap_resolution = o; }
 
+		/**
+		* Set approximate matching.  A candidate sequence with no exact match in a
+		* Dictionary having an n-gram index is tagged with the classes of the most
+		* similar key, if its similarity reaches the threshold.
+		* @param[in] threshold Minimum similarity (1.0: exact matching only)
+		* @param[in] measure Similarity measure (a SimilarityMeasure)
+		*/
+		static void set_approximate_matching(double threshold, int measure = SimilarityCosine) {
+			similarity_threshold = threshold;
+			similarity_measure = measure;
+		}
+
+		/**
+		* Set the output column format.  The dense format appends one column per
+		* Dictionary class, "O" unless matched.  The sparse format appends a single
+		* column listing the matched columns only, e.g. "0:B-Gene|3:I-Chemical"
+		* (see parse_dic_hits()), or "O" if none.
+		* @param[in] sparse true for the sparse format
+		*/
+		static void set_sparse_output(bool sparse) { sparse_output = sparse; }
+
 		/**
 		* Set candidate sequence POS tag filter.  Only sequences
 		* containing a POS tag matching any in tag in in_exact or in_prefix
@@ -197,24 +272,51 @@ namespace NER
 		*/
 		size_t	read(std::istream &ifs, const std::string &multidoc_separator="");
 
+		/**
+		* Read a sentence with the given reader and create the internal token list.
+		* The rows of the previous sentence are reused.
+		* @param[in] multidoc_separator String marking document break (if non-empty)
+		* @return Size of tokens read
+		*/
+		size_t	read(SentenceReader &reader, const std::string &multidoc_separator="");
+
 		/**
 		* Append dictionary-class features to the internal token list.
 		* @param[in] dict The Dictionary used to search for feature classes.
 		*/
 		void	tag_nes(const Dictionary& dict);
 
+		/**
+		* Append dictionary-class features of several Dictionaries to the internal token list.
+		* The columns of each Dictionary are appended in the given order, as if the
+		* sentence was tagged with each Dictionary in turn. Candidate keys are built
+		* and normalized only once for all Dictionaries queried with the same normalization type.
+		* @param[in] dicts The Dictionaries used to search for feature classes.
+		* @param[in] normalize_types Normalization type used to query each Dictionary.
+		*/
+		void	tag_nes(const std::vector<const Dictionary*>& dicts, const std::vector<int>& normalize_types);
+
 	private:
 		void	resolve_collision();
 
 		void	mark_ne(const Dictionary& dict);
 
-		std::string make_key(size_t i_row, size_t key_len) const;
+		const std::string&	get_mark(size_t row, int col) const;
+
+		void	set_mark(size_t row, int col, const std::string& value);
+
+		void make_keys(size_t i_row, size_t max_len, const DictGroup& group);
 
 		bool find_range(size_t i_row, size_t& min_len, size_t& max_len) const;
 
-		int find_longest(size_t i_row, std::vector<NE>& nes, const Dictionary& dict) const;
+		void find_longest(const DictGroup& group, const std::vector<const Dictionary*>& dicts);
+
+		void find_exact(const DictGroup& group, const std::vector<const Dictionary*>& dicts);
+
+		const int* find_similar(const Dictionary& dict, const char* nkey, size_t nkey_len, size_t* count, double* sim);
 
-		int find_exact(size_t i_row, std::vector<NE>& nes, const Dictionary& dict) const;
+		/* Classify the POS of each token and fill the next-required / next-disallowed tables. */
+		void	compile_POS_filter();
 
 		/* Return minimum length of sequence satisfying required POS filter. */
 		size_t	find_min_length(size_t i_row) const;
@@ -11,14 +11,14 @@
 #include <sstream>
 #include <cmath>
 #include <set>
+#include <algorithm>
 #include "maxent.h"
 #include "common.h"
+#include "../../nersuite_common/thread_utils.h"
 
 using namespace std;
 
 const int UPDATE_WINDOW_SIZE = 2;
-//const int BEAM_NUM = 10;
-const int BEAM_NUM = 1;
 const double BEAM_WINDOW = 0.01;
 //const double BEAM_WINDOW = 0.9;
 const bool ONLY_VERTICAL_FEATURES = false;
@@ -27,20 +27,21 @@ const bool ONLY_VERTICAL_FEATURES = false;
 void tokenize(const string & s1, list<string> & lt);
 string base_form(const string & s, const string & pos);
 
-void bidir_chuning_decode_beam(vector<Token> & vt, const vector<ME_Model> & vme);
+void bidir_chuning_decode_beam(vector<Token> & vt, const vector<ME_Model> & vme,
+                               ClassificationMemo * memo = NULL, const int beam_width = 1);
+void bidir_chunking_decode_greedy(vector<Token> & vt, const vector<ME_Model> & vme,
+                                  bool left_to_right);
 
-static ME_Sample
-mesample(const vector<Token> &vt, int i,
-         const string & pos_left2, const string & pos_left1, 
-         const string & pos_right1, const string & pos_right2)
+// The features of a token are split into the ones that depend only on the
+// words (word_features_head/tail) and the ones that depend on the tags of
+// the neighbours (tag_features). mesample() puts them in that order, which
+// the ID-based classification in Hypothesis::Update reproduces.
+static void
+word_features_head(const vector<Token> &vt, int i, vector<string> & features)
 {
-  ME_Sample sample;
+  const string & str = vt[i].str;
 
-  string str = vt[i].str;
-
-  sample.label = vt[i].pos;
-
-  sample.features.push_back("W0_" + str);
+  features.push_back("W0_" + str);
   string prestr = "BOS";
   if (i > 0) prestr = vt[i-1].str;
   //  string prestr2 = "BOS2";
@@ -51,88 +52,100 @@ mesample(const vector<Token> &vt, int i,
   //  if (i < (int)vt.size()-2) poststr2 = normalize(vt[i+2].str);
 
   if (!ONLY_VERTICAL_FEATURES) {
-    sample.features.push_back("W-1_" + prestr);
-    sample.features.push_back("W+1_" + poststr);
+    features.push_back("W-1_" + prestr);
+    features.push_back("W+1_" + poststr);
 
-    sample.features.push_back("W-10_" + prestr + "_" + str);
-    sample.features.push_back("W0+1_" + str  + "_" + poststr);
+    features.push_back("W-10_" + prestr + "_" + str);
+    features.push_back("W0+1_" + str  + "_" + poststr);
   }
 
   for (int j = 1; j <= 10; j++) {
     char buf[1000];
     if (str.size() >= j) {
       sprintf(buf, "suf%d_%s", j, str.substr(str.size() - j).c_str());
-      sample.features.push_back(buf);
+      features.push_back(buf);
     }
     if (str.size() >= j) {
       sprintf(buf, "pre%d_%s", j, str.substr(0, j).c_str());
-      sample.features.push_back(buf);
+      features.push_back(buf);
     }
   }
+}
+
+static void
+tag_features(const string & str,
+             const string & pos_left2, const string & pos_left1, 
+             const string & pos_right1, const string & pos_right2,
+             vector<string> & features)
+{
   // L
   if (pos_left1 != "") {
-    sample.features.push_back("P-1_" + pos_left1);
-    sample.features.push_back("P-1W0_"  + pos_left1 + "_" + str);
+    features.push_back("P-1_" + pos_left1);
+    features.push_back("P-1W0_"  + pos_left1 + "_" + str);
   }
   // L2
   if (pos_left2 != "") {
-    sample.features.push_back("P-2_" + pos_left2);
+    features.push_back("P-2_" + pos_left2);
   }
   // R
   if (pos_right1 != "") {
-    sample.features.push_back("P+1_" + pos_right1);
-    sample.features.push_back("P+1W0_"  + pos_right1 + "_" + str);
+    features.push_back("P+1_" + pos_right1);
+    features.push_back("P+1W0_"  + pos_right1 + "_" + str);
   }
   // R2
   if (pos_right2 != "") {
-    sample.features.push_back("P+2_" + pos_right2);
+    features.push_back("P+2_" + pos_right2);
   }
   // LR
   if (pos_left1 != "" && pos_right1 != "") {
-    sample.features.push_back("P-1+1_" + pos_left1 + "_" + pos_right1);
-    sample.features.push_back("P-1W0P+1_"  + pos_left1 + "_" + str + "_" + pos_right1);
+    features.push_back("P-1+1_" + pos_left1 + "_" + pos_right1);
+    features.push_back("P-1W0P+1_"  + pos_left1 + "_" + str + "_" + pos_right1);
   }
   // LL
   if (pos_left1 != "" && pos_left2 != "") {
-    sample.features.push_back("P-2-1_" + pos_left2 + "_" + pos_left1);
-    //    sample.features.push_back("P-1W0_"  + pos_left + "_" + str);
+    features.push_back("P-2-1_" + pos_left2 + "_" + pos_left1);
+    //    features.push_back("P-1W0_"  + pos_left + "_" + str);
   }
   // RR
   if (pos_right1 != "" && pos_right2 != "") {
-    sample.features.push_back("P+1+2_" + pos_right1 + "_" + pos_right2);
-    //    sample.features.push_back("P-1W0_"  + pos_left + "_" + str);
+    features.push_back("P+1+2_" + pos_right1 + "_" + pos_right2);
+    //    features.push_back("P-1W0_"  + pos_left + "_" + str);
   }
   // LLR
   if (pos_left1 != "" && pos_left2 != "" && pos_right1 != "") {
-    sample.features.push_back("P-2-1+1_" + pos_left2 + "_" + pos_left1 + "_" + pos_right1);
-    //    sample.features.push_back("P-1W0_"  + pos_left + "_" + str);
+    features.push_back("P-2-1+1_" + pos_left2 + "_" + pos_left1 + "_" + pos_right1);
+    //    features.push_back("P-1W0_"  + pos_left + "_" + str);
   }
   // LRR
   if (pos_left1 != "" && pos_right1 != "" && pos_right2 != "") {
-    sample.features.push_back("P-1+1+2_" + pos_left1 + "_" + pos_right1 + "_" + pos_right2);
-    //    sample.features.push_back("P-1W0_"  + pos_left + "_" + str);
+    features.push_back("P-1+1+2_" + pos_left1 + "_" + pos_right1 + "_" + pos_right2);
+    //    features.push_back("P-1W0_"  + pos_left + "_" + str);
   }
   // LLRR
   if (pos_left2 != "" && pos_left1 != "" && pos_right1 != "" && pos_right2 != "") {
-    sample.features.push_back("P-2-1+1+2_" + pos_left2 + "_" + pos_left1 + "_" + pos_right1 + "_" + pos_right2);
-    //    sample.features.push_back("P-1W0_"  + pos_left + "_" + str);
+    features.push_back("P-2-1+1+2_" + pos_left2 + "_" + pos_left1 + "_" + pos_right1 + "_" + pos_right2);
+    //    features.push_back("P-1W0_"  + pos_left + "_" + str);
   }
+}
 
+static void
+word_features_tail(const string & str, vector<string> & features)
+{
   for (int j = 0; j < str.size(); j++) {
     if (isdigit(str[j])) {
-      sample.features.push_back("CONTAIN_NUMBER");
+      features.push_back("CONTAIN_NUMBER");
       break;
     }
   }
   for (int j = 0; j < str.size(); j++) {
     if (isupper(str[j])) {
-      sample.features.push_back("CONTAIN_UPPER");
+      features.push_back("CONTAIN_UPPER");
       break;
     }
   }
   for (int j = 0; j < str.size(); j++) {
     if (str[j] == '-') {
-      sample.features.push_back("CONTAIN_HYPHEN");
+      features.push_back("CONTAIN_HYPHEN");
       break;
     }
   }
@@ -145,18 +158,22 @@ mesample(const vector<Token> &vt, int i,
     }
   }
   if (allupper)
-    sample.features.push_back("ALL_UPPER");
+    features.push_back("ALL_UPPER");
+}
 
+static ME_Sample
+mesample(const vector<Token> &vt, int i,
+         const string & pos_left2, const string & pos_left1, 
+         const string & pos_right1, const string & pos_right2)
+{
+  ME_Sample sample;
+
+  sample.label = vt[i].pos;
+
+  word_features_head(vt, i, sample.features);
+  tag_features(vt[i].str, pos_left2, pos_left1, pos_right1, pos_right2, sample.features);
+  word_features_tail(vt[i].str, sample.features);
 
-  //  for (int j = 0; j < vt.size(); j++)
-  //    cout << vt[j].str << " ";
-  //  cout << endl;
-  //  cout << i << endl;
-  //  for (list<string>::const_iterator j = sample.features.begin(); j != sample.features.end(); j++) {
-  //    cout << *j << " ";
-  //  }
-  //  cout << endl << endl;
-  
   return sample;
 }
 
@@ -333,55 +350,116 @@ static double entropy(const vector<double>& v)
     return -sum;
 }
 
+// Trains the model of type t, i.e. the one used when the tags selected by the
+// bits of t are known (see Hypothesis::Update), and saves it to filename.
 int
-bidir_train(const vector<Sentence> & vs, int para)
+bidir_train(const vector<Sentence> & vs, int t, const string & filename,
+            const TrainingParameters & param)
 {
-  //  vme.clear();
-  //  vme.resize(16);
+  assert(t >= 0 && t < 16);
+  vector<ME_Sample> train;
 
-  for (int t = 0; t < 16; t++) {
-    if (t != 15 && t != 0) continue;
-  //  for (int t = 15; t >= 0; t--) {
-    vector<ME_Sample> train;
-
-    if (para != -1 && t % 4 != para) continue;
-    //    if (t % 2 == 1) continue;
+  if (param.verbose) {
     cerr << "type = " << t << endl;
     cerr << "extracting features...";
-    int n = 0;
-    for (vector<Sentence>::const_iterator i = vs.begin(); i != vs.end(); i++) {
-      const Sentence & s = *i;
-      for (int j = 0; j < s.size(); j++) {
-
-        string pos_left1 = "BOS", pos_left2 = "BOS2";
-        if (j >= 1) pos_left1 = s[j-1].pos;
-        if (j >= 2) pos_left2 = s[j-2].pos;
-        string pos_right1 = "EOS", pos_right2 = "EOS2";
-        if (j <= int(s.size()) - 2) pos_right1 = s[j+1].pos;
-        if (j <= int(s.size()) - 3) pos_right2 = s[j+2].pos;
-        if ( (t & 0x8) == 0 ) pos_left2 = "";
-        if ( (t & 0x4) == 0 ) pos_left1 = "";
-        if ( (t & 0x2) == 0 ) pos_right1 = "";
-        if ( (t & 0x1) == 0 ) pos_right2 = "";
-
-        train.push_back(mesample(s, j, pos_left2, pos_left1, pos_right1, pos_right2));
-      }
-      //      if (n++ > 1000) break;
+  }
+  for (vector<Sentence>::const_iterator i = vs.begin(); i != vs.end(); i++) {
+    const Sentence & s = *i;
+    for (int j = 0; j < s.size(); j++) {
+
+      string pos_left1 = "BOS", pos_left2 = "BOS2";
+      if (j >= 1) pos_left1 = s[j-1].pos;
+      if (j >= 2) pos_left2 = s[j-2].pos;
+      string pos_right1 = "EOS", pos_right2 = "EOS2";
+      if (j <= int(s.size()) - 2) pos_right1 = s[j+1].pos;
+      if (j <= int(s.size()) - 3) pos_right2 = s[j+2].pos;
+      if ( (t & 0x8) == 0 ) pos_left2 = "";
+      if ( (t & 0x4) == 0 ) pos_left1 = "";
+      if ( (t & 0x2) == 0 ) pos_right1 = "";
+      if ( (t & 0x1) == 0 ) pos_right2 = "";
+
+      train.push_back(mesample(s, j, pos_left2, pos_left1, pos_right1, pos_right2));
     }
-    cerr << "done" << endl;
-
-    ME_Model m;
-    //    m.set_heldout(1000,0);
-    //    m.train(train, 2, 1000, 0);
-    m.train(train, 2, 0, 1);
-    char buf[1000];
-    sprintf(buf, "model.bidir.%d", t);
-    m.save_to_file(buf);
-    
   }
+  if (param.verbose) cerr << "done" << endl;
+
+  ME_Model m;
+  m.set_num_threads(param.num_threads);
+  m.set_verbose(param.verbose);
+  //    m.set_heldout(1000,0);
+  if (!m.train(train, param.cutoff, param.sigma, param.widthfactor)) return -1;
+  if (!m.save_to_file(filename)) return -1;
+
   return 0;
 }
 
+// Writes the tags seen with each word of vs that occurs at least min_count
+// times to filename, a word and its tags (tab-separated) per line
+int
+save_tagdic(const vector<Sentence> & vs, int min_count, const string & filename)
+{
+  map<string, int> count;
+  map<string, set<string> > tags;
+  for (vector<Sentence>::const_iterator i = vs.begin(); i != vs.end(); i++) {
+    for (Sentence::const_iterator j = i->begin(); j != i->end(); j++) {
+      count[j->str]++;
+      tags[j->str].insert(j->pos);
+    }
+  }
+
+  ofstream ofs(filename.c_str());
+  if (!ofs) return -1;
+  int n = 0;
+  for (map<string, set<string> >::const_iterator i = tags.begin(); i != tags.end(); i++) {
+    if (count[i->first] < min_count) continue;
+    ofs << i->first;
+    for (set<string>::const_iterator j = i->second.begin(); j != i->second.end(); j++) {
+      ofs << "\t" << *j;
+    }
+    ofs << "\n";
+    n++;
+  }
+  ofs.close();
+  return ofs ? n : -1;
+}
+
+// Loads the tag dictionary written by save_tagdic() into tagdic; given to
+// bidir_postag(), it restricts the POS tags of its words. Returns the
+// number of words.
+int
+load_tagdic(const string & filename, multimap<string, string> & tagdic)
+{
+  ifstream ifs(filename.c_str());
+  if (!ifs) return -1;
+
+  tagdic.clear();
+  int n = 0;
+  string line;
+  while (getline(ifs, line)) {
+    istringstream is(line);
+    string word, tag;
+    if (!(is >> word)) continue;
+    while (is >> tag) tagdic.insert(make_pair(word, tag));
+    n++;
+  }
+  return n;
+}
+
+// IDs of the classes of mep allowed by tagdic for word (none if the word is
+// unknown, or none of its tags is a class of mep)
+static void
+allowed_classes(const multimap<string, string> & tagdic, const string & word,
+                const ME_Model & me, vector<int> & ids)
+{
+  ids.clear();
+  pair<multimap<string, string>::const_iterator, multimap<string, string>::const_iterator>
+    range = tagdic.equal_range(word);
+  for (multimap<string, string>::const_iterator i = range.first; i != range.second; i++) {
+    int id = me.get_class_id(i->second);
+    if (id >= 0) ids.push_back(id);
+  }
+}
+
 struct Hypothesis
 {
   vector<Token> vt;
@@ -389,24 +467,40 @@ struct Hypothesis
   vector<int> order;
   vector< vector<pair<string, double> > > vvp;
   double prob;
+  ClassificationMemo * memo;  // shared by the hypotheses of a sentence (may be NULL)
+  vector<int> tag_ids;        // IDs of the tags of vt in the memo (if any)
+  vector<const ClassificationMemo::Result *> memo_results;  // entries holding the candidates (NULL: in vvp)
+  WordFeatureCache * word_features;  // shared as well (may be NULL)
   bool operator<(const Hypothesis & h) const {
     return prob < h.prob;
   }
   Hypothesis(const vector<Token> & vt_,
              const multimap<string, string> & tagdic,
-             const vector<ME_Model> & vme)
+             const vector<ME_Model> & vme,
+             ClassificationMemo * memo_ = NULL,
+             WordFeatureCache * word_features_ = NULL,
+             bool update_all = true)  // false: no position is classified yet
   {
     prob = 1.0;
+    memo = memo_;
+    word_features = word_features_;
     vt = vt_;
     int n = vt.size();
     vent.resize(n);
     vvp.resize(n);
+    tag_ids.assign(n, ClassificationMemo::UNDECIDED);
+    memo_results.assign(n, NULL);
     order.resize(n);
     for (size_t i = 0; i < n; i++) {
       vt[i].prd = "";
-      Update(i, tagdic, vme);
+      if (update_all) Update(i, tagdic, vme);
     }
   }
+  // candidate tags of position j and their probabilities
+  const vector<pair<string, double> > & Candidates(int j) const
+  {
+    return memo_results[j] != NULL ? memo_results[j]->vp : vvp[j];
+  }
   void Print()
   {
     for (size_t k = 0; k < vt.size(); k++) {
@@ -428,8 +522,18 @@ struct Hypothesis
     string pos_right1 = "EOS", pos_right2 = "EOS2";
     if (j <= int(vt.size()) - 2) pos_right1 = vt[j+1].prd;
     if (j <= int(vt.size()) - 3) pos_right2 = vt[j+2].prd;
-    ME_Sample mes = mesample(vt, j, pos_left2, pos_left1, pos_right1, pos_right2);
-    
+
+    ClassificationMemo::Result * memo_result = NULL;
+    if (memo != NULL) {
+      bool found;
+      memo_result = &memo->Lookup(ClassificationMemo::MakeKey(j, tag_ids), found);
+      memo_results[j] = memo_result;
+      if (found) {
+        vent[j] = memo_result->ent;
+        return;
+      }
+    }
+
     vector<double> membp;
     const ME_Model * mep = NULL;
     int bits = 0;
@@ -439,19 +543,54 @@ struct Hypothesis
     if (pos_right2 != "") bits += 1;
     assert(bits >= 0 && bits < 16);
     mep = &(vme[bits]);
-    membp = mep->classify(mes);
-    assert(mes.label != "");
+    int label;
+    vector<int> ids, classes;
+    const vector<int> * allowed = &classes;
+    if (word_features != NULL) {
+      // same features as mesample(), but only the tag features are looked up here
+      WordFeatureCache::Entry & wf = word_features->Get(j, bits);
+      if (!wf.resolved) {
+        vector<string> head, tail;
+        word_features_head(vt, j, head);
+        word_features_tail(vt[j].str, tail);
+        mep->get_feature_ids(head, wf.head);
+        mep->get_feature_ids(tail, wf.tail);
+        allowed_classes(tagdic, vt[j].str, *mep, wf.classes);
+        wf.resolved = true;
+      }
+      allowed = &wf.classes;
+      vector<string> tags;
+      tag_features(vt[j].str, pos_left2, pos_left1, pos_right1, pos_right2, tags);
+      ids = wf.head;
+      mep->get_feature_ids(tags, ids);
+      ids.insert(ids.end(), wf.tail.begin(), wf.tail.end());
+    } else {
+      ME_Sample mes = mesample(vt, j, pos_left2, pos_left1, pos_right1, pos_right2);
+      mep->get_feature_ids(mes.features, ids);
+      allowed_classes(tagdic, vt[j].str, *mep, classes);
+    }
+
+    // a known word only takes the tags of the tag dictionary: the
+    // distribution is computed over those alone
+    if (allowed->empty()) label = mep->classify(ids, membp);
+    else label = mep->classify(ids, *allowed, membp);
     vent[j] = entropy(membp);
     //    vent[j] = -j;
 
-    vvp[j].clear();
-    double maxp = membp[mep->get_class_id(mes.label)];
+    // with a memo, the candidates are made in its entry
+    vector<pair<string, double> > & vp = memo_result != NULL ? memo_result->vp : vvp[j];
+    const vector<int> * class_tags = memo_result != NULL ? &memo->ClassTags(bits, *mep) : NULL;
+    vp.clear();
+    double maxp = membp[label];
     //    vp[j] = mes.label;
     for (int i = 0; i < mep->num_classes(); i++) {
       double p = membp[i];
-      if (p > maxp * BEAM_WINDOW)
-        vvp[j].push_back(pair<string, double>(mep->get_class_label(i), p));
+      if (p > maxp * BEAM_WINDOW) {
+        vp.push_back(pair<string, double>(mep->get_class_label(i), p));
+        if (class_tags != NULL) memo_result->tag_ids.push_back((*class_tags)[i]);
+      }
     }
+    if (memo_result != NULL) memo_result->ent = vent[j];
     /*
       if (tagdic.find(vt[j].str) != tagdic.end()) {
       // known words
@@ -476,16 +615,13 @@ struct Hypothesis
 };
 
 
-void generate_hypotheses(const int order, const Hypothesis & h,
-                         const multimap<string, string> & tag_dictionary,
-                         const vector<ME_Model> & vme,
-                         list<Hypothesis> & vh)
+// the undecided position whose prediction is the most confident
+static int
+easiest_position(const Hypothesis & h)
 {
   int n = h.vt.size();
   int pred_position = -1;
   double min_ent = 999999;
-  string pred = "";
-  double pred_prob = 0;
   for (int j = 0; j < n; j++) {
     if (h.vt[j].prd != "") continue;
     double ent = h.vent[j];
@@ -497,14 +633,39 @@ void generate_hypotheses(const int order, const Hypothesis & h,
     }
   }
   assert(pred_position >= 0 && pred_position < n);
+  return pred_position;
+}
 
-  for (vector<pair<string, double> >::const_iterator k = h.vvp[pred_position].begin();
-       k != h.vvp[pred_position].end(); k++) {
+// the most probable candidate; of equally probable ones, the last is taken,
+// as the (stable) sort of the beam search does
+static const string &
+best_tag(const vector<pair<string, double> > & vp)
+{
+  assert(!vp.empty());
+  vector<pair<string, double> >::const_iterator best = vp.begin();
+  for (vector<pair<string, double> >::const_iterator k = vp.begin(); k != vp.end(); k++) {
+    if (k->second >= best->second) best = k;
+  }
+  return best->first;
+}
+
+void generate_hypotheses(const int order, const Hypothesis & h,
+                         const multimap<string, string> & tag_dictionary,
+                         const vector<ME_Model> & vme,
+                         list<Hypothesis> & vh)
+{
+  int n = h.vt.size();
+  int pred_position = easiest_position(h);
+
+  const vector<pair<string, double> > & candidates = h.Candidates(pred_position);
+  for (size_t k = 0; k < candidates.size(); k++) {
     Hypothesis newh = h;
     
-    newh.vt[pred_position].prd = k->first;
+    newh.vt[pred_position].prd = candidates[k].first;
+    if (h.memo_results[pred_position] != NULL)
+      newh.tag_ids[pred_position] = h.memo_results[pred_position]->tag_ids[k];
     newh.order[pred_position] = order + 1;
-    newh.prob = h.prob * k->second;
+    newh.prob = h.prob * candidates[k].second;
   
     // update the neighboring predictions
     for (int j = pred_position - UPDATE_WINDOW_SIZE; j <= pred_position + UPDATE_WINDOW_SIZE; j++) {
@@ -520,13 +681,18 @@ void generate_hypotheses(const int order, const Hypothesis & h,
 void
 bidir_decode_beam(vector<Token> & vt,
                   const multimap<string, string> & tag_dictionary,
-                  const vector<ME_Model> & vme)
+                  const vector<ME_Model> & vme,
+                  ClassificationMemo * memo = NULL,
+                  const int beam_width = 1)
 {
   int n = vt.size();
   if (n == 0) return;
 
   list<Hypothesis> vh;
-  Hypothesis h(vt, tag_dictionary, vme);
+  // With a beam of one, the hypotheses of a step differ in the tag just
+  // fixed, which is in every neighbourhood they update: nothing to reuse.
+  WordFeatureCache word_features(n, vme.size());
+  Hypothesis h(vt, tag_dictionary, vme, beam_width > 1 ? memo : NULL, &word_features);
   vh.push_back(h);
   
   for (size_t i = 0; i < n; i++) {
@@ -535,7 +701,7 @@ bidir_decode_beam(vector<Token> & vt,
       generate_hypotheses(i, *j, tag_dictionary, vme, newvh);
     }
     newvh.sort();
-    while (newvh.size() > BEAM_NUM) {
+    while (newvh.size() > (size_t) beam_width) {
       newvh.pop_front();
     }
     vh = newvh;
@@ -551,6 +717,44 @@ bidir_decode_beam(vector<Token> & vt,
 
 }
 
+// Decoders for bulk tagging, which update a single hypothesis in place.
+// Without left_to_right, the easiest position is fixed first, as by
+// bidir_decode_beam() with a beam of one (and with the same result); with
+// it, each token is classified once, knowing only the tags on its left.
+static void
+bidir_decode_greedy(vector<Token> & vt,
+                    const multimap<string, string> & tag_dictionary,
+                    const vector<ME_Model> & vme,
+                    bool left_to_right)
+{
+  int n = vt.size();
+  if (n == 0) return;
+
+  WordFeatureCache word_features(n, vme.size());
+  Hypothesis h(vt, tag_dictionary, vme, NULL, &word_features, !left_to_right);
+
+  for (int i = 0; i < n; i++) {
+    if (left_to_right) {
+      h.Update(i, tag_dictionary, vme);
+      h.vt[i].prd = best_tag(h.Candidates(i));
+      continue;
+    }
+
+    int pred_position = easiest_position(h);
+    h.vt[pred_position].prd = best_tag(h.Candidates(pred_position));
+
+    // update the neighboring predictions
+    for (int j = pred_position - UPDATE_WINDOW_SIZE; j <= pred_position + UPDATE_WINDOW_SIZE; j++) {
+      if (j < 0 || j > n-1) continue;
+      if (h.vt[j].prd == "") h.Update(j, tag_dictionary, vme);
+    }
+  }
+
+  for (size_t k = 0; k < n; k++) {
+    vt[k].prd = h.vt[k].prd;
+  }
+}
+
 static void
 decode_no_context(vector<Token> & vt, const ME_Model & me_none)
 {
@@ -592,24 +796,118 @@ public:
       pos2ptb.insert(make_pair(table[i+1], table[i]));
     }
   }
-  string Ptb2Pos(const string & s) {
+  string Ptb2Pos(const string & s) const {
     map<string, string>::const_iterator i = ptb2pos.find(s);
     if (i == ptb2pos.end()) return s;
     return i->second;
   }
-  string Pos2Ptb(const string & s) {
+  string Pos2Ptb(const string & s) const {
     map<string, string>::const_iterator i = pos2ptb.find(s);
     if (i == pos2ptb.end()) return s;
     return i->second;
   }
 };
 
-ParenConverter paren_converter;
+static const ParenConverter paren_converter;
+
+static ClassificationMemoStats memo_stats;
+static NER::Mutex memo_stats_mtx;
+
+static void add_memo_stats(const ClassificationMemo & memo, bool chunking)
+{
+  NER::ScopedLock lock(memo_stats_mtx);
+  if (chunking) {
+    memo_stats.chunk_lookups += memo.lookups;
+    memo_stats.chunk_hits += memo.hits;
+  } else {
+    memo_stats.pos_lookups += memo.lookups;
+    memo_stats.pos_hits += memo.hits;
+  }
+}
+
+// Classification memo lookups and hits of the sentences tagged so far
+ClassificationMemoStats
+get_memo_stats()
+{
+  NER::ScopedLock lock(memo_stats_mtx);
+  return memo_stats;
+}
+
+// Sets the POS tags (prd) or, with chunking, the chunk tags (cprd) of vt
+static void
+decode_tags(vector<Token> & vt, bool chunking,
+            const multimap<string, string> & tag_dictionary,
+            const vector<ME_Model> & vme, const vector<ME_Model> & chunking_vme,
+            const DecodingOptions & decoding)
+{
+  ClassificationMemo memo;
+  if (chunking) {
+    if (decoding.mode == DECODE_BEAM) {
+      bidir_chuning_decode_beam(vt, chunking_vme, &memo, decoding.beam_width);
+    } else {
+      bidir_chunking_decode_greedy(vt, chunking_vme, decoding.mode == DECODE_LEFT_TO_RIGHT);
+    }
+  } else {
+    if (decoding.mode == DECODE_BEAM) {
+      bidir_decode_beam(vt, tag_dictionary, vme, &memo, decoding.beam_width);
+    } else {
+      bidir_decode_greedy(vt, tag_dictionary, vme, decoding.mode == DECODE_LEFT_TO_RIGHT);
+    }
+  }
+  add_memo_stats(memo, chunking);
+}
+
+// decode_tags() for sentences of any length
+//   A sentence longer than decoding.max_window tokens is decoded in windows
+//   of that length, each overlapping the next by decoding.window_overlap
+//   tokens. A window keeps the tags of its tokens that are not in the outer
+//   half of an overlap, so every kept tag was decoded with at least half of
+//   the overlap as context on both sides. The cost of a sentence thus grows
+//   linearly with its length, and the windows do not depend on each other.
+static void
+decode_tags_windowed(vector<Token> & vt, bool chunking,
+                     const multimap<string, string> & tag_dictionary,
+                     const vector<ME_Model> & vme, const vector<ME_Model> & chunking_vme,
+                     const DecodingOptions & decoding)
+{
+  const int n = vt.size();
+  const int width = decoding.max_window;
+  const int overlap = decoding.window_overlap;
+  if (width <= 0 || n <= width) {
+    decode_tags(vt, chunking, tag_dictionary, vme, chunking_vme, decoding);
+    return;
+  }
+
+  for (int begin = 0; ; begin += width - overlap) {
+    const int end = min(begin + width, n);
+    vector<Token> window(vt.begin() + begin, vt.begin() + end);
+    decode_tags(window, chunking, tag_dictionary, vme, chunking_vme, decoding);
+
+    const int keep_begin = (begin == 0) ? 0 : begin + overlap / 2;
+    const int keep_end = (end == n) ? n : end - (overlap - overlap / 2);
+    for (int k = keep_begin; k < keep_end; k++) {
+      if (chunking) vt[k].cprd = window[k - begin].cprd;
+      else          vt[k].prd = window[k - begin].prd;
+    }
+
+    // a chunk cannot be continued from the previous window if it was not
+    // open there: it begins at the seam instead (IOB2)
+    if (chunking && keep_begin > 0 && vt[keep_begin].cprd.compare(0, 2, "I-") == 0) {
+      const string & prev = vt[keep_begin - 1].cprd;
+      if (prev.size() < 2 || prev.substr(1) != vt[keep_begin].cprd.substr(1))
+        vt[keep_begin].cprd[0] = 'B';
+    }
+
+    if (end == n) break;
+  }
+}
 
 //extern int netagging(vector<Token> & vt);
 
 string
-bidir_postag(const string & s, const vector<ME_Model> & vme, const vector<ME_Model> & chunking_vme, bool dont_tokenize)
+bidir_postag(const string & s, const vector<ME_Model> & vme, const vector<ME_Model> & chunking_vme,
+             const multimap<string, string> & tag_dictionary, bool dont_tokenize,
+             const DecodingOptions & decoding)
 {
   list<string> lt;
   if (dont_tokenize) {
@@ -627,14 +925,13 @@ bidir_postag(const string & s, const vector<ME_Model> & vme, const vector<ME_Mod
     vt.push_back(Token(s, "?"));
   }
   
-  const multimap<string, string> dummy;
-  //  bidir_decode_search(vt, dummy, vme);
-  bidir_decode_beam(vt, dummy, vme);
+  //  bidir_decode_search(vt, tag_dictionary, vme);
+  decode_tags_windowed(vt, false, tag_dictionary, vme, chunking_vme, decoding);
   for (size_t i = 0; i < vt.size(); i++) {
     vt[i].pos = vt[i].prd;
   }
 
-  bidir_chuning_decode_beam(vt, chunking_vme);
+  decode_tags_windowed(vt, true, tag_dictionary, vme, chunking_vme, decoding);
   
   //netagging(vt);
 
@@ -694,7 +991,8 @@ bidir_postagging(vector<Sentence> & vs,
     Sentence & s = *i;
     ntokens += s.size();
     //    if (s.size() > 2) continue;
-    bidir_decode_beam(s, tag_dictionary, vme);
+    ClassificationMemo memo;
+    bidir_decode_beam(s, tag_dictionary, vme, &memo);
     //bidir_decode_search(s, tag_dictionary, vme);
     //decode_no_context(s, vme[0]);
 
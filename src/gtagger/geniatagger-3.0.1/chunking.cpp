@@ -17,8 +17,6 @@
 using namespace std;
 
 const int TAG_WINDOW_SIZE = 1;
-const int BEAM_NUM = 1;
-//const int BEAM_NUM = 10;
 const double BEAM_WINDOW = 0.01;
 const bool ONLY_VERTICAL_FEATURES = false;
 //const bool DISTANT_FEATURES = false;
@@ -28,16 +26,14 @@ const DecodingStrategy decoding_strategy = EASIEST_FIRST;
 //const DecodingStrategy decoding_strategy = LEFT_TO_RIGHT;
 //const DecodingStrategy decoding_strategy = RIGHT_TO_LEFT;
 
-static ME_Sample
-mesample(const vector<Token> &vt, int pos,
-         const string & tag_left2,  const string & tag_left1, 
-         const string & tag_right1, const string & tag_right2)
+// The features of a token are split into the ones that depend only on the
+// words and POS tags (word_pos_features) and the ones that depend on the chunk
+// tags of the neighbours (tag_features). mesample() puts them in that order,
+// which the ID-based classification in Hypothesis::Update reproduces.
+static void
+word_pos_features(const vector<Token> &vt, int pos, vector<string> & features)
 {
-  ME_Sample sample;
-
-  sample.label = vt[pos].tag;
-
-  string w[5], p[5], t[5];
+  string w[5], p[5];
 
   w[0] = "BOS2";
   if (pos > 1) w[0] = vt[pos-2].str;
@@ -63,26 +59,35 @@ mesample(const vector<Token> &vt, int pos,
   // first-order 
   for (int i = 0; i < 5; i++) {
     sprintf(buf, "W%d_%s", i-2, w[i].c_str());
-    sample.features.push_back(buf);
+    features.push_back(buf);
     sprintf(buf, "P%d_%s", i-2, p[i].c_str());
-    sample.features.push_back(buf);
+    features.push_back(buf);
   }
   // bigram
   for (int i = 0; i < 4; i++) {
     int j = i + 1;
     sprintf(buf, "P%dP%d_%s_%s", i-2, j-2, p[i].c_str(), p[j].c_str());
-    sample.features.push_back(buf);
+    features.push_back(buf);
     sprintf(buf, "W%dW%d_%s_%s", i-2, j-2, w[i].c_str(), w[j].c_str());
-    sample.features.push_back(buf);
+    features.push_back(buf);
   }
   // pos trigram
   for (int i = 0; i < 3; i++) {
     int j = i + 1;
     int k = i + 2;
     sprintf(buf, "P%dP%dP%d_%s_%s_%s", i-2, j-2, k-2, p[i].c_str(), p[j].c_str(), p[k].c_str());
-    sample.features.push_back(buf);
+    features.push_back(buf);
   }
-  
+}
+
+static void
+tag_features(const string & tag_left2,  const string & tag_left1, 
+             const string & tag_right1, const string & tag_right2,
+             vector<string> & features)
+{
+  string t[5];
+  char buf[1000];
+
   t[0] = tag_left2;
   t[1] = tag_left1;
   t[2] = "";  
@@ -93,7 +98,7 @@ mesample(const vector<Token> &vt, int pos,
     //  for (int i = 1; i < 4; i++) {
     if (t[i] == "") continue;
     sprintf(buf, "T%d_%s", i-2, t[i].c_str());
-    sample.features.push_back(buf);
+    features.push_back(buf);
   }
 
   // second-order
@@ -102,34 +107,35 @@ mesample(const vector<Token> &vt, int pos,
     if (t[i] == "") continue;
     if (t[j] == "") continue;
     sprintf(buf, "T%dT%d_%s_%s", i-2, j-2, t[i].c_str(), t[j].c_str());
-    sample.features.push_back(buf);
+    features.push_back(buf);
   }
 
   if (t[1] != "" && t[3] != "") {
     sprintf(buf, "T%dT%d_%s_%s", 1-2, 3-2, t[1].c_str(), t[3].c_str());
-    sample.features.push_back(buf);
+    features.push_back(buf);
   }
   if (t[0] != "" && t[1] != "" && t[3] != "") {
     sprintf(buf, "T%dT%dT%d_%s_%s_%s", 0-2, 1-2, 3-2, t[0].c_str(), t[1].c_str(), t[3].c_str());
-    sample.features.push_back(buf);
+    features.push_back(buf);
   }
   if (t[1] != "" && t[3] != "" && t[4] != "") {
     sprintf(buf, "T%dT%dT%d_%s_%s_%s", 1-2, 3-2, 4-2, t[1].c_str(), t[3].c_str(), t[4].c_str());
-    sample.features.push_back(buf);
+    features.push_back(buf);
   }
+}
+
+static ME_Sample
+mesample(const vector<Token> &vt, int pos,
+         const string & tag_left2,  const string & tag_left1, 
+         const string & tag_right1, const string & tag_right2)
+{
+  ME_Sample sample;
+
+  sample.label = vt[pos].tag;
+
+  word_pos_features(vt, pos, sample.features);
+  tag_features(tag_left2, tag_left1, tag_right1, tag_right2, sample.features);
 
-  
-  /*
-  for (int j = 0; j < vt.size(); j++)
-    cout << vt[j].str << "/" << vt[j].pos << " ";
-  cout << endl;
-  cout << pos << endl;
-  for (list<string>::const_iterator j = sample.features.begin(); j != sample.features.end(); j++) {
-    cout << *j << " ";
-  }
-  cout << endl << endl;
-  */
-  
   return sample;
 }
 
@@ -152,24 +158,40 @@ struct Hypothesis
   //  vector<int> model;
   vector< vector<pair<string, double> > > vvp;
   double prob;
+  ClassificationMemo * memo;  // shared by the hypotheses of a sentence (may be NULL)
+  vector<int> tag_ids;        // IDs of the tags of vt in the memo (if any)
+  vector<const ClassificationMemo::Result *> memo_results;  // entries holding the candidates (NULL: in vvp)
+  WordFeatureCache * word_features;  // shared as well (may be NULL)
   bool operator<(const Hypothesis & h) const {
     return prob < h.prob;
   }
   Hypothesis(const vector<Token> & vt_,
-             const vector<ME_Model> & vme)
+             const vector<ME_Model> & vme,
+             ClassificationMemo * memo_ = NULL,
+             WordFeatureCache * word_features_ = NULL,
+             bool update_all = true)  // false: no position is classified yet
   {
     prob = 1.0;
+    memo = memo_;
+    word_features = word_features_;
     vt = vt_;
     int n = vt.size();
     vent.resize(n);
     vvp.resize(n);
+    tag_ids.assign(n, ClassificationMemo::UNDECIDED);
+    memo_results.assign(n, NULL);
     order.resize(n);
     //    model.resize(n);
     for (size_t i = 0; i < n; i++) {
       vt[i].cprd = "";
-      Update(i, vme);
+      if (update_all) Update(i, vme);
     }
   }
+  // candidate tags of position j and their probabilities
+  const vector<pair<string, double> > & Candidates(int j) const
+  {
+    return memo_results[j] != NULL ? memo_results[j]->vp : vvp[j];
+  }
   void Print()
   {
     for (size_t k = 0; k < vt.size(); k++) {
@@ -190,8 +212,18 @@ struct Hypothesis
     string tag_right1 = "EOS", tag_right2 = "EOS2";
     if (j <= int(vt.size()) - 2) tag_right1 = vt[j+1].cprd;
     if (j <= int(vt.size()) - 3) tag_right2 = vt[j+2].cprd;
-    ME_Sample mes = mesample(vt, j, tag_left2, tag_left1, tag_right1, tag_right2);
-    
+
+    ClassificationMemo::Result * memo_result = NULL;
+    if (memo != NULL) {
+      bool found;
+      memo_result = &memo->Lookup(ClassificationMemo::MakeKey(j, tag_ids), found);
+      memo_results[j] = memo_result;
+      if (found) {
+        vent[j] = memo_result->ent;
+        return;
+      }
+    }
+
     vector<double> membp;
     const ME_Model * mep = NULL;
     int bits = 0;
@@ -201,11 +233,30 @@ struct Hypothesis
     if (TAG_WINDOW_SIZE >= 2 && tag_right2 != "") bits += 1;
     assert(bits >= 0 && bits < 16);
     mep = &(vme[bits]);
-    membp = mep->classify(mes);
-    assert(mes.label != "");
+    int label;
+    if (word_features != NULL) {
+      // same features as mesample(), but only the tag features are looked up here
+      WordFeatureCache::Entry & wf = word_features->Get(j, bits);
+      if (!wf.resolved) {
+        vector<string> words;
+        word_pos_features(vt, j, words);
+        mep->get_feature_ids(words, wf.head);
+        wf.resolved = true;
+      }
+      vector<string> tags;
+      tag_features(tag_left2, tag_left1, tag_right1, tag_right2, tags);
+      vector<int> ids(wf.head);
+      mep->get_feature_ids(tags, ids);
+      label = mep->classify(ids, membp);
+    } else {
+      ME_Sample mes = mesample(vt, j, tag_left2, tag_left1, tag_right1, tag_right2);
+      membp = mep->classify(mes);
+      assert(mes.label != "");
+      label = mep->get_class_id(mes.label);
+    }
     //cout << "(" << j << ", " << bits << ") ";
 
-    double maxp = membp[mep->get_class_id(mes.label)];
+    double maxp = membp[label];
     //    vector<double> tmpv(membp);
     //    sort(tmpv.begin(), tmpv.end());
     //    double second = tmpv[1];
@@ -225,13 +276,19 @@ struct Hypothesis
       break;
     }
 
-    vvp[j].clear();
+    // with a memo, the candidates are made in its entry
+    vector<pair<string, double> > & vp = memo_result != NULL ? memo_result->vp : vvp[j];
+    const vector<int> * class_tags = memo_result != NULL ? &memo->ClassTags(bits, *mep) : NULL;
+    vp.clear();
     //    vp[j] = mes.label;
     for (int i = 0; i < mep->num_classes(); i++) {
       double p = membp[i];
-      if (p > maxp * BEAM_WINDOW)
-        vvp[j].push_back(pair<string, double>(mep->get_class_label(i), p));
+      if (p > maxp * BEAM_WINDOW) {
+        vp.push_back(pair<string, double>(mep->get_class_label(i), p));
+        if (class_tags != NULL) memo_result->tag_ids.push_back((*class_tags)[i]);
+      }
     }
+    if (memo_result != NULL) memo_result->ent = vent[j];
   }
   bool IsErroneous() const
   {
@@ -251,15 +308,13 @@ struct Hypothesis
   }
 };
 
-void generate_hypotheses(const int order, const Hypothesis & h,
-                         const vector<ME_Model> & vme,
-                         list<Hypothesis> & vh)
+// the undecided position whose prediction is the most confident
+static int
+easiest_position(const Hypothesis & h)
 {
   int n = h.vt.size();
   int pred_position = -1;
   double min_ent = 999999;
-  string pred = "";
-  double pred_prob = 0;
   for (int j = 0; j < n; j++) {
     if (h.vt[j].cprd != "") continue;
     double ent = h.vent[j];
@@ -271,14 +326,38 @@ void generate_hypotheses(const int order, const Hypothesis & h,
     }
   }
   assert(pred_position >= 0 && pred_position < n);
+  return pred_position;
+}
 
-  for (vector<pair<string, double> >::const_iterator k = h.vvp[pred_position].begin();
-       k != h.vvp[pred_position].end(); k++) {
+// the most probable candidate (the last of equally probable ones, as in
+// the beam search)
+static const string &
+best_tag(const vector<pair<string, double> > & vp)
+{
+  assert(!vp.empty());
+  vector<pair<string, double> >::const_iterator best = vp.begin();
+  for (vector<pair<string, double> >::const_iterator k = vp.begin(); k != vp.end(); k++) {
+    if (k->second >= best->second) best = k;
+  }
+  return best->first;
+}
+
+void generate_hypotheses(const int order, const Hypothesis & h,
+                         const vector<ME_Model> & vme,
+                         list<Hypothesis> & vh)
+{
+  int n = h.vt.size();
+  int pred_position = easiest_position(h);
+
+  const vector<pair<string, double> > & candidates = h.Candidates(pred_position);
+  for (size_t k = 0; k < candidates.size(); k++) {
     Hypothesis newh = h;
     
-    newh.vt[pred_position].cprd = k->first;
+    newh.vt[pred_position].cprd = candidates[k].first;
+    if (h.memo_results[pred_position] != NULL)
+      newh.tag_ids[pred_position] = h.memo_results[pred_position]->tag_ids[k];
     newh.order[pred_position] = order + 1;
-    newh.prob = h.prob * k->second;
+    newh.prob = h.prob * candidates[k].second;
 
     //    if (newh.IsErroneous()) {
     //      cout << "*errorneous" << endl;
@@ -312,15 +391,37 @@ static void convert_startend_to_iob2_sub(vector<string> & s)
   }
 }
 
+// sets the chunk tags of vt from those of h, converted to IOB2
+static void
+set_chunk_tags(vector<Token> & vt, const Hypothesis & h)
+{
+  size_t n = vt.size();
+  vector<string> tags;
+  for (size_t k = 0; k < n; k++) {
+    //    cout << h.vt[k].str << "/" << h.vt[k].cprd << "/" << h.order[k] << " ";
+    tags.push_back(h.vt[k].cprd);
+  }
+
+  convert_startend_to_iob2_sub(tags);
+  for (size_t k = 0; k < n; k++) {
+    vt[k].cprd = tags[k];
+  }
+}
+
 void
 bidir_chuning_decode_beam(vector<Token> & vt,
-                  const vector<ME_Model> & vme)
+                  const vector<ME_Model> & vme,
+                  ClassificationMemo * memo,
+                  const int beam_width)
 {
   int n = vt.size();
   if (n == 0) return;
 
   list<Hypothesis> vh;
-  Hypothesis h(vt, vme);
+  // With a beam of one, the hypotheses of a step differ in the tag just
+  // fixed, which is in every neighbourhood they update: nothing to reuse.
+  WordFeatureCache word_features(n, vme.size());
+  Hypothesis h(vt, vme, beam_width > 1 ? memo : NULL, &word_features);
   vh.push_back(h);
   
   for (size_t i = 0; i < n; i++) {
@@ -329,7 +430,7 @@ bidir_chuning_decode_beam(vector<Token> & vt,
       generate_hypotheses(i, *j, vme, newvh);
     }
     newvh.sort();
-    while (newvh.size() > BEAM_NUM) {
+    while (newvh.size() > (size_t) beam_width) {
       newvh.pop_front();
     }
     vh = newvh;
@@ -342,22 +443,105 @@ bidir_chuning_decode_beam(vector<Token> & vt,
     h = Hypothesis(vt, vme);
   }
 
-  vector<string> tags;
-  for (size_t k = 0; k < n; k++) {
-    //    cout << h.vt[k].str << "/" << h.vt[k].cprd << "/" << h.order[k] << " ";
-    tags.push_back(h.vt[k].cprd);
-  }
-
-  convert_startend_to_iob2_sub(tags);
-  for (size_t k = 0; k < n; k++) {
-    vt[k].cprd = tags[k];
-  }
+  set_chunk_tags(vt, h);
   
   
   //  cout << endl;
   
 
 }
+
+// The chunking counterpart of bidir_decode_greedy() (see bidir.cpp)
+void
+bidir_chunking_decode_greedy(vector<Token> & vt,
+                             const vector<ME_Model> & vme,
+                             bool left_to_right)
+{
+  int n = vt.size();
+  if (n == 0) return;
+
+  WordFeatureCache word_features(n, vme.size());
+  Hypothesis h(vt, vme, NULL, &word_features, !left_to_right);
+
+  for (int i = 0; i < n; i++) {
+    if (left_to_right) {
+      h.Update(i, vme);
+      h.vt[i].cprd = best_tag(h.Candidates(i));
+      continue;
+    }
+
+    int pred_position = easiest_position(h);
+    h.vt[pred_position].cprd = best_tag(h.Candidates(pred_position));
+
+    // update the neighboring predictions
+    for (int j = pred_position - TAG_WINDOW_SIZE; j <= pred_position + TAG_WINDOW_SIZE; j++) {
+      if (j < 0 || j > n-1) continue;
+      if (h.vt[j].cprd == "") h.Update(j, vme);
+    }
+  }
+
+  set_chunk_tags(vt, h);
+}
+// The inverse of convert_startend_to_iob2_sub(): the chunking models tell
+// the last token of a chunk (E-) and single-token chunks (S-) apart.
+static void convert_iob2_to_startend_sub(vector<string> & s)
+{
+  for (int i = 0; i < s.size(); i++) {
+    const string & tag = s[i];
+    if (tag[0] != 'B' && tag[0] != 'I') continue;
+    bool last = (i + 1 == s.size() || s[i+1][0] != 'I' || s[i+1].substr(1) != tag.substr(1));
+    if (!last) continue;
+    s[i] = (tag[0] == 'B' ? "S" : "E") + tag.substr(1);
+  }
+}
+
+// Trains the chunking model of type t on the sentences vs, whose tags are
+// in IOB2, and saves it to filename. The decoder only uses the types
+// without the distant tags (TAG_WINDOW_SIZE = 1), i.e. 0, 2, 4 and 6.
+int
+bidir_chunking_train(const vector<Sentence> & vs, int t, const string & filename,
+                     const TrainingParameters & param)
+{
+  assert(t >= 0 && t < 16);
+  vector<ME_Sample> train;
+
+  if (param.verbose) {
+    cerr << "chunking type = " << t << endl;
+    cerr << "extracting features...";
+  }
+  for (vector<Sentence>::const_iterator i = vs.begin(); i != vs.end(); i++) {
+    Sentence s = *i;
+    vector<string> tags;
+    for (size_t j = 0; j < s.size(); j++) tags.push_back(s[j].tag);
+    convert_iob2_to_startend_sub(tags);
+    for (size_t j = 0; j < s.size(); j++) s[j].tag = tags[j];
+
+    for (int j = 0; j < s.size(); j++) {
+      string tag_left1 = "BOS", tag_left2 = "BOS2";
+      if (j >= 1) tag_left1 = s[j-1].tag;
+      if (j >= 2) tag_left2 = s[j-2].tag;
+      string tag_right1 = "EOS", tag_right2 = "EOS2";
+      if (j <= int(s.size()) - 2) tag_right1 = s[j+1].tag;
+      if (j <= int(s.size()) - 3) tag_right2 = s[j+2].tag;
+      if ( (t & 0x8) == 0 ) tag_left2 = "";
+      if ( (t & 0x4) == 0 ) tag_left1 = "";
+      if ( (t & 0x2) == 0 ) tag_right1 = "";
+      if ( (t & 0x1) == 0 ) tag_right2 = "";
+
+      train.push_back(mesample(s, j, tag_left2, tag_left1, tag_right1, tag_right2));
+    }
+  }
+  if (param.verbose) cerr << "done" << endl;
+
+  ME_Model m;
+  m.set_num_threads(param.num_threads);
+  m.set_verbose(param.verbose);
+  if (!m.train(train, param.cutoff, param.sigma, param.widthfactor)) return -1;
+  if (!m.save_to_file(filename)) return -1;
+
+  return 0;
+}
+
 /*
 void
 bidir_chunking(vector<Sentence> & vs,
@@ -7,6 +7,8 @@
 
 #include <string>
 #include <vector>
+#include <map>
+#include <utility>
 
 struct Token
 {
@@ -21,6 +23,164 @@ struct Token
 
 typedef std::vector<Token> Sentence;
 
+// Memo of the Maxent classifications made while decoding one sentence.
+// A classification of position j depends only on j and the tags of its
+// four neighbours (which also select the model), so the beam hypotheses
+// that share a neighbourhood can share its result.
+//
+// The tags are compared as IDs, given once per sentence: the boundary tags
+// and "" (undecided) have fixed IDs, and the classes of a model get theirs
+// when the model is first used (see ClassTags()).
+class ClassificationMemo
+{
+public:
+  enum { UNDECIDED = 0, BOS, BOS2, EOS, EOS2, NUM_FIXED_TAGS };
+
+  // Position and tag IDs of its neighbours (left2, left1, right1, right2)
+  struct Key
+  {
+    int j;
+    int tags[4];
+    bool operator<(const Key & k) const {
+      if (j != k.j) return j < k.j;
+      for (int i = 0; i < 4; i++) {
+        if (tags[i] != k.tags[i]) return tags[i] < k.tags[i];
+      }
+      return false;
+    }
+  };
+
+  struct Result
+  {
+    double ent;
+    std::vector<std::pair<std::string, double> > vp;
+    std::vector<int> tag_ids;  // IDs of the tags of vp
+  };
+
+  ClassificationMemo() : lookups(0), hits(0)
+  {
+    const char * const fixed[NUM_FIXED_TAGS] = { "", "BOS", "BOS2", "EOS", "EOS2" };
+    for (int i = 0; i < NUM_FIXED_TAGS; i++) tag_ids[fixed[i]] = i;
+  }
+
+  // Key of position j, given the tag IDs of the positions of the sentence
+  static Key MakeKey(int j, const std::vector<int> & ids)
+  {
+    int n = ids.size();
+    Key key;
+    key.j = j;
+    key.tags[0] = j >= 2 ? ids[j-2] : BOS2;
+    key.tags[1] = j >= 1 ? ids[j-1] : BOS;
+    key.tags[2] = j <= n - 2 ? ids[j+1] : EOS;
+    key.tags[3] = j <= n - 3 ? ids[j+2] : EOS2;
+    return key;
+  }
+
+  // Returns the entry of the neighbourhood, adding an empty one if it is
+  // new; found tells whether the entry was already filled. The entries stay
+  // in place until the memo is destroyed.
+  Result & Lookup(const Key & key, bool & found)
+  {
+    lookups++;
+    std::map<Key, Result>::iterator i = table.lower_bound(key);
+    found = (i != table.end() && !(key < i->first));
+    if (found) {
+      hits++;
+      return i->second;
+    }
+    return table.insert(i, std::make_pair(key, Result()))->second;
+  }
+
+  // IDs of the classes of me, the model selected by the given bits
+  template <class Model>
+  const std::vector<int> & ClassTags(int bits, const Model & me)
+  {
+    if ((int)class_tags.size() <= bits) class_tags.resize(bits + 1);
+    std::vector<int> & ids = class_tags[bits];
+    if (ids.empty()) {
+      for (int i = 0; i < me.num_classes(); i++) ids.push_back(TagId(me.get_class_label(i)));
+    }
+    return ids;
+  }
+
+  size_t lookups;
+  size_t hits;
+
+private:
+  int TagId(const std::string & tag)
+  {
+    std::map<std::string, int>::iterator i = tag_ids.lower_bound(tag);
+    if (i == tag_ids.end() || i->first != tag)
+      i = tag_ids.insert(i, std::make_pair(tag, (int)tag_ids.size()));
+    return i->second;
+  }
+
+  std::map<Key, Result> table;
+  std::map<std::string, int> tag_ids;
+  std::vector<std::vector<int> > class_tags;
+};
+
+// Maxent feature IDs of the tokens of a sentence that do not depend on the
+// tags being searched. Feature IDs differ between models, so they are
+// resolved once per token and model, on first use.
+class WordFeatureCache
+{
+public:
+  struct Entry
+  {
+    bool resolved;
+    std::vector<int> head;  // IDs of the features before the tag features
+    std::vector<int> tail;  // IDs of the features after the tag features
+    std::vector<int> classes;  // classes allowed by the tag dictionary (empty: all)
+    Entry() : resolved(false) {}
+  };
+
+  WordFeatureCache(size_t n_tokens, size_t n_models)
+    : entries(n_tokens * n_models), num_models(n_models) {}
+
+  Entry & Get(int token, int model) { return entries[token * num_models + model]; }
+
+private:
+  std::vector<Entry> entries;
+  size_t num_models;
+};
+
+// Lookups and hits of the classification memos, summed over sentences
+struct ClassificationMemoStats
+{
+  size_t pos_lookups, pos_hits;
+  size_t chunk_lookups, chunk_hits;
+};
+
+// How bidir_postag() searches for the POS and chunk tags of a sentence
+enum DecodingMode
+{
+  DECODE_BEAM,           // easiest-first beam search (the original decoder)
+  DECODE_GREEDY_BIDIR,   // easiest-first, keeping only the best tag of each step
+  DECODE_LEFT_TO_RIGHT   // one classification per token, knowing the tags on its left
+};
+
+struct DecodingOptions
+{
+  DecodingMode mode;
+  int beam_width;       // hypotheses kept by DECODE_BEAM
+  int max_window;       // longer sentences are decoded in windows (0: never)
+  int window_overlap;   // tokens shared by consecutive windows
+  DecodingOptions() : mode(DECODE_BEAM), beam_width(1), max_window(0), window_overlap(16) {}
+};
+
+// Settings of bidir_train() and bidir_chunking_train()
+struct TrainingParameters
+{
+  int cutoff;           // features seen no more than this are dropped
+  double sigma;         // Gaussian prior (0: none)
+  double widthfactor;   // inequality modeling (0: none)
+  int num_threads;      // threads computing the model expectation
+  bool verbose;         // report the progress of the estimation on cerr
+  TrainingParameters()
+    : cutoff(2), sigma(0), widthfactor(1), num_threads(1), verbose(true) {}
+};
+
 
 #endif
 
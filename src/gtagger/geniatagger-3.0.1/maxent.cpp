@@ -11,6 +11,7 @@
 #include <iterator>
 #include <sstream>			// for faster model loading
 #include <vector>
+#include "../../nersuite_common/thread_utils.h"
 
 using namespace std;
 
@@ -115,45 +116,185 @@ ME_Model::perform_GIS(int C)
   return 0;
 }
 
+// The objective minimized by perform_LMVM(), i.e. the negative (penalized)
+// log-likelihood at x, and its gradient. x holds the lambdas, or the alphas
+// followed by the betas with inequality modeling (as in BLMVMFunctionGradient).
+double
+ME_Model::function_gradient(const vector<double> & x, vector<double> & grad)
+{
+  const int nf = _fb.Size();
+
+  if (_inequality_width > 0) {
+    assert((int)x.size() == nf * 2);
+    for (int i = 0; i < nf; i++) {
+      _va[i] = x[i];
+      _vb[i] = x[i + nf];
+      _vl[i] = _va[i] - _vb[i];
+    }
+  } else {
+    assert((int)x.size() == nf);
+    for (int i = 0; i < nf; i++) {
+      _vl[i] = x[i];
+    }
+  }
+
+  double score = update_model_expectation();
+
+  grad.resize(x.size());
+  if (_inequality_width > 0) {
+    for (int i = 0; i < nf; i++) {
+      grad[i]      = -(_vee[i] - _vme[i] - _inequality_width);
+      grad[i + nf] = -(_vme[i] - _vee[i] - _inequality_width);
+    }
+  } else {
+    const double c = (_sigma > 0) ? 1 / (_sigma * _sigma) : 0;
+    for (int i = 0; i < nf; i++) {
+      grad[i] = -(_vee[i] - _vme[i] - c * _vl[i]);
+    }
+  }
+
+  return -score;
+}
+
+static double
+dot_product(const vector<double> & a, const vector<double> & b)
+{
+  double sum = 0;
+  for (size_t i = 0; i < a.size(); i++) sum += a[i] * b[i];
+  return sum;
+}
+
+// Limited-memory quasi-Newton (L-BFGS) minimization of function_gradient().
+// With inequality modeling the alphas and betas must stay non-negative, so
+// the steps are projected onto that bound and the variables held at it are
+// left out of the search direction.
 int
 ME_Model::perform_LMVM()
 {
-  cerr << "performing LMVM" << endl;
+  const int M = 10;              // number of corrections kept
+  const int MAX_ITER = 300;
+  const int MAX_LINE_SEARCH = 30;
+  const double EPSILON = 1e-6;   // relative decrease of the objective at convergence
 
-  if (_inequality_width > 0) {
-    int nvars = _fb.Size() * 2;
-    double *x = (double*)malloc(nvars*sizeof(double)); 
+  if (_verbose) cerr << "performing LMVM" << endl;
+
+  const bool bounded = (_inequality_width > 0);
+  const int nf = _fb.Size();
+  const int nvars = bounded ? nf * 2 : nf;
 
-    // INITIAL POINT
-    for (int i = 0; i < nvars / 2; i++) {
+  // INITIAL POINT
+  vector<double> x(nvars);
+  for (int i = 0; i < nf; i++) {
+    if (bounded) {
       x[i] = _va[i];
-      x[i + _fb.Size()] = _vb[i];
+      x[i + nf] = _vb[i];
+    } else {
+      x[i] = _vl[i];
     }
+  }
 
-    //    int info = BLMVMSolve(x, nvars);
+  vector<double> grad, pgrad(nvars), dir(nvars), alpha(M);
+  vector<double> new_x(nvars), new_grad;
+  vector< vector<double> > vs, vy;  // the last M corrections, oldest first
+  vector<double> vrho;
+  double f = function_gradient(x, grad);
+  bool stalled = false;
+
+  for (int iter = 0; iter < MAX_ITER; iter++) {
+    // 1. search direction from the two-loop recursion
+    pgrad = grad;
+    if (bounded) {
+      for (int i = 0; i < nvars; i++) {
+        if (x[i] <= 0 && grad[i] > 0) pgrad[i] = 0;  // held at the bound
+      }
+    }
+    const double pgnorm = sqrt(dot_product(pgrad, pgrad));
+    if (pgnorm == 0) break;
 
-    for (int i = 0; i < nvars / 2; i++) {
-      _va[i] = x[i];
-      _vb[i] = x[i + _fb.Size()];
-      _vl[i] = _va[i] - _vb[i];
+    for (int i = 0; i < nvars; i++) dir[i] = -pgrad[i];
+    for (int k = (int)vs.size() - 1; k >= 0; k--) {
+      alpha[k] = vrho[k] * dot_product(vs[k], dir);
+      for (int i = 0; i < nvars; i++) dir[i] -= alpha[k] * vy[k][i];
+    }
+    if (!vs.empty()) {
+      const double gamma = dot_product(vs.back(), vy.back()) / dot_product(vy.back(), vy.back());
+      for (int i = 0; i < nvars; i++) dir[i] *= gamma;
+    }
+    for (int k = 0; k < (int)vs.size(); k++) {
+      const double beta = vrho[k] * dot_product(vy[k], dir);
+      for (int i = 0; i < nvars; i++) dir[i] += vs[k][i] * (alpha[k] - beta);
+    }
+    if (bounded) {
+      for (int i = 0; i < nvars; i++) {
+        if (pgrad[i] == 0) dir[i] = 0;
+      }
+    }
+    if (dot_product(pgrad, dir) >= 0) {
+      // not a descent direction: restart from the steepest descent
+      vs.clear(); vy.clear(); vrho.clear();
+      for (int i = 0; i < nvars; i++) dir[i] = -pgrad[i];
     }
-  
-    free(x);
 
-    return 0;
-  }
+    // 2. backtracking line search (Armijo condition)
+    double step = vs.empty() ? 1.0 / pgnorm : 1.0;
+    double new_f = f;
+    bool found = false;
+    for (int ls = 0; ls < MAX_LINE_SEARCH; ls++, step *= 0.5) {
+      for (int i = 0; i < nvars; i++) {
+        new_x[i] = x[i] + step * dir[i];
+        if (bounded && new_x[i] < 0) new_x[i] = 0;
+      }
+      new_f = function_gradient(new_x, new_grad);
+      double decrease = 0;
+      for (int i = 0; i < nvars; i++) decrease += grad[i] * (new_x[i] - x[i]);
+      if (new_f <= f + 1e-4 * decrease) {
+        found = true;
+        break;
+      }
+    }
+    if (!found) {
+      if (_verbose) cerr << "line search failed" << endl;
+      stalled = true;
+      break;
+    }
+
+    // 3. keep the correction pair, if it has positive curvature
+    vector<double> s(nvars), y(nvars);
+    for (int i = 0; i < nvars; i++) {
+      s[i] = new_x[i] - x[i];
+      y[i] = new_grad[i] - grad[i];
+    }
+    const double sy = dot_product(s, y);
+    if (sy > 0) {
+      vs.push_back(s);
+      vy.push_back(y);
+      vrho.push_back(1 / sy);
+      if ((int)vs.size() > M) {
+        vs.erase(vs.begin());
+        vy.erase(vy.begin());
+        vrho.erase(vrho.begin());
+      }
+    }
 
-  int nvars = _fb.Size();
-  double *x = (double*)malloc(nvars*sizeof(double)); 
+    const double delta = (f - new_f) / max(fabs(new_f), 1.0);
+    x.swap(new_x);
+    grad.swap(new_grad);
+    f = new_f;
 
-  // INITIAL POINT
-  for (int i = 0; i < nvars; i++) { x[i] = _vl[i]; }
+    if (_verbose) {
+      fprintf(stderr, "iter = %3d  logl = %10.7f  train_err = %7.5f", iter, -f, _train_error);
+      if (_heldout.size() > 0) {
+        double hlogl = heldout_likelihood();
+        fprintf(stderr, "  heldout_logl(err) = %f (%6.4f)", hlogl, _heldout_error);
+      }
+      cerr << endl;
+    }
 
-  //  int info = BLMVMSolve(x, nvars);
+    if (delta < EPSILON) break;
+  }
 
-  for (int i = 0; i < nvars; i++) { _vl[i] = x[i]; }
-  
-  free(x);
+  // the last evaluation was a rejected step: go back to the best point
+  if (stalled) function_gradient(x, grad);
 
   return 0;
 }
@@ -200,6 +341,44 @@ ME_Model::conditional_probability(const Sample & s,
   return max_label;
 }
 
+// conditional_probability() over the given classes only (see classify())
+int
+ME_Model::conditional_probability(const Sample & s, const vector<int> & classes,
+                                  std::vector<double> & membp) const
+{
+  assert(!classes.empty());
+  vector<double> powv(_num_classes, 0.0);
+  for (vector<int>::const_iterator j = s.positive_features.begin(); j != s.positive_features.end(); j++){
+    for (vector<int>::const_iterator k = _feature2mef[*j].begin(); k != _feature2mef[*j].end(); k++) {
+      powv[_fb.Feature(*k).label()] += _vl[*k];
+    }
+  }
+  for (vector<pair<int, double> >::const_iterator j = s.rvfeatures.begin(); j != s.rvfeatures.end(); j++) {
+    for (vector<int>::const_iterator k = _feature2mef[j->first].begin(); k != _feature2mef[j->first].end(); k++) {
+      powv[_fb.Feature(*k).label()] += _vl[*k] * j->second;
+    }
+  }
+
+  double maxpow = powv[classes.front()];
+  for (vector<int>::const_iterator i = classes.begin(); i != classes.end(); i++) {
+    maxpow = max(maxpow, powv[*i]);
+  }
+  double offset = max(0.0, maxpow - 700); // to avoid overflow
+  double sum = 0;
+  for (vector<int>::const_iterator i = classes.begin(); i != classes.end(); i++) {
+    double prod = exp(powv[*i] - offset);
+    if (_ref_modelp != NULL) prod *= s.ref_pd[*i];
+    membp[*i] = prod;
+    sum += prod;
+  }
+  int max_label = classes.front();
+  for (vector<int>::const_iterator i = classes.begin(); i != classes.end(); i++) {
+    membp[*i] /= sum;
+    if (membp[*i] > membp[max_label]) max_label = *i;
+  }
+  return max_label;
+}
+
 int
 ME_Model::make_feature_bag(const int cutoff)
 {
@@ -269,18 +448,47 @@ ME_Model::heldout_likelihood()
   return logl /= _heldout.size();
 }
 
-double
-ME_Model::update_model_expectation()
+// A share of the training samples of update_model_expectation(). The
+// shares are summed up in a fixed order, so the result does not depend on
+// how the threads happen to be scheduled.
+struct ME_Model::ExpectationJob
 {
-  double logl = 0;
-  int ncorrect = 0;
+  struct Share {
+    int begin, end;
+    vector<double> vme;
+    double logl;
+    int ncorrect;
+  };
+  const ME_Model * model;
+  vector<Share> shares;
+  size_t next;      // next share to be computed
+  NER::Mutex mtx;   // guards next
+};
 
-  _vme.resize(_fb.Size());
-  for (int i = 0; i < _fb.Size(); i++) _vme[i] = 0;
-  
-  int n = 0;
-  for (vector<Sample>::const_iterator i = _vs.begin(); i != _vs.end(); i++, n++) {
-    vector<double> membp(_num_classes);
+void
+ME_Model::expectation_thread(void * arg)
+{
+  ExpectationJob * job = static_cast<ExpectationJob *>(arg);
+  while (true) {
+    size_t idx;
+    {
+      NER::ScopedLock lock(job->mtx);
+      idx = job->next++;
+    }
+    if (idx >= job->shares.size()) break;
+    ExpectationJob::Share & s = job->shares[idx];
+    job->model->add_model_expectation(s.begin, s.end, s.vme, s.logl, s.ncorrect);
+  }
+}
+
+// adds the model expectation of the samples [begin, end) to vme (unnormalized)
+void
+ME_Model::add_model_expectation(const int begin, const int end, vector<double> & vme,
+                                double & logl, int & ncorrect) const
+{
+  vector<double> membp(_num_classes);
+  for (int n = begin; n < end; n++) {
+    const Sample * i = &_vs[n];
     int max_label = conditional_probability(*i, membp);
     
     logl += log(membp[i->label]);
@@ -290,16 +498,51 @@ ME_Model::update_model_expectation()
     // model_expectation
     for (vector<int>::const_iterator j = i->positive_features.begin(); j != i->positive_features.end(); j++){
       for (vector<int>::const_iterator k = _feature2mef[*j].begin(); k != _feature2mef[*j].end(); k++) {
-	_vme[*k] += membp[_fb.Feature(*k).label()];
+	vme[*k] += membp[_fb.Feature(*k).label()];
       }
     }
     for (vector<pair<int, double> >::const_iterator j = i->rvfeatures.begin(); j != i->rvfeatures.end(); j++) {
       for (vector<int>::const_iterator k = _feature2mef[j->first].begin(); k != _feature2mef[j->first].end(); k++) {
-	_vme[*k] += membp[_fb.Feature(*k).label()] * j->second;
+	vme[*k] += membp[_fb.Feature(*k).label()] * j->second;
       }
     }
     
   }
+}
+
+double
+ME_Model::update_model_expectation()
+{
+  double logl = 0;
+  int ncorrect = 0;
+
+  _vme.resize(_fb.Size());
+  for (int i = 0; i < _fb.Size(); i++) _vme[i] = 0;
+  
+  const int nshares = min(_num_threads, (int)_vs.size());
+  if (nshares <= 1) {
+    add_model_expectation(0, _vs.size(), _vme, logl, ncorrect);
+  } else {
+    ExpectationJob job;
+    job.model = this;
+    job.next = 0;
+    job.shares.resize(nshares);
+    for (int t = 0; t < nshares; t++) {
+      ExpectationJob::Share & s = job.shares[t];
+      s.begin = (int)((double)_vs.size() * t / nshares);
+      s.end = (int)((double)_vs.size() * (t + 1) / nshares);
+      s.vme.assign(_fb.Size(), 0.0);
+      s.logl = 0;
+      s.ncorrect = 0;
+    }
+    NER::run_threads(nshares, expectation_thread, &job);
+    for (int t = 0; t < nshares; t++) {
+      const ExpectationJob::Share & s = job.shares[t];
+      for (int i = 0; i < _fb.Size(); i++) _vme[i] += s.vme[i];
+      logl += s.logl;
+      ncorrect += s.ncorrect;
+    }
+  }
 
   for (int i = 0; i < _fb.Size(); i++) {
     _vme[i] /= _vs.size();
@@ -433,21 +676,25 @@ ME_Model::train(const int cutoff,
   _sigma = sigma;
   _inequality_width = widthfactor / _vs.size();
   
-  if (cutoff > 0)
-    cerr << "cutoff threshold = " << cutoff << endl;
-  if (_sigma > 0)
-    cerr << "Gaussian prior sigma = " << _sigma << endl;
-    //    cerr << "N*sigma^2 = " << Nsigma2 << " sigma = " << _sigma << endl;
-  if (widthfactor > 0)
-    cerr << "widthfactor = " << widthfactor << endl;
-  cerr << "preparing for estimation...";
+  if (_verbose) {
+    if (cutoff > 0)
+      cerr << "cutoff threshold = " << cutoff << endl;
+    if (_sigma > 0)
+      cerr << "Gaussian prior sigma = " << _sigma << endl;
+      //    cerr << "N*sigma^2 = " << Nsigma2 << " sigma = " << _sigma << endl;
+    if (widthfactor > 0)
+      cerr << "widthfactor = " << widthfactor << endl;
+    cerr << "preparing for estimation...";
+  }
   int C = make_feature_bag(cutoff);
   //  _vs.clear();
-  cerr << "done" << endl;
-  cerr << "number of samples = " << _vs.size() << endl;
-  cerr << "number of features = " << _fb.Size() << endl;
+  if (_verbose) {
+    cerr << "done" << endl;
+    cerr << "number of samples = " << _vs.size() << endl;
+    cerr << "number of features = " << _fb.Size() << endl;
 
-  cerr << "calculating empirical expectation...";
+    cerr << "calculating empirical expectation...";
+  }
   _vee.resize(_fb.Size());
   for (int i = 0; i < _fb.Size(); i++) {
     _vee[i] = 0;
@@ -470,7 +717,7 @@ ME_Model::train(const int cutoff,
   for (int i = 0; i < _fb.Size(); i++) {
     _vee[i] /= _vs.size();
   }
-  cerr << "done" << endl;
+  if (_verbose) cerr << "done" << endl;
   
   _vl.resize(_fb.Size());
   for (int i = 0; i < _fb.Size(); i++) _vl[i] = 0.0;
@@ -491,9 +738,10 @@ ME_Model::train(const int cutoff,
     for (int i = 0; i < _fb.Size(); i++) {
       if (_vl[i] != 0) sum++;
     }
-    cerr << "number of active features = " << sum << endl;
+    if (_verbose) cerr << "number of active features = " << sum << endl;
   }
   
+  return 1;
 }
 
 void
@@ -729,6 +977,35 @@ ME_Model::classify(ME_Sample & mes) const
   return vp;
 }
 
+int
+ME_Model::classify(const vector<int> & feature_ids, vector<double> & membp) const
+{
+  assert(_ref_modelp == NULL);  // a reference model needs the feature names
+  Sample s;
+  for (vector<int>::const_iterator j = feature_ids.begin(); j != feature_ids.end(); j++) {
+    if (*j >= 0)
+      s.positive_features.push_back(*j);
+  }
+
+  membp.resize(_num_classes);
+  return classify(s, membp);
+}
+
+int
+ME_Model::classify(const vector<int> & feature_ids, const vector<int> & classes,
+                   vector<double> & membp) const
+{
+  assert(_ref_modelp == NULL);  // a reference model needs the feature names
+  Sample s;
+  for (vector<int>::const_iterator j = feature_ids.begin(); j != feature_ids.end(); j++) {
+    if (*j >= 0)
+      s.positive_features.push_back(*j);
+  }
+
+  membp.assign(_num_classes, 0.0);
+  return conditional_probability(s, classes, membp);
+}
+
 /*
  * $Log: maxent.cpp,v $
  * Revision 1.2  2011/02/25 15:21:30  hccho
@@ -70,6 +70,21 @@ public:
   void add_training_sample(const ME_Sample & s);
   int train(const int cutoff = 0, const double sigma = 0, const double widthfactor = 0);
   std::vector<double> classify(ME_Sample & s) const;
+  // to classify a sample given as feature IDs of this model (see get_feature_id()).
+  // returns the ID of the most probable class.
+  int classify(const std::vector<int> & feature_ids, std::vector<double> & membp) const;
+  // the same, but only the probabilities of the given classes are computed: the
+  // distribution is normalized over them, and the other classes get 0.
+  int classify(const std::vector<int> & feature_ids, const std::vector<int> & classes,
+               std::vector<double> & membp) const;
+  int get_feature_id(const std::string & f) const { return _featurename_bag.Id(f); }
+  // to append the IDs of the features known to this model
+  void get_feature_ids(const std::vector<std::string> & features, std::vector<int> & ids) const {
+    for (std::vector<std::string>::const_iterator i = features.begin(); i != features.end(); i++) {
+      int id = _featurename_bag.Id(*i);
+      if (id >= 0) ids.push_back(id);
+    }
+  }
   bool load_from_file(const std::string & filename);
   bool save_to_file(const std::string & filename) const;
   int num_classes() const { return _num_classes; }
@@ -77,6 +92,11 @@ public:
   int get_class_id(const std::string & s) const { return _label_bag.Id(s); }
   void get_features(std::list< std::pair< std::pair<std::string, std::string>, double> > & fl);
   void set_heldout(const int h, const int n = 0) { _nheldout = h; _early_stopping_n = n; };
+  // number of threads computing the model expectation during training
+  void set_num_threads(const int n) { _num_threads = (n < 1) ? 1 : n; }
+  // to report the progress of training on cerr (on by default)
+  void set_verbose(const bool b) { _verbose = b; }
+  double train_error() const { return _train_error; }
   bool load_from_array(const ME_Model_Data data[]);
   void set_reference_model(const ME_Model & ref_model) { _ref_modelp = &ref_model; };
 
@@ -84,6 +104,8 @@ public:
     _nheldout = 0;
     _early_stopping_n = 0;
     _ref_modelp = NULL;
+    _num_threads = 1;
+    _verbose = true;
   }
 
 public:
@@ -264,12 +286,22 @@ private:
   int _early_stopping_n;
   std::vector<double> _vhlogl;
   const ME_Model * _ref_modelp;
+  int _num_threads;
+  bool _verbose;
+
+  struct ExpectationJob;
+  static void expectation_thread(void * arg);
 
   double heldout_likelihood();
   int conditional_probability(const Sample & nbs, std::vector<double> & membp) const;
+  int conditional_probability(const Sample & nbs, const std::vector<int> & classes,
+                              std::vector<double> & membp) const;
   int make_feature_bag(const int cutoff);
   int classify(const Sample & nbs, std::vector<double> & membp) const;
+  void add_model_expectation(const int begin, const int end, std::vector<double> & vme,
+                             double & logl, int & ncorrect) const;
   double update_model_expectation();
+  double function_gradient(const std::vector<double> & x, std::vector<double> & grad);
   int perform_LMVM();
   int perform_GIS(int C);
   void set_ref_dist(Sample & s) const;
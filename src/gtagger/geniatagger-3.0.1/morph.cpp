@@ -5,9 +5,22 @@
 #include <map>
 #include <set>
 #include <stdlib.h>
+#ifndef _WIN32
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+#include "../../cdbpp-1.1/include/cdbpp.h"
 
 using namespace std;
 
+// The compiled morphological dictionary (see compile_morphdic()) is this
+// header followed by one CDB++ chunk per table, in the MorphDic::Table order.
+static const char MORPHDIC_COMPILED_FILE[] = "morphdic.cdbpp";
+static const char MORPHDIC_HEADER[] = "GENIA morphdic 1.0";
+
 struct MorphDic
 {
   map<string, string> verbex;
@@ -17,9 +30,29 @@ struct MorphDic
   set<string> noundic;
   set<string> verbdic;
   set<string> adjdic;
-  MorphDic() {}
+
+  // Tables of the compiled dictionary, read in place from a mapped file
+  enum Table { NOUN_EX, VERB_EX, ADJ_EX, ADV_EX, NOUN_DIC, VERB_DIC, ADJ_DIC, N_TABLES };
+  cdbpp::cdbpp table[N_TABLES];
+  bool compiled;
+  const char *image;
+  size_t image_size;
+
+  MorphDic() : compiled(false), image(NULL), image_size(0) {}
+  ~MorphDic() {
+    for (int i = 0; i < N_TABLES; i++) table[i].close();
+#ifdef _WIN32
+    delete[] image;
+#else
+    if (image != NULL) munmap((void*)image, image_size);
+#endif
+  }
   void Init(const string &dir) {
     cerr << "Loading morphdic...";
+    if (! LoadCompiled(dir + "/" + MORPHDIC_COMPILED_FILE)) LoadText(dir);
+    cerr << "done." << endl;
+  }
+  void LoadText(const string &dir) {
     string path = dir + "/noun.exc";
     LoadEx(path.c_str(), nounex);
     path = dir + "/verb.exc";
@@ -34,7 +67,77 @@ struct MorphDic
     LoadIdx(path.c_str(), verbdic);
     path = dir + "/adj.dic";
     LoadIdx(path.c_str(), adjdic);
-    cerr << "done." << endl;
+  }
+  // Map the compiled dictionary; returns false if the file does not exist
+  bool LoadCompiled(const string & filename) {
+#ifdef _WIN32
+    ifstream ifile(filename.c_str(), ios::binary);
+    if (!ifile) return false;
+    ifile.seekg(0, ios::end);
+    image_size = (size_t)ifile.tellg();
+    ifile.seekg(0, ios::beg);
+    char *buffer = new char[image_size];
+    ifile.read(buffer, image_size);
+    image = buffer;
+#else
+    int fd = open(filename.c_str(), O_RDONLY);
+    if (fd < 0) return false;
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+      close(fd);
+      return false;
+    }
+    image_size = (size_t)st.st_size;
+    void *p = mmap(NULL, image_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (p == MAP_FAILED) {
+      cerr << "error: cannot map " << filename << endl;
+      exit(1);
+    }
+    image = (const char*)p;
+#endif
+    size_t pos = sizeof(MORPHDIC_HEADER);
+    if (image_size < pos || memcmp(image, MORPHDIC_HEADER, pos) != 0) {
+      cerr << "error: " << filename << " is not a compiled morphdic" << endl;
+      exit(1);
+    }
+    try {
+      for (int i = 0; i < N_TABLES; i++) {
+        pos += table[i].open(image + pos, image_size - pos);
+      }
+    } catch (const cdbpp::cdbpp_exception & e) {
+      cerr << "error: broken compiled morphdic " << filename << ": " << e.what() << endl;
+      exit(1);
+    }
+    compiled = true;
+    return true;
+  }
+  void Compile(const string & filename) const {
+    ofstream ofile(filename.c_str(), ios::binary);
+    if (!ofile) {
+      cerr << "error: cannot open " << filename << endl;
+      exit(1);
+    }
+    ofile.write(MORPHDIC_HEADER, sizeof(MORPHDIC_HEADER));
+    WriteEx(ofile, nounex);
+    WriteEx(ofile, verbex);
+    WriteEx(ofile, adjex);
+    WriteEx(ofile, advex);
+    WriteIdx(ofile, noundic);
+    WriteIdx(ofile, verbdic);
+    WriteIdx(ofile, adjdic);
+  }
+  static void WriteEx(ofstream & ofile, const map<string, string> & exmap) {
+    cdbpp::builder dbw(ofile);
+    for (map<string, string>::const_iterator i = exmap.begin(); i != exmap.end(); ++i) {
+      dbw.put(i->first.data(), i->first.size(), i->second.data(), i->second.size());
+    }
+  }
+  static void WriteIdx(ofstream & ofile, const set<string> & dic) {
+    cdbpp::builder dbw(ofile);
+    for (set<string>::const_iterator i = dic.begin(); i != dic.end(); ++i) {
+      dbw.put(i->data(), i->size(), "", 0);
+    }
   }
   /*
   void Init() {
@@ -91,38 +194,57 @@ struct MorphDic
       dic.insert(base2);
     }
   }
-  bool LookUpDicNoun(const string & s) {
-    return noundic.find(s) != noundic.end();
+  bool LookUpIdx(Table t, const set<string> & dic, const char * s, size_t len) const {
+    if (compiled) return table[t].get(s, len, NULL) != NULL;
+    return dic.find(string(s, len)) != dic.end();
   }
-  bool LookUpDicVerb(const string & s) {
-    return verbdic.find(s) != verbdic.end();
+  string LookUpEx(Table t, const map<string, string> & exmap, const string & s) const {
+    if (compiled) {
+      size_t vsize;
+      const char *base = (const char*)table[t].get(s.data(), s.size(), &vsize);
+      if (base == NULL) return "";
+      return string(base, vsize);
+    }
+    map<string, string>::const_iterator i = exmap.find(s);
+    if (i == exmap.end()) return "";
+    return i->second;
   }
-  bool LookUpDicAdj(const string & s) {
-    return adjdic.find(s) != adjdic.end();
+  bool LookUpDicNoun(const char * s, size_t len) const {
+    return LookUpIdx(NOUN_DIC, noundic, s, len);
   }
-  string BaseFormNoun(const string & s) {
-    map<string, string>::const_iterator i = nounex.find(s);
-    if (i == nounex.end()) return "";
-    return i->second;
+  bool LookUpDicVerb(const char * s, size_t len) const {
+    return LookUpIdx(VERB_DIC, verbdic, s, len);
   }
-  string BaseFormVerb(const string & s) {
-    map<string, string>::const_iterator i = verbex.find(s);
-    if (i == verbex.end()) return "";
-    return i->second;
+  bool LookUpDicAdj(const char * s, size_t len) const {
+    return LookUpIdx(ADJ_DIC, adjdic, s, len);
   }
-  string BaseFormAdj(const string & s) {
-    map<string, string>::const_iterator i = adjex.find(s);
-    if (i == adjex.end()) return "";
-    return i->second;
+  bool LookUpDicVerb(const string & s) const {
+    return LookUpDicVerb(s.data(), s.size());
   }
-  string BaseFormAdv(const string & s) {
-    map<string, string>::const_iterator i = advex.find(s);
-    if (i == advex.end()) return "";
-    return i->second;
+  bool LookUpDicAdj(const string & s) const {
+    return LookUpDicAdj(s.data(), s.size());
+  }
+  string BaseFormNoun(const string & s) const {
+    return LookUpEx(NOUN_EX, nounex, s);
+  }
+  string BaseFormVerb(const string & s) const {
+    return LookUpEx(VERB_EX, verbex, s);
+  }
+  string BaseFormAdj(const string & s) const {
+    return LookUpEx(ADJ_EX, adjex, s);
+  }
+  string BaseFormAdv(const string & s) const {
+    return LookUpEx(ADV_EX, advex, s);
   }
 };
 
-MorphDic morphdic;
+static MorphDic morphdic;
+
+// Suffix tests that do not copy the word
+static inline bool has_suffix(const string & s, int len, const char * suf, int n)
+{
+  return s.compare(len - n, n, suf) == 0;
+}
 
 static string base_form_noun(const string & s)
 {
@@ -131,28 +253,24 @@ static string base_form_noun(const string & s)
 
   int len = s.size();
   if (len > 1) {
-    string suf1 = s.substr(len - 1);
-    if (suf1 == "s") {
-      if (morphdic.LookUpDicNoun(s.substr(0, len - 1))) return s.substr(0, len - 1);
-      //      if (morphdic.LookUpDicVerb(s.substr(0, len - 1))) return s.substr(0, len - 1);
+    if (s[len - 1] == 's') {
+      if (morphdic.LookUpDicNoun(s.data(), len - 1)) return s.substr(0, len - 1);
+      //      if (morphdic.LookUpDicVerb(s.data(), len - 1)) return s.substr(0, len - 1);
     }
   }
   if (len > 4) {
-    string suf4 = s.substr(len - 4);
-    if (suf4 == "ches") return s.substr(0, len - 4) + "ch";
-    if (suf4 == "shes") return s.substr(0, len - 4) + "sh";
+    if (has_suffix(s, len, "ches", 4)) return s.substr(0, len - 4) + "ch";
+    if (has_suffix(s, len, "shes", 4)) return s.substr(0, len - 4) + "sh";
   }
   if (len > 3) {
-    string suf3 = s.substr(len - 3);
-    if (suf3 == "ses") return s.substr(0, len - 3) + "s";
-    if (suf3 == "xes") return s.substr(0, len - 3) + "x";
-    if (suf3 == "zes") return s.substr(0, len - 3) + "z";
-    if (suf3 == "men") return s.substr(0, len - 3) + "man";
-    if (suf3 == "ies") return s.substr(0, len - 3) + "y";
+    if (has_suffix(s, len, "ses", 3)) return s.substr(0, len - 3) + "s";
+    if (has_suffix(s, len, "xes", 3)) return s.substr(0, len - 3) + "x";
+    if (has_suffix(s, len, "zes", 3)) return s.substr(0, len - 3) + "z";
+    if (has_suffix(s, len, "men", 3)) return s.substr(0, len - 3) + "man";
+    if (has_suffix(s, len, "ies", 3)) return s.substr(0, len - 3) + "y";
   }
   if (len > 1) {
-    string suf1 = s.substr(len - 1);
-    if (suf1 == "s") return s.substr(0, len - 1);
+    if (s[len - 1] == 's') return s.substr(0, len - 1);
   }
   return s;
 }
@@ -165,23 +283,20 @@ static string base_form_verb(const string & s)
 
   int len = s.size();
   if (len > 3) {
-    string suf3 = s.substr(len - 3);
-    if (suf3 == "ies") return s.substr(0, len - 3) + "y";
-    if (suf3 == "ing") {
-      if (morphdic.LookUpDicVerb(s.substr(0, len - 3))) return s.substr(0, len - 3);
+    if (has_suffix(s, len, "ies", 3)) return s.substr(0, len - 3) + "y";
+    if (has_suffix(s, len, "ing", 3)) {
+      if (morphdic.LookUpDicVerb(s.data(), len - 3)) return s.substr(0, len - 3);
       else  return s.substr(0, len - 3)  + "e";
     }
   }
   if (len > 2) {
-    string suf2 = s.substr(len - 2);
-    if (suf2 == "es" || suf2 == "ed") {
-      if (morphdic.LookUpDicVerb(s.substr(0, len - 2))) return s.substr(0, len - 2);
+    if (has_suffix(s, len, "es", 2) || has_suffix(s, len, "ed", 2)) {
+      if (morphdic.LookUpDicVerb(s.data(), len - 2)) return s.substr(0, len - 2);
       else  return s.substr(0, len - 2)  + "e";
     }
   }
   if (len > 1) {
-    string suf1 = s.substr(len - 1);
-    if (suf1 == "s") return s.substr(0, len - 1);
+    if (s[len - 1] == 's') return s.substr(0, len - 1);
   }
   return s;
 }
@@ -193,16 +308,16 @@ static string base_form_adjective(const string & s)
 
   int len = s.size();
   if (len > 3) {
-    string suf3 = s.substr(len - 3);
-    if (suf3 == "est") {
-      if (morphdic.LookUpDicAdj(s.substr(0, len - 3) + "e")) return s.substr(0, len - 3) + "e";
+    if (has_suffix(s, len, "est", 3)) {
+      string stem = s.substr(0, len - 3) + "e";
+      if (morphdic.LookUpDicAdj(stem)) return stem;
       else  return s.substr(0, len - 3);
     }
   }
   if (len > 2) {
-    string suf2 = s.substr(len - 2);
-    if (suf2 == "er") {
-      if (morphdic.LookUpDicAdj(s.substr(0, len - 2) + "e")) return s.substr(0, len - 2) + "e";
+    if (has_suffix(s, len, "er", 2)) {
+      string stem = s.substr(0, len - 2) + "e";
+      if (morphdic.LookUpDicAdj(stem)) return stem;
       else  return s.substr(0, len - 2);
     }
   }
@@ -229,6 +344,15 @@ void init_morphdic(const string &path)
   morphdic.Init(path);
 }
 
+// Compile the morph files in dir into a single file that init_morphdic()
+// maps instead of parsing the text files
+void compile_morphdic(const string &dir, const string &filename)
+{
+  MorphDic dic;
+  dic.LoadText(dir);
+  dic.Compile(filename);
+}
+
 string base_form(const string & s, const string & pos)
 {
   if (pos == "NNS") return base_form_noun(s);
@@ -72,6 +72,20 @@ public:
 		return found;
 	}
 
+	// Get the name of the first parameter not listed in known_names (terminated by NULL).
+	bool get_unknown(const char* const known_names[], string &name) const {
+		for (V1_PARAM::const_iterator citr = params.begin(); citr != params.end(); ++citr) {
+			int i = 0;
+			while ((known_names[i] != NULL) && (citr->name != known_names[i]))
+				++i;
+			if (known_names[i] == NULL) {
+				name = citr->name;
+				return true;
+			}
+		}
+		return false;
+	}
+
 	// Output parameters.
 	void output_params(void) {
 		for (V1_PARAM::const_iterator citr = params.begin(); citr != params.end(); ++citr) {
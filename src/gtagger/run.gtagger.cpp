@@ -16,6 +16,7 @@
 #include <sstream>
 #include <map>
 #include <list>
+#include <algorithm>
 
 #include <stdio.h>  
 #include <stdlib.h>
@@ -26,6 +27,8 @@
 
 #include "option_parser/option_parser.h"
 #include "../nersuite_common/text_loader.h"
+#include "../nersuite_common/thread_utils.h"
+#include "../nersuite_common/output_writer.h"
 #include <fstream>
 
 using namespace std;
@@ -33,60 +36,181 @@ using namespace std;
 typedef    vector<string>    V1_STR;
 typedef    vector< V1_STR >  V2_STR;
 
-
-vector<ME_Model>    vme(16);    // genia pos models
-vector<ME_Model>    vme_chunking(16);  // genia chunking models
+// Number of sentences read per thread before a batch is tagged
+const int SENTS_PER_THREAD = 64;
 
 // Original functions of the Genia tagger 3.0.1
-int     genia_init( const string &genia_dir );
-string  bidir_postag( const string & s, const vector<ME_Model> & vme, const vector<ME_Model> & cvme, bool dont_tokenize );
-  int     run_tagging(istream &is, ostream &os, string multidoc_separator, bool dont_tokenize);
+int     genia_init( const string &genia_dir, vector<ME_Model> &vme, vector<ME_Model> &vme_chunking );
+string  bidir_postag( const string & s, const vector<ME_Model> & vme, const vector<ME_Model> & cvme,
+                      const multimap<string, string> & tag_dictionary, bool dont_tokenize,
+                      const DecodingOptions & decoding );
 void    bidir_chunking( vector<Sentence> & vs, const vector<ME_Model> & vme );
 void    init_morphdic( const string &path );
+void    compile_morphdic( const string &dir, const string &filename );
+int     load_tagdic( const string &filename, multimap<string, string> &tagdic );
+ClassificationMemoStats get_memo_stats();
 
 // New functions for this version
 // int     get_sent( istream &is, V2_STR &one_sent, string &multidoc_separator, bool &separator_read );
+int     run_tagging( istream &is, ostream &os, const string &multidoc_separator, bool dont_tokenize, bool line_buffered,
+                     NER::DataFormat in_format, NER::DataFormat out_format,
+                     const DecodingOptions &decoding,
+                     const vector<ME_Model> &vme, const vector<ME_Model> &vme_chunking,
+                     const multimap<string, string> &tagdic, int n_threads );
+void    tag_sentence( V2_STR &one_sent, int sent_no, bool dont_tokenize, const DecodingOptions &decoding,
+                      const vector<ME_Model> &vme, const vector<ME_Model> &vme_chunking,
+                      const multimap<string, string> &tagdic );
 string  assemble_tok_sent( const V2_STR &one_sent );
 int     tokenize( V1_STR &one_seg, string &one_line, const string &del );
-void    output_result( V2_STR &one_sent, ostream &os );
+void    output_result( V2_STR &one_sent, NER::OutputWriter &out );
 void    output_usage(char *command);
 
+static double percentage( size_t part, size_t total )
+{
+  return (total == 0) ? 0.0 : 100.0 * part / total;
+}
+
+
+// Options of nersuite_gtagger; any other option is an error
+static const char* const KNOWN_OPTIONS[] = {
+  "-d", "-f", "-l", "-multidoc", "-threads", "-decode", "-beam", "-max_window", "-window_overlap",
+  "-compile_morphdic", "-tagdic", "-line-buffered", "-if", "-of", NULL
+};
 
 int main(int argc, char* argv[])
 {
+  // Sentences are read from cin alone: unsynchronized, it tells SentenceReader
+  // how much input is waiting, which is then taken in one read
+  std::ios::sync_with_stdio( false );
+
   bool            dont_tokenize = true;
   string          opt_value = "";
   OPTION_PARSER   opt_parser;
+  int             n_consumed = 0;
 
   if (argc < 3) {
     output_usage(argv[0]);
     return -1;
   }else{
-    opt_parser.parse(argc - 1, &argv[1]);
+    n_consumed = opt_parser.parse(argc - 1, &argv[1]);
     if( !opt_parser.get_value("-d", opt_value) ) {
       cerr << "-d option is required." << endl;
       return -2;
     }
   }
 
-  // 1. Load POS-tagging, lemmatization and chunking models
+  // 1. Check the number of tagging threads
+  int      n_threads = 1;
+  if( opt_parser.get_value("-threads", opt_value) ) {
+    n_threads = atoi( opt_value.c_str() );
+    if( n_threads < 1 ) {
+      cerr << "-threads option requires a positive number." << endl;
+      return -2;
+    }
+  }
+
+  // 2. Check the decoder
+  DecodingOptions    decoding;
+  if( opt_parser.get_value("-decode", opt_value) ) {
+    if( opt_value == "beam" ) {
+      decoding.mode = DECODE_BEAM;
+    }else if( opt_value == "greedy-bidir" ) {
+      decoding.mode = DECODE_GREEDY_BIDIR;
+    }else if( opt_value == "left-to-right" ) {
+      decoding.mode = DECODE_LEFT_TO_RIGHT;
+    }else {
+      cerr << "-decode option requires beam, greedy-bidir or left-to-right." << endl;
+      return -2;
+    }
+  }
+  if( opt_parser.get_value("-beam", opt_value) ) {
+    decoding.beam_width = atoi( opt_value.c_str() );
+    if( decoding.beam_width < 1 ) {
+      cerr << "-beam option requires a positive number." << endl;
+      return -2;
+    }
+  }
+  if( opt_parser.get_value("-max_window", opt_value) ) {
+    decoding.max_window = atoi( opt_value.c_str() );
+    if( decoding.max_window < 0 ) {
+      cerr << "-max_window option requires a non-negative number." << endl;
+      return -2;
+    }
+  }
+  if( opt_parser.get_value("-window_overlap", opt_value) ) {
+    decoding.window_overlap = atoi( opt_value.c_str() );
+    if( decoding.window_overlap < 0 ) {
+      cerr << "-window_overlap option requires a non-negative number." << endl;
+      return -2;
+    }
+  }
+  if( (decoding.max_window > 0) && (decoding.window_overlap >= decoding.max_window) ) {
+    cerr << "-window_overlap must be smaller than -max_window." << endl;
+    return -2;
+  }
+
+  // 3. Compile the morphological dictionary of the model directory, if asked to
+  string   morphdic_file = "";
+  if( opt_parser.get_value("-compile_morphdic", morphdic_file) ) {
+    opt_parser.get_value("-d", opt_value);
+    cerr << "Compiling morphdic into " << morphdic_file << "...";
+    compile_morphdic( opt_value, morphdic_file );
+    cerr << "done." << endl;
+    return 0;
+  }
+
+  // 4. Load POS-tagging, lemmatization and chunking models
+  //    The models are only read after this point, so all threads share them.
+  vector<ME_Model>    vme(16);    // genia pos models
+  vector<ME_Model>    vme_chunking(16);  // genia chunking models
+
   opt_parser.get_value("-d", opt_value);
   if( opt_value[ opt_value.length() - 1 ] != '/' )
     opt_value += "/";
-  genia_init(opt_value);
+  genia_init(opt_value, vme, vme_chunking);
+
+  //    With -tagdic FILE, the POS tags of known words are restricted to those of the tag dictionary
+  multimap<string, string>   tagdic;
+  string   tagdic_file;
+  if( opt_parser.get_value("-tagdic", tagdic_file) ) {
+    int    n_words = load_tagdic( tagdic_file, tagdic );
+    if( n_words < 0 ) {
+      cerr << "Can not open a file: " << tagdic_file << endl;
+      return -3;
+    }
+    cerr << "Loaded the tag dictionary of " << n_words << " words." << endl;
+  }
 
-  // 2. Check multi-document mode
+  // 5. Check multi-document mode
   string   multidoc_separator = "";
-  bool     multidoc_mode = opt_parser.get_value("-multidoc", multidoc_separator);
-  
-  // 3. Run POS-tagging, Lemmatization and Chunking with Genia tagger ver. 3.0.1
-  if ( (argc == 3) || ( (argc == 5) && (multidoc_mode == true) ) ) {
-    run_tagging(cin, cout, multidoc_separator, dont_tokenize);
+  opt_parser.get_value("-multidoc", multidoc_separator);
+
+  //    The output is only flushed at the end of each document, unless -line-buffered is given
+  string   line_buffered_opt;
+  bool     line_buffered = opt_parser.get_value("-line-buffered", line_buffered_opt);
+
+  //    Sentences are read and written as tab-separated text, unless -if / -of binary is given
+  NER::DataFormat   in_format = NER::FORMAT_TSV, out_format = NER::FORMAT_TSV;
+  if( opt_parser.get_value("-if", opt_value) && ! NER::parse_data_format(opt_value, in_format) ) {
+    cerr << "-if option requires tsv or binary." << endl;
+    return -2;
+  }
+  if( opt_parser.get_value("-of", opt_value) && ! NER::parse_data_format(opt_value, out_format) ) {
+    cerr << "-of option requires tsv or binary." << endl;
+    return -2;
+  }
+  if( in_format == NER::FORMAT_BINARY )
+    NER::set_binary_stdio( stdin );
+  if( out_format == NER::FORMAT_BINARY )
+    NER::set_binary_stdio( stdout );
+  ios::openmode     in_mode = (in_format == NER::FORMAT_BINARY) ? ios::in | ios::binary : ios::in;
+  ios::openmode     out_mode = (out_format == NER::FORMAT_BINARY) ? ios::out | ios::binary : ios::out;
   
-  }else if (opt_parser.get_value("-f", opt_value)) {
-    ifstream ifs(opt_value.c_str());
+  // 6. Run POS-tagging, Lemmatization and Chunking with Genia tagger ver. 3.0.1
+  if (opt_parser.get_value("-f", opt_value)) {
+    ifstream ifs(opt_value.c_str(), in_mode);
 		if( ifs ) {
-	    run_tagging(ifs, cout, multidoc_separator, dont_tokenize);
+	    run_tagging(ifs, cout, multidoc_separator, dont_tokenize, line_buffered, in_format, out_format, decoding, vme, vme_chunking, tagdic, n_threads);
   	  ifs.close();
 		}else {
 			cerr << "Can not open a file: " << opt_value.c_str() << endl;
@@ -109,7 +233,7 @@ int main(int argc, char* argv[])
     while(getline(ifs_lst, fn)) {
       string target = path + fn, result = path + fn + ".gtag";
 
-      ifstream ifs_trg(target.c_str());
+      ifstream ifs_trg(target.c_str(), in_mode);
       if (! ifs_trg) {
         cerr << "Cannot open a target file! " << target << endl;
         return -4;
@@ -117,77 +241,169 @@ int main(int argc, char* argv[])
 				cerr << "Processing a file: " << target << endl;
 			}
 
-      ofstream ofs_res(result.c_str());
+      ofstream ofs_res(result.c_str(), out_mode);
       
-      run_tagging(ifs_trg, ofs_res, multidoc_separator, dont_tokenize);
+      run_tagging(ifs_trg, ofs_res, multidoc_separator, dont_tokenize, line_buffered, in_format, out_format, decoding, vme, vme_chunking, tagdic, n_threads);
       ifs_trg.close();
       ofs_res.close();
     }
     ifs_lst.close();
+  }else if ( (n_consumed == argc - 1) && ! opt_parser.get_unknown(KNOWN_OPTIONS, opt_value) ) {
+    run_tagging(cin, cout, multidoc_separator, dont_tokenize, line_buffered, in_format, out_format, decoding, vme, vme_chunking, tagdic, n_threads);
   }else {
+    if( n_consumed < argc - 1 )
+      cerr << "Unexpected argument: " << argv[n_consumed + 1] << endl;
+    else
+      cerr << "Unknown option: " << opt_value << endl;
     cerr << "Input must be 1) STDIN, 2) an input file name, or 3) a file name of input files." << endl;
     return -3;
   }
+
+  // 7. Report how often the beam decoders reused a classification
+  ClassificationMemoStats   stats = get_memo_stats();
+  if( stats.pos_lookups + stats.chunk_lookups > 0 )
+    cerr << "Classification memo hits: POS " << stats.pos_hits << "/" << stats.pos_lookups
+         << " (" << percentage( stats.pos_hits, stats.pos_lookups ) << "%), chunking "
+         << stats.chunk_hits << "/" << stats.chunk_lookups
+         << " (" << percentage( stats.chunk_hits, stats.chunk_lookups ) << "%)" << endl;
   
   return 0;
 }
 
+// A batch of sentences shared by the tagging threads
+struct TaggingBatch {
+  vector<V2_STR>            sents;          // sentences (or comment blocks) in input order
+  vector<bool>              is_comment;     // comment blocks are passed through untouched
+  vector<int>               sent_no;        // sentence number used in warnings
+  size_t                    n_sents;        // number of valid entries in this batch
+  size_t                    next;           // next entry to be tagged
+  NER::Mutex                mtx;            // guards next
+
+  bool                      dont_tokenize;
+  DecodingOptions           decoding;
+  const vector<ME_Model>    *vme;
+  const vector<ME_Model>    *vme_chunking;
+  const multimap<string, string>  *tagdic;
+};
+
+// Thread entry point: tag the sentences of a batch until none are left
+void tag_batch(void *arg)
+{
+  TaggingBatch  *batch = static_cast<TaggingBatch*>(arg);
+
+  while (true) {
+    size_t  idx;
+    {
+      NER::ScopedLock   lock(batch->mtx);
+      idx = batch->next++;
+    }
+    if (idx >= batch->n_sents)
+      break;
+    if (! batch->is_comment[idx])
+      tag_sentence(batch->sents[idx], batch->sent_no[idx], batch->dont_tokenize, batch->decoding,
+                   *batch->vme, *batch->vme_chunking, *batch->tagdic);
+  }
+}
+
 // Tag input from the is stream, and output its result to the os stream.
-int run_tagging(istream &is, ostream &os, string multidoc_separator, bool dont_tokenize) {
+//   With n_threads > 1, sentences are read in batches and tagged concurrently,
+//   but the output keeps the input order (including multidoc comment blocks).
+int run_tagging( istream &is, ostream &os, const string &multidoc_separator, bool dont_tokenize, bool line_buffered,
+                 NER::DataFormat in_format, NER::DataFormat out_format,
+                 const DecodingOptions &decoding,
+                 const vector<ME_Model> &vme, const vector<ME_Model> &vme_chunking,
+                 const multimap<string, string> &tagdic, int n_threads )
+{
   int       n = 1;
-  V2_STR    one_sent;
-  
-  bool multidoc_mode = multidoc_separator != "";
-  bool separator_read;
+  bool      multidoc_mode = multidoc_separator != "";
+  size_t    batch_size = (n_threads > 1) ? n_threads * SENTS_PER_THREAD : 1;
+
+  TaggingBatch  batch;
+  batch.sents.resize( batch_size );
+  batch.is_comment.resize( batch_size );
+  batch.sent_no.resize( batch_size );
+  batch.dont_tokenize = dont_tokenize;
+  batch.decoding = decoding;
+  batch.vme = &vme;
+  batch.vme_chunking = &vme_chunking;
+  batch.tagdic = &tagdic;
+
+  NER::OutputWriter  out( os, line_buffered, out_format );
+
+  NER::SentenceReader  reader( is, in_format );
+
+	while (! reader.eof() ) {
+		// 1. Read a batch of sentences (or comments)
+    batch.n_sents = 0;
+    while( (batch.n_sents < batch_size) && (! reader.eof()) ) {
+      bool    separator_read;
+      NER::get_sent(reader, batch.sents[batch.n_sents], multidoc_separator, separator_read);
+
+      batch.is_comment[batch.n_sents] = multidoc_mode && separator_read;
+      batch.sent_no[batch.n_sents] = n;
+      if( ! batch.is_comment[batch.n_sents] )
+        ++n;
+      ++batch.n_sents;
+    }
+
+		// 2. Run the GENIA tagger on the sentences of the batch
+    batch.next = 0;
+    NER::run_threads( (int) min((size_t) n_threads, batch.n_sents), tag_batch, &batch );
+
+		// 3. Output the results in the input order
+    //    Lines of comments are passed to the output, if the multidoc mode is on
+    for( size_t i = 0; i < batch.n_sents; ++i ) {
+      if( batch.is_comment[i] ) {
+        out.write_comment( batch.sents[i] );
+      }else {
+        output_result( batch.sents[i], out );
+      }
+    }
+  }
   
-	while (! is.eof() ) {
-		// 1. Read a sentence (or comments)
-    NER::get_sent(is, one_sent, multidoc_separator, separator_read);
-		
-		// 2. Pass the input to output, if the multidoc mode is on and the read sentence is lines of comments
-		if( multidoc_mode && separator_read ) {
-			for( V2_STR::iterator irow = one_sent.begin(); irow != one_sent.end(); ++irow ) {
-				os << irow->front() << endl;
-			}
-			os << endl;
+  return 0;
+}
 
-			continue;
-		}
 
-		// 3. Run the GENIA tagger on the sentence 
-    string    tok_sent = assemble_tok_sent( one_sent );
-		if( tok_sent.size() > 1024 )
-      cerr << "Warning: input sentence seems to be too long at the line, " << n << endl;
+// Tag a sentence and append the result columns to it
+//   Only reads the models and the morphological dictionary, so several
+//   sentences can be tagged at the same time.
+void tag_sentence( V2_STR &one_sent, int sent_no, bool dont_tokenize, const DecodingOptions &decoding,
+                   const vector<ME_Model> &vme, const vector<ME_Model> &vme_chunking,
+                   const multimap<string, string> &tagdic )
+{
+  // 1. Assemble the tokens
+  //    Without -max_window, the decoding time of a long sentence grows
+  //    quadratically with its length.
+  string    tok_sent = assemble_tok_sent( one_sent );
+  if( (tok_sent.size() > 1024) && (decoding.max_window == 0) ) {
+    ostringstream   oss;
+    oss << "Warning: input sentence seems to be too long at the line, " << sent_no << endl;
+    cerr << oss.str();
+  }
 
-    // 3.1. Run tagging
-    string    tagged = bidir_postag( tok_sent, vme, vme_chunking, dont_tokenize );
+  // 2. Run tagging
+  string    tagged = bidir_postag( tok_sent, vme, vme_chunking, tagdic, dont_tokenize, decoding );
 
-    // 3.2. Split the result and push them into the data container
-    V2_STR::iterator  i_row_sent = one_sent.begin();
+  // 3. Split the result and push them into the data container
+  V2_STR::iterator  i_row_sent = one_sent.begin();
 
-    V1_STR    line_items;
-    tokenize( line_items, tagged, "\n" );
-    for( V1_STR::iterator i_row_tagged = line_items.begin(); i_row_tagged != line_items.end(); ++i_row_tagged) {
-      V1_STR    token_items;
-      tokenize( token_items, *i_row_tagged, "\t" );
-      
-      for( V1_STR::iterator i_col_tagged = token_items.begin() + 1; i_col_tagged != token_items.end(); ++i_col_tagged )
-        i_row_sent->push_back( *i_col_tagged );
-  
-      ++i_row_sent;
-    }
+  V1_STR    line_items;
+  tokenize( line_items, tagged, "\n" );
+  for( V1_STR::iterator i_row_tagged = line_items.begin(); i_row_tagged != line_items.end(); ++i_row_tagged) {
+    V1_STR    token_items;
+    tokenize( token_items, *i_row_tagged, "\t" );
+    
+    for( V1_STR::iterator i_col_tagged = token_items.begin() + 1; i_col_tagged != token_items.end(); ++i_col_tagged )
+      i_row_sent->push_back( *i_col_tagged );
 
-    // 3.3. Output the result
-    output_result( one_sent, os );
-    ++n;
+    ++i_row_sent;
   }
-  
-  return 0;
 }
 
 
 // Load models of the GENIA tagger 3.0.1
-int genia_init( const string &genia_dir )
+int genia_init( const string &genia_dir, vector<ME_Model> &vme, vector<ME_Model> &vme_chunking )
 {
   init_morphdic( genia_dir );
   
@@ -257,23 +473,15 @@ int tokenize( V1_STR &one_seg, string &one_line, const string &del )
 
 
 // Print results
-void output_result( V2_STR &one_sent, ostream &os )
+void output_result( V2_STR &one_sent, NER::OutputWriter &out )
 {
-  for( V2_STR::iterator i_row = one_sent.begin(); i_row != one_sent.end(); ++i_row ) {
-    for( V1_STR::iterator i_col = i_row->begin(); i_col != i_row->end(); ++i_col ) {
-      os << *i_col;
-      if( (i_col + 1) != i_row->end() )
-        os << "\t";
-    }
-    os << endl;
-  }
-  os <<  endl;
+  out.write_sent( one_sent );
 }
 
 
 void output_usage(char *command)
 {
-    cerr << "Usage: " << command << " -d  <path/to/the/model/directory/>  [file(s)]" << endl;
+    cerr << "Usage: " << command << " -d  <path/to/the/model/directory/>  [-threads N]  [-decode MODE]  [-max_window N]  [-tagdic FILE]  [-line-buffered]  [-if FORMAT]  [-of FORMAT]  [file(s)]" << endl;
     cerr << "  1. <path/to/the/model/directory/>" << endl;
     cerr << "    - Path to the directory in which the GENIA tagger models are stored " << endl;
 	cerr << endl;
@@ -289,6 +497,44 @@ void output_usage(char *command)
     cerr << "  3. multi-document mode (for tag mode) " << endl;
     cerr << "     - if -multidoc SEP option is given, looks for lines beginning with the "   << endl;
     cerr << "       separator SEP in the input and echoes the same on output." << endl; 
+    cerr << endl;
+    cerr << "  4. parallel tagging " << endl;
+    cerr << "     - if -threads N option is given, sentences are tagged with N threads " << endl;
+    cerr << "       sharing the loaded models. The output order is the same as the input order." << endl;
+    cerr << endl;
+    cerr << "  5. compiled morphological dictionary " << endl;
+    cerr << "     - -compile_morphdic FILE compiles the morph files (*.exc, *.dic) of the model " << endl;
+    cerr << "       directory into FILE and exits. If the model directory has a compiled " << endl;
+    cerr << "       morphdic.cdbpp, it is mapped at startup instead of parsing the text files." << endl;
+    cerr << endl;
+    cerr << "  6. decoding " << endl;
+    cerr << "     - -decode beam (default) runs the easiest-first beam search of the GENIA tagger;" << endl;
+    cerr << "       -beam N sets its width (default: 1)." << endl;
+    cerr << "     - -decode greedy-bidir gives the same tags as a beam of width 1, faster." << endl;
+    cerr << "     - -decode left-to-right classifies each token once, knowing only the tags on " << endl;
+    cerr << "       its left: the fastest, at some loss of accuracy." << endl;
+    cerr << endl;
+    cerr << "  7. long sentences " << endl;
+    cerr << "     - -max_window N decodes sentences longer than N tokens in windows of N tokens," << endl;
+    cerr << "       each overlapping the next by -window_overlap M tokens (default: 16), and keeps " << endl;
+    cerr << "       the tags decoded away from the window edges. This bounds the decoding time " << endl;
+    cerr << "       per token. -max_window 0 (default) decodes whole sentences." << endl;
+    cerr << endl;
+    cerr << "  8. tag dictionary " << endl;
+    cerr << "     - -tagdic FILE restricts the POS tags of the words of the tag dictionary FILE " << endl;
+    cerr << "       to the tags listed there, which narrows the beam candidates. No dictionary " << endl;
+    cerr << "       is used by default; nersuite_gtagger_train writes one to pos.tagdic of the " << endl;
+    cerr << "       model directory. gtagger_decode_eval.py -o \"-tagdic FILE\" measures the " << endl;
+    cerr << "       difference on held-out data." << endl;
+    cerr << endl;
+    cerr << "  9. output buffering " << endl;
+    cerr << "     - the output is written in large blocks, and flushed at the end of each " << endl;
+    cerr << "       document. -line-buffered flushes it at the end of every line instead." << endl;
+    cerr << endl;
+    cerr << "  10. data formats " << endl;
+    cerr << "     - -if FORMAT and -of FORMAT set the format of the input and of the output: " << endl;
+    cerr << "       tsv (default) or binary, the NERsuite binary format for passing sentences " << endl;
+    cerr << "       between the NERsuite tools without formatting and parsing them as text." << endl;
 
 }
 
@@ -0,0 +1,281 @@
+/**
+ * Trainer of the GENIA tagger models for NERSuite
+ * The information on the license of using the GENIA tagger is
+ * in in LICENSE and README files, and NERSuite follows it.
+ *
+ * Trains the 16 bidirectional POS-tagging models and the 4 chunking models
+ * read by nersuite_gtagger. The models are trained concurrently, and the
+ * model expectations of each one are computed with several threads.
+ *
+**/
+
+#include <iostream>
+#include <string>
+#include <sstream>
+#include <vector>
+#include <algorithm>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "geniatagger-3.0.1/maxent.h"
+#include "geniatagger-3.0.1/common.h"
+
+
+#include "option_parser/option_parser.h"
+#include "../nersuite_common/thread_utils.h"
+#include <fstream>
+
+using namespace std;
+
+// Number of the models: 16 POS-tagging models and chunking models 0, 2, 4 and 6
+const int N_POS_MODELS = 16;
+const int N_CHUNK_MODELS = 4;
+
+// Original functions of the Genia tagger 3.0.1 (modified for training)
+int     bidir_train( const vector<Sentence> & vs, int t, const string & filename, const TrainingParameters & param );
+int     bidir_chunking_train( const vector<Sentence> & vs, int t, const string & filename, const TrainingParameters & param );
+int     save_tagdic( const vector<Sentence> & vs, int min_count, const string & filename );
+
+// New functions for this version
+int     load_corpus( istream &is, bool gtagger_format, vector<Sentence> &vs );
+void    output_usage( char *command );
+
+// The models to be trained, shared by the training threads
+struct TrainingJobs {
+  const vector<Sentence>    *vs;
+  string                    model_dir;
+  TrainingParameters        param;
+
+  int                       next;       // next model to be trained
+  int                       n_failed;   // number of models which could not be trained
+  NER::Mutex                mtx;        // guards next, n_failed and cerr
+};
+
+// Thread entry point: train models until none are left
+void train_models(void *arg)
+{
+  TrainingJobs  *jobs = static_cast<TrainingJobs*>(arg);
+
+  while (true) {
+    int   idx;
+    {
+      NER::ScopedLock   lock(jobs->mtx);
+      idx = jobs->next++;
+    }
+    if (idx >= N_POS_MODELS + N_CHUNK_MODELS)
+      break;
+
+    char    buf[16];
+    string  fn_model;
+    int     ret;
+    if( idx < N_POS_MODELS ) {
+      sprintf( buf, "%d", idx );
+      fn_model = jobs->model_dir + "pos.model.bidir." + buf;
+      ret = bidir_train( *jobs->vs, idx, fn_model, jobs->param );
+    }else {
+      sprintf( buf, "%d", (idx - N_POS_MODELS) * 2 );
+      fn_model = jobs->model_dir + "chunk.model.bidir." + buf;
+      ret = bidir_chunking_train( *jobs->vs, (idx - N_POS_MODELS) * 2, fn_model, jobs->param );
+    }
+
+    NER::ScopedLock   lock(jobs->mtx);
+    if( ret != 0 ) {
+      cerr << "Failed to train " << fn_model << endl;
+      ++jobs->n_failed;
+    }else {
+      cerr << "Trained " << fn_model << endl;
+    }
+  }
+}
+
+
+int main(int argc, char* argv[])
+{
+  string          opt_value = "";
+  OPTION_PARSER   opt_parser;
+
+  if (argc < 3) {
+    output_usage(argv[0]);
+    return -1;
+  }else{
+    opt_parser.parse(argc - 1, &argv[1]);
+    if( !opt_parser.get_value("-d", opt_value) ) {
+      cerr << "-d option is required." << endl;
+      return -2;
+    }
+  }
+
+  TrainingJobs    jobs;
+  jobs.model_dir = opt_value;
+  if( jobs.model_dir[ jobs.model_dir.length() - 1 ] != '/' )
+    jobs.model_dir += "/";
+
+  // 1. Check the number of threads
+  int      n_threads = 1;
+  if( opt_parser.get_value("-threads", opt_value) ) {
+    n_threads = atoi( opt_value.c_str() );
+    if( n_threads < 1 ) {
+      cerr << "-threads option requires a positive number." << endl;
+      return -2;
+    }
+  }
+
+  // 2. Check the parameters of the estimation
+  //    A Gaussian prior replaces the default inequality modeling.
+  if( opt_parser.get_value("-cutoff", opt_value) )
+    jobs.param.cutoff = atoi( opt_value.c_str() );
+  if( opt_parser.get_value("-sigma", opt_value) ) {
+    jobs.param.sigma = atof( opt_value.c_str() );
+    if( jobs.param.sigma > 0 )
+      jobs.param.widthfactor = 0;
+  }
+  if( opt_parser.get_value("-width", opt_value) )
+    jobs.param.widthfactor = atof( opt_value.c_str() );
+  if( (jobs.param.sigma > 0) && (jobs.param.widthfactor > 0) ) {
+    cerr << "-sigma and -width options cannot be used together." << endl;
+    return -2;
+  }
+
+  // 3. Load the training corpus
+  bool     gtagger_format = false;
+  if( opt_parser.get_value("-format", opt_value) ) {
+    if( opt_value == "gtagger" ) {
+      gtagger_format = true;
+    }else if( opt_value != "conll" ) {
+      cerr << "-format option requires conll or gtagger." << endl;
+      return -2;
+    }
+  }
+
+  vector<Sentence>    vs;
+  if (opt_parser.get_value("-f", opt_value)) {
+    ifstream ifs(opt_value.c_str());
+    if( ! ifs ) {
+      cerr << "Can not open a file: " << opt_value.c_str() << endl;
+      return -3;
+    }
+    if( load_corpus(ifs, gtagger_format, vs) < 0 )
+      return -3;
+    ifs.close();
+  }else {
+    if( load_corpus(cin, gtagger_format, vs) < 0 )
+      return -3;
+  }
+  if( vs.empty() ) {
+    cerr << "The training corpus is empty." << endl;
+    return -3;
+  }
+  cerr << "Loaded " << vs.size() << " sentences." << endl;
+
+  // 4. Write the tag dictionary of the words seen at least -tagdic_min times
+  int      tagdic_min = 5;
+  if( opt_parser.get_value("-tagdic_min", opt_value) ) {
+    tagdic_min = atoi( opt_value.c_str() );
+    if( tagdic_min < 1 ) {
+      cerr << "-tagdic_min option requires a positive number." << endl;
+      return -2;
+    }
+  }
+  int      n_words = save_tagdic( vs, tagdic_min, jobs.model_dir + "pos.tagdic" );
+  if( n_words < 0 ) {
+    cerr << "Failed to write " << jobs.model_dir << "pos.tagdic" << endl;
+    return -4;
+  }
+  cerr << "Wrote the tag dictionary of " << n_words << " words." << endl;
+
+  // 5. Train the models
+  //    Up to one thread per model; the threads left over compute the model
+  //    expectations of each model. The progress of the estimation is only
+  //    reported when the models are trained one by one.
+  int      n_parallel = min( n_threads, N_POS_MODELS + N_CHUNK_MODELS );
+  jobs.vs = &vs;
+  jobs.param.num_threads = n_threads / n_parallel;
+  jobs.param.verbose = (n_parallel == 1);
+  jobs.next = 0;
+  jobs.n_failed = 0;
+  NER::run_threads( n_parallel, train_models, &jobs );
+
+  if( jobs.n_failed > 0 ) {
+    cerr << jobs.n_failed << " model(s) could not be trained." << endl;
+    return -4;
+  }
+
+  return 0;
+}
+
+
+// Load sentences of the training corpus
+//   A line has the columns of a token, and an empty line ends a sentence.
+//   The columns are whitespace-separated: word, POS and IOB2 chunk tag in the
+//   conll format, and those of the nersuite_gtagger output in the gtagger format.
+int load_corpus( istream &is, bool gtagger_format, vector<Sentence> &vs )
+{
+  const size_t  word_col = gtagger_format ? 2 : 0;
+  const size_t  pos_col = gtagger_format ? 4 : 1;
+  const size_t  chunk_col = gtagger_format ? 5 : 2;
+
+  string    line;
+  int       line_no = 0;
+  Sentence  sent;
+
+  while( getline(is, line) ) {
+    ++line_no;
+
+    istringstream     iss(line);
+    vector<string>    cols;
+    string            col;
+    while( iss >> col )
+      cols.push_back(col);
+
+    if( cols.empty() ) {
+      if( ! sent.empty() ) {
+        vs.push_back(sent);
+        sent.clear();
+      }
+      continue;
+    }
+
+    if( cols.size() <= chunk_col ) {
+      cerr << "Too few columns at the line, " << line_no << endl;
+      return -1;
+    }
+    sent.push_back( Token(cols[word_col], cols[pos_col]) );
+    sent.back().tag = cols[chunk_col];
+  }
+  if( ! sent.empty() )
+    vs.push_back(sent);
+
+  return (int) vs.size();
+}
+
+
+void output_usage(char *command)
+{
+    cerr << "Usage: " << command << " -d  <path/to/the/model/directory/>  [-threads N]  [-f corpus]" << endl;
+    cerr << "  1. <path/to/the/model/directory/>" << endl;
+    cerr << "    - Path to the directory in which pos.model.bidir.0-15, " << endl;
+    cerr << "      chunk.model.bidir.{0,2,4,6} and pos.tagdic are written. nersuite_gtagger also needs the " << endl;
+    cerr << "      morphological dictionary (*.exc, *.dic) of the GENIA tagger in that directory." << endl;
+    cerr << endl;
+    cerr << "  2. [-f corpus]" << endl;
+    cerr << "    - The training corpus is read from the file given with -f option, or from the" << endl;
+    cerr << "      standard input." << endl;
+    cerr << "    - A line has the columns of a token, and an empty line ends a sentence." << endl;
+    cerr << "    - -format conll (default): word, POS and IOB2 chunk tag columns." << endl;
+    cerr << "    - -format gtagger: the columns of the nersuite_gtagger output." << endl;
+    cerr << endl;
+    cerr << "  3. parallel training " << endl;
+    cerr << "     - if -threads N option is given, up to N models are trained at the same time," << endl;
+    cerr << "       and the threads left over compute the model expectations of each model." << endl;
+    cerr << endl;
+    cerr << "  4. estimation " << endl;
+    cerr << "     - -cutoff N drops the features seen no more than N times (default: 2)." << endl;
+    cerr << "     - -width W uses inequality modeling with the width factor W (default: 1)." << endl;
+    cerr << "     - -sigma S uses a Gaussian prior with the standard deviation S instead." << endl;
+    cerr << endl;
+    cerr << "  5. tag dictionary " << endl;
+    cerr << "     - pos.tagdic lists the POS tags of the words seen at least -tagdic_min N times" << endl;
+    cerr << "       (default: 5). Given with -tagdic, nersuite_gtagger only gives those words" << endl;
+    cerr << "       the tags listed." << endl;
+}
+
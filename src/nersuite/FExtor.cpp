@@ -30,6 +30,7 @@
 */
 
 #include "FExtor.h"
+#include "../nersuite_common/text_loader.h"
 
 
 using namespace std;
@@ -643,9 +644,27 @@ namespace NER
 	void FeatureExtractor::ext_DIC_feats(const V2_STR &one_sent, V2_STR &sent_feats, int opt_dic)
 	{
 		int						end_COL_DIC = 0, k_dics = 0;
-		string					one_feat= "", feat_value1 = "", feat_value2 = "", feat_word_value1 = "", feat_word_value2 = "";
+		string					one_feat= "";
+		string					dic_values[RHS_CS - LHS_CS + 1];		// Values of a dictionary column around the current token
 		V2_STR::iterator		i_row_feats = sent_feats.begin(), beg, end;
 
+		// Dictionary hits may be given in a single sparse column (see parse_dic_hits())
+		bool					sparse = false;
+		for (V2_STR::const_iterator i_row = one_sent.begin(); i_row != one_sent.end(); ++i_row) 
+		{
+			if ((int) (*i_row).size() != COL_INFO.DIC + 1) {
+				sparse = false;
+				break;
+			}
+			if (is_dic_hit_column((*i_row)[ COL_INFO.DIC ])) {
+				sparse = true;
+			}
+		}
+		if (sparse) {
+			ext_sparse_DIC_feats(one_sent, sent_feats, opt_dic);
+			return;
+		}
+
 
 		for (V2_STR::const_iterator i_row = one_sent.begin(); i_row != one_sent.end(); ++i_row) 
 		{
@@ -664,47 +683,76 @@ namespace NER
 
 			// Uni/Bi-gram dictionary matching features for all dictionaries
 			for (int kth_COL_DIC = COL_INFO.DIC; kth_COL_DIC < end_COL_DIC; ++kth_COL_DIC) {
-				// Uni-gram features
 				for (int rel_pos = LHS_CS; rel_pos <= RHS_CS; ++rel_pos) {
-					feat_value1 = get_item(one_sent, i_row, kth_COL_DIC, rel_pos);
-					feat_word_value1 = get_item(one_sent, i_row, COL_INFO.WORD, rel_pos); 
+					dic_values[rel_pos - LHS_CS] = get_item(one_sent, i_row, kth_COL_DIC, rel_pos);
+				}
+				ext_DIC_column_feats(one_sent, i_row, kth_COL_DIC - COL_INFO.DIC, dic_values, *i_row_feats, opt_dic);
+			}
 
-					if ((feat_value1 != "O" ) && (feat_value1 != "NULL")) {
-						// Dictionary hit uni-gram feature
-						one_feat = "DIC" + int2str((int) kth_COL_DIC - COL_INFO.DIC) + "_U_" + int2strIDX(rel_pos) + "=" + feat_value1;
-						(*i_row_feats).push_back(one_feat);
 
-						// Lexicalized dictionary hit feature
-						if (opt_dic == 0) {
-							one_feat = "DIC" + int2str((int) kth_COL_DIC - COL_INFO.DIC) + "_LU_" + int2strIDX(rel_pos) + "="
-								+ feat_value1 + "_" + feat_word_value1;
-							(*i_row_feats).push_back(one_feat);
-						}
-					}
+			i_row_feats++;
+		}
+	}
+
+
+
+	//
+	// Private member functions 
+	//
+
+	void FeatureExtractor::ext_sparse_DIC_feats(const V2_STR &one_sent, V2_STR &sent_feats, int opt_dic)
+	{
+		string					one_feat= "";
+		string					dic_values[RHS_CS - LHS_CS + 1];
+		vector<int>				cols;
+		V2_STR::iterator		i_row_feats = sent_feats.begin();
+
+		// Parse the hits of each token once
+		const int				n_rows = (int) one_sent.size();
+		vector<DIC_HITS>		sent_hits(n_rows);
+		for (int i = 0; i < n_rows; ++i) {
+			parse_dic_hits(one_sent[i][ COL_INFO.DIC ], sent_hits[i]);
+		}
+
+		for (V2_STR::const_iterator i_row = one_sent.begin(); i_row != one_sent.end(); ++i_row) 
+		{
+			const int			i = (int) (i_row - one_sent.begin());
+
+			// The number of dictionaries that includes the current token
+			one_feat = "K_DICS=" + int2str((int) sent_hits[i].size());
+			(*i_row_feats).push_back(one_feat);
+
+			// Only the columns hit around the current token give features
+			cols.clear();
+			for (int j = i + LHS_CS; j <= i + RHS_CS; ++j) {
+				if (j < 0 || j >= n_rows)
+					continue;
+				for (DIC_HITS::const_iterator hit = sent_hits[j].begin(); hit != sent_hits[j].end(); ++hit) {
+					cols.push_back(hit->first);
 				}
+			}
+			sort(cols.begin(), cols.end());
+			cols.erase(unique(cols.begin(), cols.end()), cols.end());
 
-				// Bi-gram features
-				for (int rel_pos = LHS_CS + 1; rel_pos <= RHS_CS; ++rel_pos) {
-					feat_value1 = get_item(one_sent, i_row, kth_COL_DIC, rel_pos - 1);
-					feat_value2 = get_item(one_sent, i_row, kth_COL_DIC, rel_pos);
-					feat_word_value1 = get_item(one_sent, i_row, COL_INFO.WORD, rel_pos - 1);
-					feat_word_value2 = get_item(one_sent, i_row, COL_INFO.WORD, rel_pos);
-
-					if ( ((feat_value1 != "O") && (feat_value1 != "NULL")) || 
-						((feat_value2 != "O") && (feat_value2 != "NULL")) ) {					
-							// Dictionary hit bi-gram feature
-							one_feat = "DIC" + int2str((int) kth_COL_DIC - COL_INFO.DIC) + "_B_" + int2strIDX(rel_pos - 1) 
-								+ int2strIDX(rel_pos) + "=" + feat_value1 + "/" + feat_value2;
-							(*i_row_feats).push_back(one_feat);
-
-							// Lexicalized dictionary hit feautre
-							if (opt_dic == 0) {
-								one_feat = "DIC" + int2str((int) kth_COL_DIC - COL_INFO.DIC) + "_LB_" + int2strIDX(rel_pos - 1) + int2strIDX(rel_pos) 
-									+ "=" + feat_value1 + "_" + feat_word_value1 + "/" + feat_value2 + "_" + feat_word_value2;
-								(*i_row_feats).push_back(one_feat);
-							}
+			// Uni/Bi-gram dictionary matching features in the column order of the dense format
+			for (vector<int>::const_iterator col = cols.begin(); col != cols.end(); ++col) {
+				for (int rel_pos = LHS_CS; rel_pos <= RHS_CS; ++rel_pos) {
+					const int	j = i + rel_pos;
+					string&		value = dic_values[rel_pos - LHS_CS];
+
+					if (j < 0 || j >= n_rows) {
+						value = "NULL";
+						continue;
+					}
+					value = "O";
+					for (DIC_HITS::const_iterator hit = sent_hits[j].begin(); hit != sent_hits[j].end(); ++hit) {
+						if (hit->first == *col) {
+							value = hit->second;
+							break;
+						}
 					}
 				}
+				ext_DIC_column_feats(one_sent, i_row, *col, dic_values, *i_row_feats, opt_dic);
 			}
 
 
@@ -712,11 +760,59 @@ namespace NER
 		}
 	}
 
+	void FeatureExtractor::ext_DIC_column_feats(
+		const V2_STR		&one_sent, 
+		const V2_STR_citr	&i_row,						// Current token
+		const int			k,							// Dictionary column number (from 0)
+		const string		*dic_values,				// Values of the column from LHS_CS to RHS_CS
+		vector<string>		&row_feats,
+		int					opt_dic
+		)
+	{
+		string					one_feat= "", feat_value1 = "", feat_value2 = "", feat_word_value1 = "", feat_word_value2 = "";
+
+		// Uni-gram features
+		for (int rel_pos = LHS_CS; rel_pos <= RHS_CS; ++rel_pos) {
+			feat_value1 = dic_values[rel_pos - LHS_CS];
+			feat_word_value1 = get_item(one_sent, i_row, COL_INFO.WORD, rel_pos); 
 
+			if ((feat_value1 != "O" ) && (feat_value1 != "NULL")) {
+				// Dictionary hit uni-gram feature
+				one_feat = "DIC" + int2str(k) + "_U_" + int2strIDX(rel_pos) + "=" + feat_value1;
+				row_feats.push_back(one_feat);
 
-	//
-	// Private member functions 
-	//
+				// Lexicalized dictionary hit feature
+				if (opt_dic == 0) {
+					one_feat = "DIC" + int2str(k) + "_LU_" + int2strIDX(rel_pos) + "="
+						+ feat_value1 + "_" + feat_word_value1;
+					row_feats.push_back(one_feat);
+				}
+			}
+		}
+
+		// Bi-gram features
+		for (int rel_pos = LHS_CS + 1; rel_pos <= RHS_CS; ++rel_pos) {
+			feat_value1 = dic_values[rel_pos - 1 - LHS_CS];
+			feat_value2 = dic_values[rel_pos - LHS_CS];
+			feat_word_value1 = get_item(one_sent, i_row, COL_INFO.WORD, rel_pos - 1);
+			feat_word_value2 = get_item(one_sent, i_row, COL_INFO.WORD, rel_pos);
+
+			if ( ((feat_value1 != "O") && (feat_value1 != "NULL")) || 
+				((feat_value2 != "O") && (feat_value2 != "NULL")) ) {					
+					// Dictionary hit bi-gram feature
+					one_feat = "DIC" + int2str(k) + "_B_" + int2strIDX(rel_pos - 1) 
+						+ int2strIDX(rel_pos) + "=" + feat_value1 + "/" + feat_value2;
+					row_feats.push_back(one_feat);
+
+					// Lexicalized dictionary hit feautre
+					if (opt_dic == 0) {
+						one_feat = "DIC" + int2str(k) + "_LB_" + int2strIDX(rel_pos - 1) + int2strIDX(rel_pos) 
+							+ "=" + feat_value1 + "_" + feat_word_value1 + "/" + feat_value2 + "_" + feat_word_value2;
+						row_feats.push_back(one_feat);
+					}
+			}
+		}
+	}
 
 	void FeatureExtractor::get_n_grams(const string &token, const int n, vector<string> &ngrams)
 	{
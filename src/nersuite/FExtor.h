@@ -98,10 +98,16 @@ namespace NER
 		* @param[in] one_sent input sentence (List of token) in the POS tagged format
 		* @param[in,out] sent_feats Resulting feature list for each input token
 		* @param[in] opt_dic If 0, enables Lexicalized dictionary hit feature
+		*
+		* The dictionary-class columns may be one per class (dense), or a single
+		* column listing the hits of each token (sparse, see parse_dic_hits());
+		* both give the same features.
 		*/
 		void ext_DIC_feats(const V2_STR &one_sent, V2_STR &sent_feats, int opt_dic);
 
 	private:
+		void ext_sparse_DIC_feats(const V2_STR &one_sent, V2_STR &sent_feats, int opt_dic);
+		void ext_DIC_column_feats(const V2_STR &one_sent, const V2_STR_citr &i_row, const int k, const std::string *dic_values, std::vector<std::string> &row_feats, int opt_dic);
 		void get_n_grams(const std::string &token, const int n, std::vector<std::string> &ngrams);
 		std::string get_item(const V2_STR &one_sent, const V2_STR_citr &i_row, const int col, const int rel_pos);
 		void find_chunk_range(const V2_STR &one_sent, const V2_STR_citr &i_row, std::pair<V2_STR_citr, V2_STR_citr> &chk_range);
@@ -1,5 +1,17 @@
+#ifdef    HAVE_CONFIG_H
+#include <config.h>
+#endif/*HAVE_CONFIG_H*/
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
 #include "crfsuite2.h"
 #include "crfsuite.hpp"
+#include "../nersuite_common/thread_utils.h"
 
 using namespace CRFSuite;
 
@@ -43,3 +55,104 @@ void Trainer2::message(const std::string& msg)
 {
 	std::cerr << msg;
 }
+
+
+SharedModel::REGISTRY	SharedModel::registry;
+
+// Guards the registry and the reference counts
+static NER::Mutex	registry_mtx;
+
+SharedModel::SharedModel(const std::string& name_, const void* image_, size_t image_size_)
+	: name(name_), image(image_), image_size(image_size_), refs(1)
+{
+}
+
+SharedModel* SharedModel::acquire(const std::string& name)
+{
+	NER::ScopedLock	lock(registry_mtx);
+
+	REGISTRY::iterator	i = registry.find(name);
+	if (i != registry.end()) {
+		++i->second->refs;
+		return i->second;
+	}
+
+#ifdef _WIN32
+	return NULL;
+#else
+	int		fd = ::open(name.c_str(), O_RDONLY);
+	if (fd < 0)
+		return NULL;
+	struct stat	st;
+	if (fstat(fd, &st) != 0 || st.st_size == 0) {
+		::close(fd);
+		return NULL;
+	}
+	void	*p = mmap(NULL, (size_t) st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+	::close(fd);
+	if (p == MAP_FAILED)
+		return NULL;
+
+	SharedModel	*model = new SharedModel(name, p, (size_t) st.st_size);
+	registry[name] = model;
+	return model;
+#endif
+}
+
+void SharedModel::release(SharedModel* model)
+{
+	NER::ScopedLock	lock(registry_mtx);
+
+	if (--model->refs > 0)
+		return;
+	registry.erase(model->name);
+#ifndef _WIN32
+	munmap(const_cast<void*>(model->image), model->image_size);
+#endif
+	delete model;
+}
+
+
+Tagger2::Tagger2()
+	: shared(NULL)
+{
+}
+
+Tagger2::~Tagger2()
+{
+	this->close();
+}
+
+bool Tagger2::open(const std::string& name)
+{
+	this->close();
+
+#ifdef HAVE_CRFSUITE_CREATE_INSTANCE_FROM_MEMORY
+	shared = SharedModel::acquire(name);
+	if (shared == NULL)
+		return false;
+
+	// The model refers to the mapping instead of copying it
+	if (crfsuite_create_instance_from_memory(shared->data(), shared->size(), (void**)&model)) {
+		this->close();
+		return false;
+	}
+	if (model->get_tagger(model, &tagger)) {
+		this->close();
+		throw std::runtime_error("Failed to obtain the tagger interface");
+	}
+	return true;
+#else
+	return Tagger::open(name);
+#endif
+}
+
+void Tagger2::close()
+{
+	// The model has to be released before the mapping it reads
+	Tagger::close();
+	if (shared != NULL) {
+		SharedModel::release(shared);
+		shared = NULL;
+	}
+}
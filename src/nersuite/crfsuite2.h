@@ -1,6 +1,10 @@
 #ifndef __CRFSUITE2_H
 #define __CRFSUITE2_H
 
+#include <cstddef>
+#include <map>
+#include <string>
+
 #include "crfsuite.h"
 #include "crfsuite_api.hpp"
 
@@ -21,5 +25,59 @@ namespace CRFSuite
 		virtual void message(const std::string& msg);
 	};
 
+	/**
+	* A model file mapped read-only into memory. Every tagger of the process
+	* that opens the same file shares one mapping, and the pages of the
+	* mapping are shared with the other processes reading the file.
+	*/
+	class SharedModel
+	{
+	public:
+		/** Map a model file, or take another reference to its mapping.
+		* @returns NULL if the file cannot be mapped
+		*/
+		static SharedModel*	acquire(const std::string& name);
+
+		/** Drop a reference; the file is unmapped with the last one. */
+		static void	release(SharedModel* model);
+
+		const void*	data() const { return image; }
+		size_t		size() const { return image_size; }
+
+	private:
+		SharedModel(const std::string& name, const void* image, size_t image_size);
+
+		std::string	name;
+		const void*	image;
+		size_t		image_size;
+		int			refs;
+
+		typedef std::map<std::string, SharedModel*>	REGISTRY;
+		static REGISTRY		registry;
+	};
+
+	/**
+	* A tagger reading its model in place from a SharedModel, so that the
+	* taggers of several threads hold a single copy of the model. Each
+	* Tagger2 keeps its own tagging context: a tagger is used by one thread
+	* at a time.
+	*
+	* Without crfsuite_create_instance_from_memory() (CRFsuite 0.12.2 or
+	* later), the model is read into each tagger, as by Tagger::open().
+	*/
+	class Tagger2 : public Tagger
+	{
+	public:
+		Tagger2();
+		virtual ~Tagger2();
+
+		bool	open(const std::string& name);
+
+		void	close();
+
+	private:
+		SharedModel	*shared;
+	};
+
 }
 #endif
@@ -42,6 +42,10 @@ void print_usage(char exe_name[]);
 
 int main(int argc, char* argv[])
 {
+	// Sentences are read from cin alone: unsynchronized, it tells SentenceReader
+	// how much input is waiting, which is then taken in one read
+	std::ios::sync_with_stdio(false);
+
 	if (argc < 4) {
 		print_usage(argv[0]);
 		return 1;
@@ -59,8 +63,10 @@ int main(int argc, char* argv[])
 		nersuite.learn();
 	} else if (mode == MODE_TAG) {            // Tag each sentence
 		nersuite.tag();
+	} else if (mode == MODE_CONVERT) {        // Change the data format
+		return nersuite.convert();
 	} else {
-		cerr << " The first argument must be either \"" << MODE_LEARN << "\" or \"" << MODE_TAG << "\"" << endl;
+		cerr << " The first argument must be \"" << MODE_LEARN << "\", \"" << MODE_TAG << "\" or \"" << MODE_CONVERT << "\"" << endl;
 		return -1;
 	}
 
@@ -69,9 +75,10 @@ int main(int argc, char* argv[])
 
 void print_usage(char exe_name[])
 {
-	cerr << "Usage: " << exe_name << " <mode> <-m model_filename> [-C C2_value] [-o output_format] [-multidoc SEP] [file(s)]" << endl;
+	cerr << "Usage: " << exe_name << " <mode> <-m model_filename> [-C C2_value] [-o output_format] [-multidoc SEP] [-threads N] [-line-buffered] [-if FORMAT] [-of FORMAT] [file(s)]" << endl;
 	cerr << "  1. mode " << endl;
 	cerr << "    - 'learn' or 'tag' " << endl;
+	cerr << "    - 'convert' copies the input to the output, changing only its format (see 8.)" << endl;
 	cerr << endl;
 	cerr << "  2. model_filename " << endl;
 	cerr << "    - A model file name for storing a trained model in 'train' mode, or for loading a model in 'tag' mode" << endl;
@@ -88,7 +95,23 @@ void print_usage(char exe_name[])
 	cerr << "     - if -multidoc SEP option is given, looks for lines beginning with the "   << endl;
 	cerr << "       separator SEP in the input and echoes the same on output." << endl; 
 	cerr << endl;
-	cerr << "  6. input_file " << endl;
+	cerr << "  6. parallel tagging (for tag mode) " << endl;
+	cerr << "     - if -threads N option is given, sentences are tagged on N threads, which " << endl;
+	cerr << "       share one read-only mapping of the model file (also shared with the " << endl;
+	cerr << "       other processes tagging with the same model)." << endl;
+	cerr << endl;
+	cerr << "  7. output buffering (for tag mode) " << endl;
+	cerr << "     - the output is written in large blocks, and flushed at the end of each " << endl;
+	cerr << "       document. -line-buffered flushes it at the end of every line instead." << endl;
+	cerr << endl;
+	cerr << "  8. data formats " << endl;
+	cerr << "     - -if FORMAT and -of FORMAT set the format of the input and of the output: " << endl;
+	cerr << "       'tsv' (default) or 'binary', the NERsuite binary format for passing sentences " << endl;
+	cerr << "       between the NERsuite tools without formatting and parsing them as text." << endl;
+	cerr << "       -of binary is for the conll output format. The conversion between the " << endl;
+	cerr << "       formats is lossless (give -multidoc SEP to keep comment blocks as such)." << endl;
+	cerr << endl;
+	cerr << "  9. input_file " << endl;
 	cerr << "    - Input file(s) can be delivered in three ways." << endl;
 	cerr << "      1. re-directed standard input." << endl;
 	cerr << "      2. an input file name with -f option. (e.g. -f input.txt)" << endl;
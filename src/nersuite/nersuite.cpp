@@ -40,16 +40,42 @@ namespace NER
 {
 	Suite::Suite(int nargs, char** args)
 	{
+		opt_parser.add_flag("-line-buffered");
 		opt_parser.parse(nargs, args);
 	}
 
+	bool Suite::setup_data_formats(DataFormat &in_format, DataFormat &out_format)
+	{
+		string opt_value;
+
+		in_format = out_format = FORMAT_TSV;
+		if (opt_parser.get_value("-if", opt_value) && !parse_data_format(opt_value, in_format)) {
+			cerr << "-if option requires tsv or binary." << endl;
+			return false;
+		}
+		if (opt_parser.get_value("-of", opt_value) && !parse_data_format(opt_value, out_format)) {
+			cerr << "-of option requires tsv or binary." << endl;
+			return false;
+		}
+
+		if (in_format == FORMAT_BINARY)
+			set_binary_stdio(stdin);
+		if (out_format == FORMAT_BINARY)
+			set_binary_stdio(stdout);
+		return true;
+	}
+
 	int Suite::learn()
 	{
 		string opt_value;
+		DataFormat in_format, out_format;
+
+		if (!setup_data_formats(in_format, out_format))
+			return 1;
 
 		if (opt_parser.get_value("-f", opt_value)) {
 			int retval;
-			ifstream ifs(opt_value.c_str());
+			ifstream ifs(opt_value.c_str(), (in_format == FORMAT_BINARY) ? ios::in | ios::binary : ios::in);
 			if (! ifs) {
 				cerr << "Cannot open an input file! " << opt_value << endl;
 				return -2;
@@ -138,32 +164,59 @@ namespace NER
 
 	int Suite::tag()
 	{
-		// 1. Create a tagger with a given model
+		// 1. Create the taggers of a given model
+		//    Every tagging thread has its own tagger, but all of them read
+		//    the same mapping of the model file (see CRFSuite::Tagger2).
 		string             m_name = DEFAULT_MODEL_FILE;
-		CRFSuite::Tagger   tagger;
+		string             opt_value;
+		int                n_threads = 1;
+		DataFormat         in_format, out_format;
 
-		opt_parser.get_value("-m", m_name);
-		if (!tagger.open(m_name.c_str())) {
-			cerr << "Cannot create a model instance from " << m_name << endl;
+		if (!setup_data_formats(in_format, out_format))
 			return 1;
+		if (out_format == FORMAT_BINARY && opt_parser.get_value("-o", opt_value) && opt_value != "conll") {
+			cerr << "-of binary requires the conll output format." << endl;
+			return 1;
+		}
+
+		opt_parser.get_value("-m", m_name);
+		if (opt_parser.get_value("-threads", opt_value)) {
+			n_threads = atoi(opt_value.c_str());
+			if (n_threads < 1) {
+				cerr << "-threads option requires a positive number." << endl;
+				return 1;
+			}
 		}
 
-		// 2. Set the label bias parameter
 		string            lbias = "";
 		opt_parser.get_value("-b", lbias);
-		tagger.set_bias(lbias);
+
+		vector<CRFSuite::Tagger2*>  taggers;
+		for (int i = 0; i < n_threads; ++i) {
+			taggers.push_back(new CRFSuite::Tagger2);
+			if (!taggers.back()->open(m_name.c_str())) {
+				cerr << "Cannot create a model instance from " << m_name << endl;
+				for (size_t k = 0; k < taggers.size(); ++k)
+					delete taggers[k];
+				return 1;
+			}
+
+			// 2. Set the label bias parameter
+			taggers.back()->set_bias(lbias);
+		}
 
 		// 3. Tag input
-		string             opt_value;
 		FeatureExtractor   FExtor(COL_INFO);
 
+		ios::openmode      in_mode = (in_format == FORMAT_BINARY) ? ios::in | ios::binary : ios::in;
+		ios::openmode      out_mode = (out_format == FORMAT_BINARY) ? ios::out | ios::binary : ios::out;
 		if (opt_parser.get_value("-f", opt_value)) {
-			ifstream ifs(opt_value.c_str());
+			ifstream ifs(opt_value.c_str(), in_mode);
 			if (! ifs) {
 				cerr << "Cannot open an input file! " << opt_value << endl;
 				return -2;
 			}else {
-				run_tagging(ifs, cout, tagger, FExtor);
+				run_tagging(ifs, cout, taggers, FExtor);
 			}
 			ifs.close();
 		}else if (opt_parser.get_value("-l", opt_value)) {
@@ -181,14 +234,14 @@ namespace NER
 			while(getline(ifs_lst, fn)) {
 				string target = path + fn, result = path + fn + ".ner";
 
-				ifstream ifs_trg(target.c_str());
+				ifstream ifs_trg(target.c_str(), in_mode);
 				if (! ifs_trg) {
 					cerr << "Cannot open a target file! " << target << endl;
 					return -4;
 				}
-				ofstream ofs_res(result.c_str());
+				ofstream ofs_res(result.c_str(), out_mode);
 
-				run_tagging(ifs_trg, ofs_res, tagger, FExtor);
+				run_tagging(ifs_trg, ofs_res, taggers, FExtor);
 
 				ifs_trg.close();
 				ofs_res.close();
@@ -196,100 +249,212 @@ namespace NER
 
 			ifs_lst.close();
 		}else {
-			run_tagging(cin, cout, tagger, FExtor);
+			run_tagging(cin, cout, taggers, FExtor);
+		}
+
+		for (size_t k = 0; k < taggers.size(); ++k)
+			delete taggers[k];
+		return 0;
+	}
+
+	int Suite::convert()
+	{
+		string      opt_value;
+		DataFormat  in_format, out_format;
+
+		if (!setup_data_formats(in_format, out_format))
+			return 1;
+
+		if (opt_parser.get_value("-f", opt_value)) {
+			ifstream ifs(opt_value.c_str(), (in_format == FORMAT_BINARY) ? ios::in | ios::binary : ios::in);
+			if (! ifs) {
+				cerr << "Cannot open an input file! " << opt_value << endl;
+				return -2;
+			}
+			return run_conversion(ifs, cout, in_format, out_format);
 		}
+		return run_conversion(cin, cout, in_format, out_format);
+	}
+
+	// Copy the sentences (and comment blocks) of the input to the output,
+	// changing only their format
+	int Suite::run_conversion(istream &is, ostream &os, DataFormat in_format, DataFormat out_format)
+	{
+		string  multidoc_separator = "";
+		bool    multidoc_mode = opt_parser.get_value("-multidoc", multidoc_separator);
+
+		string          opt_value;
+		OutputWriter    out(os, opt_parser.get_value("-line-buffered", opt_value), out_format);
+		SentenceReader  reader(is, in_format);
+
+		V2_STR  one_sent;
+		bool    separator_read;
+		while (! reader.at_end()) {
+			get_sent(reader, one_sent, multidoc_separator, separator_read);
+			if (multidoc_mode && separator_read)
+				out.write_comment(one_sent);
+			else
+				out.write_sent(one_sent);
+		}
+
 		return 0;
 	}
 
 	/**
 	* CRF tagging functions
 	**/
+
+	// Number of sentences read per thread before a batch is tagged
+	static const int SENTS_PER_THREAD = 64;
+
+	/**
+	* A batch of sentences shared by the tagging threads
+	*/
+	struct TaggingBatch
+	{
+		std::vector<V2_STR>          sents;          // sentences (or comment blocks) in input order
+		std::vector<bool>            is_comment;     // comment blocks are passed through untouched
+		std::vector<CRFSuite::StringList>  yseqs;    // tagging results
+		size_t                       n_sents;        // number of valid entries in this batch
+		size_t                       next;           // next entry to be tagged
+		size_t                       next_tagger;    // next tagger to be taken by a thread
+		Mutex                        mtx;            // guards next and next_tagger
+
+		Suite                        *suite;
+		std::vector<CRFSuite::Tagger2*>  *taggers;
+		FeatureExtractor             *FExtor;
+	};
+
+	void Suite::tag_batch(void *arg)
+	{
+		TaggingBatch          *batch = static_cast<TaggingBatch*>(arg);
+		CRFSuite::Tagger2     *tagger;
+		{
+			ScopedLock   lock(batch->mtx);
+			tagger = (*batch->taggers)[batch->next_tagger++];
+		}
+
+		V2_STR            sent_feats;
+		while (true) {
+			size_t  idx;
+			{
+				ScopedLock   lock(batch->mtx);
+				idx = batch->next++;
+			}
+			if (idx >= batch->n_sents)
+				break;
+			if (batch->is_comment[idx])
+				continue;
+
+			// Extract features
+			V2_STR            &one_sent = batch->sents[idx];
+			FeatureExtractor  &FExtor = *batch->FExtor;
+			sent_feats.clear();
+
+			batch->suite->pad_answer(string("tag"), one_sent, sent_feats);      // CRFsuite needs that first columns are answer or dummy tags (in both training and test)
+
+			FExtor.ext_WORD_feats(one_sent, sent_feats);
+			FExtor.ext_LEMMA_feats(one_sent, sent_feats);
+			FExtor.ext_ORTHO_feats(one_sent, sent_feats);
+			FExtor.ext_POS_feats(one_sent, sent_feats);
+			FExtor.ext_LEMMA_POS_feats(one_sent, sent_feats);
+			FExtor.ext_CHUNK_feats(one_sent, sent_feats);
+
+			// Extract dictionary features
+			FExtor.ext_DIC_feats(one_sent, sent_feats, 0);      
+
+			// Tag named entities
+			tag_crfsuite(sent_feats, *tagger, batch->yseqs[idx]);
+		}
+	}
+
 	int Suite::run_tagging(
 		istream             &is, 
 		ostream             &os,
-		CRFSuite::Tagger&   tagger,
+		vector<CRFSuite::Tagger2*>  &taggers,
 		FeatureExtractor    &FExtor
 		)
 	{
 		map<string, int>  term_idx;
-		V2_STR            one_sent;
-		V2_STR            sent_feats;
 
 		set_column_info(MODE_TAG);
 
-		// 1. Option handling: -multidoc mode
+		// 1. Option handling: -multidoc mode and output format
 		string multidoc_separator = "";
 		bool multidoc_mode = opt_parser.get_value("-multidoc", multidoc_separator); 
-		bool separator_read;
 
-		// 2. Tag input
-		while (! is.eof() ) {
-		  // 2.0 early exit on EOF (get_sent can't differentiate between no input and empty line)
-			if ( is.peek() == EOF ) {
-				break;
-			}
+		string    out_format = "conll";
+		opt_parser.get_value("-o", out_format);
 
-	    // 2.1. Read a sentence (or comments)
-			get_sent(is, one_sent, multidoc_separator, separator_read);
+		string    opt_value;
+		DataFormat  in_data_format, out_data_format;
+		setup_data_formats(in_data_format, out_data_format);
+		OutputWriter  out(os, opt_parser.get_value("-line-buffered", opt_value), out_data_format);
 
-			// 2.2. Pass the input to output, if the multidoc mode is on and the read sentence is lines of comments
-	    if( multidoc_mode && separator_read ) {
-				for( V2_STR::iterator irow = one_sent.begin(); irow != one_sent.end(); ++irow ) {
-					os << irow->front() << endl;
+		// 2. Tag input
+		//    With several taggers, sentences are read in batches and tagged
+		//    concurrently, but the output keeps the input order.
+		int           n_threads = (int) taggers.size();
+		size_t        batch_size = (n_threads > 1) ? n_threads * SENTS_PER_THREAD : 1;
+
+		TaggingBatch  batch;
+		batch.sents.resize(batch_size);
+		batch.is_comment.resize(batch_size);
+		batch.yseqs.resize(batch_size);
+		batch.suite = this;
+		batch.taggers = &taggers;
+		batch.FExtor = &FExtor;
+
+		SentenceReader  reader(is, in_data_format);
+		while (! reader.eof() ) {
+			// 2.1. Read a batch of sentences (or comments)
+			batch.n_sents = 0;
+			while ((batch.n_sents < batch_size) && (! reader.eof())) {
+				// early exit on EOF (get_sent can't differentiate between no input and empty line)
+				if ( reader.at_end() ) {
+					break;
 				}
-				os << endl;
-				continue;
+				bool separator_read;
+				get_sent(reader, batch.sents[batch.n_sents], multidoc_separator, separator_read);
+				batch.is_comment[batch.n_sents] = multidoc_mode && separator_read;
+				batch.yseqs[batch.n_sents].clear();
+				++batch.n_sents;
 			}
-			
-			// 2.3. Extract features
-			sent_feats.clear();
-
-			pad_answer(string("tag"), one_sent, sent_feats);      // CRFsuite needs that first columns are answer or dummy tags (in both training and test)
-
-			FExtor.ext_WORD_feats(one_sent, sent_feats);
-			FExtor.ext_LEMMA_feats(one_sent, sent_feats);
-			FExtor.ext_ORTHO_feats(one_sent, sent_feats);
-			FExtor.ext_POS_feats(one_sent, sent_feats);
-			FExtor.ext_LEMMA_POS_feats(one_sent, sent_feats);
-			FExtor.ext_CHUNK_feats(one_sent, sent_feats);
-
-			// 2.4. Extract dictionary features
-			FExtor.ext_DIC_feats(one_sent, sent_feats, 0);      
+			if (batch.n_sents == 0)
+				break;
 
-			// 2.5 Tag named entities
-			tag_crfsuite(one_sent, sent_feats, tagger, term_idx, os);
+			// 2.2. Extract features and tag named entities
+			batch.next = 0;
+			batch.next_tagger = 0;
+			run_threads((int) min((size_t) n_threads, batch.n_sents), tag_batch, &batch);
+
+			// 2.3. Output the results in the input order
+			//      Lines of comments are passed to the output, if the multidoc mode is on
+			for (size_t i = 0; i < batch.n_sents; ++i) {
+				V2_STR  &one_sent = batch.sents[i];
+				if (batch.is_comment[i]) {
+					out.write_comment(one_sent);
+				}else if (batch.yseqs[i].size() != one_sent.size()) {
+					continue;       // not tagged (see tag_crfsuite())
+				}else if (out_format == "standoff") {
+					output_result_standoff(out, batch.yseqs[i], one_sent, term_idx);
+				}else if (out_format == "brat") {
+					output_result_standoff(out, batch.yseqs[i], one_sent, term_idx, true);
+				}else {
+					output_result_conll(out, batch.yseqs[i], one_sent);
+				}
+			}
 		}
 
 		return 0;
 	}
 
 	int Suite::tag_crfsuite(
-		V2_STR                     &one_sent, 
 		V2_STR                     &sent_feat, 
 		CRFSuite::Tagger&          tagger,
-		map<string, int>           &term_idx, 
-		ostream                    &os
+		CRFSuite::StringList       &yseq
 		)
 	{
-		int                   ret = 0;
-		int                   N = 0, L = 0, lid = -1;
-		clock_t               clk0, clk1;
-		CRFSuite::StringList  labels;
-
-		// Obtain the dictionary interface representing the labels in the model.
-		try
-		{
-			labels = tagger.labels();
-		}
-		catch (std::exception& ex)
-		{
-			std::cerr << ex.what();
-			return ret;
-		}
-
-		// Read the input data and assign labels.
-		clk0 = clock();
-
 		CRFSuite::ItemSequence xseq;
 		for(V2_STR::iterator i = sent_feat.begin(); i != sent_feat.end(); ++i) {
 			CRFSuite::Item item;
@@ -310,32 +475,14 @@ namespace NER
 		}
 
 		// Tag the instance.
-		CRFSuite::StringList yseq;
 		try {
 			yseq = tagger.tag(xseq);
 		}
-		catch (std::exception ex)
+		catch (std::exception& ex)
 		{
 			std::cerr << ex.what();
 			return 0;
 		}
-		clk1 = clock();
-
-		// Output tagging result
-		string    out_format = "conll";
-		opt_parser.get_value("-o", out_format);
-		if (out_format == "standoff")
-		{
-			output_result_standoff(os, yseq, one_sent, term_idx);
-		}
-		else if (out_format == "brat")
-		{
-			output_result_standoff(os, yseq, one_sent, term_idx, true);
-		}
-		else
-		{
-			output_result_conll(os, yseq, one_sent);
-		}
 		return 1;
 	}
 
@@ -343,7 +490,7 @@ namespace NER
 	* Internal output function
 	*/
 	void Suite::output_single_standoff(
-		ostream      &os,
+		OutputWriter &out,
 		const string &beg,
 		const string &end,
 		int cnt,
@@ -353,12 +500,14 @@ namespace NER
 		)
 	{
 		if (!brat_flavored) {
-			os << beg << "\t" << end << "\t" << "entity_name" << "\t" << "id=\"entity-" << cnt 
-			   << "\" " << "type=\"" << ne_class << "\"" << endl;
+			out << beg << '\t' << end << '\t' << "entity_name" << '\t' << "id=\"entity-" << cnt 
+			    << "\" " << "type=\"" << ne_class << '"';
+			out.end_line();
 		}else {
 			int begi = atoi(beg.c_str());
 			int endi = atoi(end.c_str());
-			os << "T" << cnt << "\t" << ne_class << " " << sentence_base_offset+begi << " " << sentence_base_offset+endi << "\t" << ne_text << endl;
+			out << 'T' << cnt << '\t' << ne_class << ' ' << sentence_base_offset+begi << ' ' << sentence_base_offset+endi << '\t' << ne_text;
+			out.end_line();
 		}
 	}
 
@@ -366,7 +515,7 @@ namespace NER
 	* Output functions
 	*/
 	void Suite::output_result_standoff(
-		ostream                  &os,
+		OutputWriter             &out,
 		CRFSuite::StringList&    yseq,
 		vector<vector<string> >  &one_sent, 
 		map<string, int>         &term_idx,
@@ -391,14 +540,14 @@ namespace NER
 
 			if (s_label == "O") {
 				if (ne_term != "") {
-					output_single_standoff(os, beg, end, cnt, ne_class, ne_term, brat_flavored);
+					output_single_standoff(out, beg, end, cnt, ne_class, ne_term, brat_flavored);
 					++cnt;
 
 					ne_term = "";
 				}
 			}else if (s_label.substr(0, 1) == "B") {
 				if (ne_term != "") {
-					output_single_standoff(os, beg, end, cnt, ne_class, ne_term, brat_flavored);
+					output_single_standoff(out, beg, end, cnt, ne_class, ne_term, brat_flavored);
 					++cnt;
 				}
 
@@ -430,7 +579,7 @@ namespace NER
 		}
 
 		if (ne_term != "") {      // If the last token is "B" or "I"
-			output_single_standoff(os, beg, end, cnt, ne_class, ne_term, brat_flavored);
+			output_single_standoff(out, beg, end, cnt, ne_class, ne_term, brat_flavored);
 			++cnt;
 
 			ne_term = "";
@@ -439,23 +588,36 @@ namespace NER
 
 
 	void Suite::output_result_conll(
-		ostream						&os,
+		OutputWriter				&out,
 		CRFSuite::StringList&			yseq,
 		vector< vector<string> >  &one_sent
 		) 
 	{
+		if (out.get_format() == FORMAT_BINARY) {
+			const int  cols[] = { COL_INFO.BEG, COL_INFO.END, COL_INFO.WORD, COL_INFO.LEMMA, COL_INFO.POS, COL_INFO.CHUNK };
+			V2_STR     rows(yseq.size(), V1_STR(7));
+			for (size_t i = 0; i < rows.size(); ++i) {
+				for (size_t j = 0; j < 6; ++j)
+					rows[i][j] = one_sent[i][cols[j]];
+				rows[i][6] = yseq[i];
+			}
+			out.write_sent(rows);
+			return;
+		}
+
 		int i = 0;
 		for (CRFSuite::StringList::const_iterator itr = yseq.begin(); itr != yseq.end(); ++itr)
 		{
 			const string label = *itr;
 
-			os << one_sent[i][COL_INFO.BEG] << "\t" << one_sent[i][COL_INFO.END] << "\t"
-				<< one_sent[i][COL_INFO.WORD] << "\t" << one_sent[i][COL_INFO.LEMMA] << "\t"
-				<< one_sent[i][COL_INFO.POS] << "\t" << one_sent[i][COL_INFO.CHUNK] << "\t"
-				<< label.c_str() << endl;
+			out << one_sent[i][COL_INFO.BEG] << '\t' << one_sent[i][COL_INFO.END] << '\t'
+				<< one_sent[i][COL_INFO.WORD] << '\t' << one_sent[i][COL_INFO.LEMMA] << '\t'
+				<< one_sent[i][COL_INFO.POS] << '\t' << one_sent[i][COL_INFO.CHUNK] << '\t'
+				<< label;
+			out.end_line();
 			i++;
 		}
-		os << endl;
+		out.end_line();
 	}
 
 
@@ -479,9 +641,13 @@ namespace NER
 		bool multidoc_mode = opt_parser.get_value("-multidoc", multidoc_separator); 
 		bool separator_read;
 
-		while( ! is.eof() ) {
+		DataFormat  in_format, out_format;
+		setup_data_formats(in_format, out_format);
+
+		SentenceReader  reader(is, in_format);
+		while( ! reader.eof() ) {
 	    // 1. Read a sentence (or comments)
-			get_sent(is, one_sent, multidoc_separator, separator_read);
+			get_sent(reader, one_sent, multidoc_separator, separator_read);
 
 			// 2. Ignore comment lines
 	    if( multidoc_mode && separator_read ) {
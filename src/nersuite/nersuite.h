@@ -43,6 +43,8 @@
 #include "../nersuite_common/string_utils.h"
 #include "../nersuite_common/text_loader.h"
 #include "../nersuite_common/option_parser.h"
+#include "../nersuite_common/thread_utils.h"
+#include "../nersuite_common/output_writer.h"
 // END: utils
 
 // BEGIN: feature extractor
@@ -63,6 +65,7 @@ typedef         std::vector< V2_STR >		V3_STR;
 
 #define MODE_LEARN	"learn"
 #define MODE_TAG	"tag"
+#define MODE_CONVERT	"convert"
 #define DEFAULT_MODEL_FILE	"model.m"
 
 
@@ -112,15 +115,24 @@ namespace NER
 		*/
 		int tag();
 
+		/** Convert sentences between the data formats (-if / -of)
+		* @returns 0 if success
+		*/
+		int convert();
+
 	private:
+		bool setup_data_formats(DataFormat &in_format, DataFormat &out_format);
+		int run_conversion(std::istream &is, std::ostream &os, DataFormat in_format, DataFormat out_format);
+
 		int learn_crfsuite(std::istream &is);
 		void read_data(std::istream &is, const COLUMN_INFO &COL_INFO, CRFSuite::Trainer* trainer);
 
-		int run_tagging(std::istream &is, std::ostream &os, CRFSuite::Tagger& tagger, FeatureExtractor &FExtor);
-		int tag_crfsuite(V2_STR &one_sent, V2_STR &sent_feat, CRFSuite::Tagger& tagger, std::map<std::string, int> &term_idx, std::ostream &os);
-		void output_result_standoff(std::ostream &os, CRFSuite::StringList& yseq, std::vector<std::vector<std::string> > &one_sent, std::map<std::string, int> &term_idx, bool brat_flavored=false);
-		void output_result_conll(std::ostream &os, CRFSuite::StringList& yseq, std::vector<std::vector<std::string> > &one_sent);
-		void output_single_standoff(std::ostream &os, const std::string &beg, const std::string &end, int cnt, const std::string &ne_class, const std::string &ne_text, bool brat_flavored);
+		int run_tagging(std::istream &is, std::ostream &os, std::vector<CRFSuite::Tagger2*> &taggers, FeatureExtractor &FExtor);
+		static void tag_batch(void *arg);
+		static int tag_crfsuite(V2_STR &sent_feat, CRFSuite::Tagger& tagger, CRFSuite::StringList &yseq);
+		void output_result_standoff(OutputWriter &out, CRFSuite::StringList& yseq, std::vector<std::vector<std::string> > &one_sent, std::map<std::string, int> &term_idx, bool brat_flavored=false);
+		void output_result_conll(OutputWriter &out, CRFSuite::StringList& yseq, std::vector<std::vector<std::string> > &one_sent);
+		void output_single_standoff(OutputWriter &out, const std::string &beg, const std::string &end, int cnt, const std::string &ne_class, const std::string &ne_text, bool brat_flavored);
 
 		void set_column_info(const std::string &mode);
 		int pad_answer(const std::string &mode, const V2_STR &one_sent, V2_STR &sent_feats);
@@ -0,0 +1,170 @@
+/*
+*      NERSuite
+*      Binary sentence format
+*
+* Copyright (c)
+* All rights reserved.
+*
+* Redistribution and use in source and binary forms, with or without
+* modification, are permitted provided that the following conditions are met:
+*     * Redistributions of source code must retain the above copyright
+*       notice, this list of conditions and the following disclaimer.
+*     * Redistributions in binary form must reproduce the above copyright
+*       notice, this list of conditions and the following disclaimer in the
+*       documentation and/or other materials provided with the distribution.
+*     * Neither the names of the authors nor the names of its contributors
+*       may be used to endorse or promote products derived from this
+*       software without specific prior written permission.
+*
+* THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+* "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+* LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+* A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER
+* OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+* EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+* PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+* PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+* LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+* NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+* SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef		_BINARY_FORMAT_H
+#define		_BINARY_FORMAT_H
+
+#include <cstddef>
+#include <cstdio>
+#include <string>
+
+#ifdef _WIN32
+#include <fcntl.h>
+#include <io.h>
+#endif
+
+// Binary sentence format (see DataFormat)
+#define		BINARY_MAGIC			"NERB"
+#define		BINARY_VERSION			1
+#define		BINARY_SENTENCE			'S'
+#define		BINARY_COMMENT			'C'
+#define		BINARY_COLUMN_INT		'I'
+#define		BINARY_COLUMN_STRING	'S'
+#define		BINARY_MAX_STRINGS		65536
+#define		BINARY_MAX_INT_DIGITS	9		// fits in 32 bits
+
+namespace NER
+{
+	/**
+	* @ingroup NERsuite
+	*/
+	/**
+	* Format of the sentences passed between the NERsuite tools (-if / -of).
+	*
+	* FORMAT_TSV is the text format: one token per line, tab-separated
+	* columns, and a blank line after each sentence.
+	*
+	* FORMAT_BINARY holds the same blocks as length-prefixed records, so a
+	* reader neither scans for tabs and newlines nor parses numbers:
+	*
+	*   stream   := "NERB" version(1) record*
+	*   record   := type(1) varint(payload length) payload
+	*   sentence := 'S' varint(rows) varint(columns) ragged(1) [varint(width) per row]
+	*               column*  (cells of the rows wide enough, in row order)
+	*   column   := 'I' varint(value)*        every cell a plain decimal integer
+	*             | 'S' string*
+	*   string   := varint(0) varint(length) bytes   new entry of the string table
+	*             | varint(index + 1)                 entry of the string table
+	*   comment  := 'C' varint(lines) (varint(length) bytes)*
+	*
+	* Integers are unsigned LEB128. The string table starts empty and is
+	* reset after every comment block (a document break in the multidoc mode)
+	* and before a sentence once it holds BINARY_MAX_STRINGS entries, so a
+	* token, tag or label recurring in a document is stored once.
+	*
+	* A cell is typed as an integer only if it prints back to the same text,
+	* so converting TSV to binary and back is lossless (for input whose blocks
+	* all end with a blank line, as the tools write them).
+	*/
+	enum DataFormat
+	{
+		FORMAT_TSV,
+		FORMAT_BINARY
+	};
+
+	/**
+	* Parse the value of a -if / -of option ("tsv" or "binary").
+	* @returns false if the value is neither
+	*/
+	inline bool parse_data_format(const std::string &name, DataFormat &format)
+	{
+		if (name == "tsv") {
+			format = FORMAT_TSV;
+		}else if (name == "binary") {
+			format = FORMAT_BINARY;
+		}else {
+			return false;
+		}
+		return true;
+	}
+
+	/**
+	* Switch the standard input or output to binary mode for FORMAT_BINARY
+	* (needed on Windows only).
+	*/
+	inline void set_binary_stdio(FILE *fp)
+	{
+#ifdef _WIN32
+		_setmode(_fileno(fp), _O_BINARY);
+#else
+		(void) fp;
+#endif
+	}
+
+	/**
+	* Append an unsigned integer in LEB128.
+	*/
+	inline void append_varint(std::string &buf, unsigned long value)
+	{
+		while (value >= 0x80) {
+			buf += (char) ((value & 0x7f) | 0x80);
+			value >>= 7;
+		}
+		buf += (char) value;
+	}
+
+	/**
+	* Decode an unsigned integer in LEB128.
+	* @returns false if the data ends before the integer does
+	*/
+	inline bool read_varint(const char *&p, const char *end, unsigned long &value)
+	{
+		value = 0;
+		for (int shift = 0; p < end && shift < (int) (8 * sizeof(unsigned long)); shift += 7) {
+			unsigned char	c = (unsigned char) *p++;
+			value |= (unsigned long) (c & 0x7f) << shift;
+			if ((c & 0x80) == 0)
+				return true;
+		}
+		return false;
+	}
+
+	/**
+	* Parse a cell that prints back to the same text as an integer:
+	* decimal digits without a leading zero, short enough for 32 bits.
+	*/
+	inline bool parse_plain_int(const std::string &cell, unsigned long &value)
+	{
+		size_t	len = cell.length();
+		if (len == 0 || len > BINARY_MAX_INT_DIGITS || (cell[0] == '0' && len > 1))
+			return false;
+
+		value = 0;
+		for (size_t i = 0; i < len; ++i) {
+			if (cell[i] < '0' || cell[i] > '9')
+				return false;
+			value = value * 10 + (cell[i] - '0');
+		}
+		return true;
+	}
+}
+
+#endif
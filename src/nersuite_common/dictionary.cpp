@@ -32,8 +32,11 @@
 #include <vector>
 #include <map>
 #include <fstream>
+#include <sstream>
 #include <exception>
 #include <algorithm>
+#include <ctype.h>
+#include <math.h>
 
 #include "../cdbpp-1.1/include/cdbpp.h"
 #include "dictionary.h"
@@ -47,12 +50,25 @@ bool build(char* txt_dbname, char* binary_dbname);
 
 namespace NER
 {
-	const char *Dictionary::VERSION_STRING = "NERsuite dictionary (v1.1)";
+	// Count of the locks guarding the lookup cache
+	static const size_t	CACHE_STRIPES = 64;
+
+	const char *Dictionary::VERSION_STRING = "NERsuite dictionary (v1.4)";
+	const char *Dictionary::VERSION_STRING_1_3 = "NERsuite dictionary (v1.3)";
+	const char *Dictionary::VERSION_STRING_1_2 = "NERsuite dictionary (v1.2)";
+	const char *Dictionary::VERSION_STRING_1_1 = "NERsuite dictionary (v1.1)";
 
 	Dictionary::Dictionary(const char* binary_dbname)
 		: db_path(binary_dbname)
 	{
 		db_normalization_type = NormalizationUnknown;
+		db_has_index = false;
+		db_has_ngram_size = false;
+		db_has_class_sets = false;
+		db_ngram_size = 0;
+		n_class_sets = 0;
+		cache_stripes = NULL;
+		n_cache_sets = 0;
 	}
 
 	Dictionary::~Dictionary()
@@ -62,16 +78,195 @@ namespace NER
 			db_reader.close();
 		}
 		db_ifs.close();
+
+		for (vector<Dictionary*>::iterator i = deltas.begin(); i != deltas.end(); ++i)
+		{
+			delete *i;
+		}
+		delete[] cache_stripes;
 	}
 
 
-	void Dictionary::build(const char* txt_dbname, int normalize_type)
+	void Dictionary::build(const char* txt_dbname, int normalize_type, int ngram_size)
 	{
 		ifstream ifs(txt_dbname);
 		if (ifs.fail()) {
 			throw nersuite_exception("ERROR: failed to open a text database file.");
 		}
 
+		// 1. Get a list of semantic class names
+		string		line = "";
+		V1_STR		tokens;
+		map<string, int>	map_name2idx;
+
+		pair< string, int >	map_elem;
+		pair< map<string, int>::iterator, bool > map_insert_ret;
+
+		while( !ifs.eof() ) {
+			getline( ifs, line );
+			if( line == "")
+				continue;
+
+			tokens.clear();
+			tokenize( tokens, line, "\t" );
+
+			// 1) Make a map of semantic class names with temporary indices
+			for( V1_STR::iterator itr = tokens.begin() + 1; itr != tokens.end(); ++itr ) {
+				// Set an element for the indexing map
+				map_elem.first = *itr;
+				map_elem.second = -1;
+
+				// Insert the element
+				map_insert_ret = map_name2idx.insert( map_elem );
+			}
+
+			// 2) Finalize indices for semantic class names
+			int		idx = 0;
+			for( map< string, int >::iterator itr = map_name2idx.begin(); itr != map_name2idx.end(); ++itr ) {
+				itr->second = (idx++);
+			}
+		}
+
+		// 2. Create key/value pairs on the memory
+		ifs.clear();				// Clear the eof flag
+		ifs.seekg( 0, ios::beg );	// Set the file pointer as the beginning
+
+		int			nth = 0;
+		map< string, int >::iterator	map_find_ret;
+		V1_STR		normalized_tokens;
+
+		map< string, vector<int> > dictionary;
+		vector<int>	classes;
+		classes.reserve(map_name2idx.size());
+
+		while (! ifs.eof()) {
+			getline( ifs, line );
+			if ( line == "" )
+				continue;
+
+			tokens.clear();
+			tokenize( tokens, line, "\t" );
+			normalize(tokens[0], normalize_type, normalized_tokens);
+			int		n_classes = tokens.size() - 1;
+
+			// Create mapping of Classes: class index (integer) --> class name (string)
+			classes.clear();
+			for (int i = 0; i < n_classes; ++i) {
+				string	sem_class = tokens[ i+1 ];
+				map_find_ret = map_name2idx.find( sem_class );
+				if( map_find_ret != map_name2idx.end() )
+				{
+					classes.push_back(map_find_ret->second);
+				}
+				else
+				{
+					throw nersuite_exception("ERROR: index not found for a given key \"" + tokens[ i+1 ] + "\"");
+				}
+			}
+			for (V1_STR::iterator it = normalized_tokens.begin(); it != normalized_tokens.end(); ++it)
+			{
+				string&	key = *it;
+				vector<int>& current_value = dictionary[key];
+				for (int i = 0; i < n_classes; ++i) {
+					if (find(current_value.begin(), current_value.end(), classes[i]) == current_value.end())
+					{
+						current_value.push_back(classes[i]);
+					}
+				}
+			}
+
+			++nth;
+			if ((nth % 10000) == 0 ) {
+				cerr << ".";
+			}
+		}
+		cerr << endl;
+		ifs.close();
+
+		// 3. Write the database
+		write_db(map_name2idx, dictionary, normalize_type, ngram_size);
+	}
+
+	namespace
+	{
+		// Tells whether the CDBPP chunk of a key --> ints map exceeds 4GB
+		// with 32-bit offsets
+		bool needs_offset64(const map< string, vector<int> >& records)
+		{
+			uint64_t	kvsize = 0;
+			for (map< string, vector<int> >::const_iterator i = records.begin(); i != records.end(); ++i)
+			{
+				kvsize += i->first.length() + sizeof(int) * i->second.size();
+			}
+			return cdbpp::builder::needs_offset64(records.size(), kvsize);
+		}
+
+	}
+
+	// Collects the records of a CDBPP database into a key --> classes map,
+	// translating the class indices with a table.  A key already in the map
+	// is left as it is.  Values are class lists, or ids of the class lists
+	// of a Dictionary if one is given.
+	struct Dictionary::EntryCollector
+	{
+		map< string, vector<int> >&	dictionary;
+		const vector<int>&			class_columns;
+		const Dictionary*			owner;
+
+		EntryCollector(map< string, vector<int> >& dict, const vector<int>& columns, const Dictionary* class_set_owner = NULL)
+			: dictionary(dict), class_columns(columns), owner(class_set_owner) {}
+
+		void operator()(const void* key, size_t ksize, const void* value, size_t vsize)
+		{
+			pair< map< string, vector<int> >::iterator, bool >	ret =
+				dictionary.insert(make_pair(string((const char*)key, ksize), vector<int>()));
+			if (!ret.second)
+			{
+				return;
+			}
+
+			size_t			count = vsize / sizeof(int);
+			const int*		classes = (owner != NULL) ? owner->resolve_db_value(value, vsize, &count) : (const int*)value;
+			vector<int>&	current_value = ret.first->second;
+			for (size_t i = 0; i < count; ++i)
+			{
+				current_value.push_back(class_columns[classes[i]]);
+			}
+		}
+	};
+
+	void Dictionary::merge(const char* base_dbname, const vector<string>& delta_dbnames)
+	{
+		Dictionary	base(base_dbname);
+		for (vector<string>::const_iterator i = delta_dbnames.begin(); i != delta_dbnames.end(); ++i)
+		{
+			base.add_delta(i->c_str());
+		}
+		base.open();
+
+		// 1. Number the classes in the name order, as when building from text
+		map<string, int>	map_name2idx;
+		for (map< int, string >::const_iterator i = base.map_idx2name.begin(); i != base.map_idx2name.end(); ++i)
+		{
+			map_name2idx[i->second] = base.class_columns[i->first];
+		}
+
+		// 2. Collect the merged classes of the delta keys, then the rest of the base
+		map< string, vector<int> >	dictionary;
+		EntryCollector	collector(dictionary, base.class_columns);
+		if (base.overlay_reader.is_open())
+		{
+			base.overlay_reader.for_each(collector);
+		}
+		EntryCollector	db_collector(dictionary, base.class_columns, &base);
+		base.db_reader.for_each(db_collector);
+
+		// 3. Write the database with the n-gram index of the base, if any
+		write_db(map_name2idx, dictionary, base.db_normalization_type, base.db_ngram_size);
+	}
+
+	void Dictionary::write_db(const map<string, int>& map_name2idx, const map< string, vector<int> >& dictionary, int normalize_type, int ngram_size)
+	{
 		std::ofstream ofs(db_path.c_str(), std::ios_base::binary);
 		if (ofs.fail()) {
 			throw nersuite_exception("ERROR: Failed to open a database file.");
@@ -86,44 +281,11 @@ namespace NER
 			db_normalization_type = normalize_type;
 			ofs.write( reinterpret_cast<char *>( &normalize_type ), sizeof(int) );
 
-			// 1. Get a list of semantic class names
-			string		line = "";
-			V1_STR		tokens;
-			map<string, int>	map_name2idx;
-
-			pair< string, int >	map_elem;
-			pair< map<string, int>::iterator, bool > map_insert_ret;
-
-			while( !ifs.eof() ) {
-				getline( ifs, line );
-				if( line == "")
-					continue;
-
-				tokens.clear();
-				tokenize( tokens, line, "\t" );
-
-				// 1) Make a map of semantic class names with temporary indices
-				for( V1_STR::iterator itr = tokens.begin() + 1; itr != tokens.end(); ++itr ) {
-					// Set an element for the indexing map
-					map_elem.first = *itr;
-					map_elem.second = -1;
-
-					// Insert the element
-					map_insert_ret = map_name2idx.insert( map_elem );
-				}
-
-				// 2) Finalize indices for semantic class names
-				int		idx = 0;
-				for( map< string, int >::iterator itr = map_name2idx.begin(); itr != map_name2idx.end(); ++itr ) {
-					itr->second = (idx++);
-				}
-			}
-
-			// 2.1. Write header information (# of semantic classes / name to index mapping)
+			// 1. Write header information (# of semantic classes / name to index mapping)
 			map< string, int >::size_type	max_idx = map_name2idx.size();
 			ofs.write( reinterpret_cast<char *>( &max_idx ), sizeof( map< string, int >::size_type ) );				// 1) Write # of classes
 
-			for( map< string, int >::iterator itr = map_name2idx.begin(); itr != map_name2idx.end(); ++itr ) {
+			for( map< string, int >::const_iterator itr = map_name2idx.begin(); itr != map_name2idx.end(); ++itr ) {
 				string				str_name = itr->first;
 				string::size_type	len_name = (itr->first).size();
 				int					str_idx = itr->second;
@@ -134,85 +296,49 @@ namespace NER
 				ofs.write( reinterpret_cast<char *>( &str_idx ), sizeof( int ) );							// 2.3) Write the index of the semantic class name
 			}
 
+			// 2. Write the table of distinct class lists.
+			map< vector<int>, int >	set_ids;
+			write_class_sets(ofs, dictionary, set_ids);
 
-			// Create key/value pairs on the memory
-			ifs.clear();				// Clear the eof flag
-			ifs.seekg( 0, ios::beg );	// Set the file pointer as the beginning
-
-			int			nth = 0;
-			map< string, int >::iterator	map_find_ret;
-			V1_STR		normalized_tokens;
-
-			map< string, vector<int> > dictionary;
-			vector<int>	classes;
-			classes.reserve(max_idx);
-
-			while (! ifs.eof()) {
-				getline( ifs, line );
-				if ( line == "" )
-					continue;
-
-				tokens.clear();
-				tokenize( tokens, line, "\t" );
-				normalize(tokens[0], normalize_type, normalized_tokens);
-				int		n_classes = tokens.size() - 1;
-
-				// Create mapping of Classes: class index (integer) --> class name (string)
-				classes.clear();
-				for (int i = 0; i < n_classes; ++i) {
-					string	sem_class = tokens[ i+1 ];
-					map_find_ret = map_name2idx.find( sem_class );
-					if( map_find_ret != map_name2idx.end() )
-					{
-						classes.push_back(map_find_ret->second);
-					}
-					else
-					{
-						throw nersuite_exception("ERROR: index not found for a given key \"" + tokens[ i+1 ] + "\"");
-					}
-				}
-				for (V1_STR::iterator it = normalized_tokens.begin(); it != normalized_tokens.end(); ++it)
+			// 3. Insert key/class list id pairs to the CDB++ writer (with 64-bit offsets beyond 4GB).
+			{
+				uint64_t	kvsize = 0;
+				for (map< string, vector<int> >::const_iterator i = dictionary.begin(); i != dictionary.end(); ++i)
 				{
-					string&	key = *it;
-					vector<int>& current_value = dictionary[key];
-					for (int i = 0; i < n_classes; ++i) {
-						if (find(current_value.begin(), current_value.end(), classes[i]) == current_value.end())
-						{
-							current_value.push_back(classes[i]);
-						}
-					}
+					kvsize += (*i).first.length() + sizeof(int);
 				}
-
-				++nth;
-				if ((nth % 10000) == 0 ) {
-					cerr << ".";
+				cdbpp::builder dbw(ofs, cdbpp::builder::needs_offset64(dictionary.size(), kvsize));
+				for (map< string, vector<int> >::const_iterator i = dictionary.begin(); i != dictionary.end(); ++i)
+				{
+					const string& key = (*i).first;
+					int		set_id = set_ids[(*i).second];
+					dbw.put(key.c_str(), key.length(), &set_id, sizeof(int));
 				}
 			}
-			cerr << endl;
 
-			// 2.2. Insert key/value pairs to the CDB++ writer.
-			cdbpp::builder dbw(ofs);
-			int*	classes_to_store = new int[max_idx];
-			for (map< string, vector<int> >::iterator i = dictionary.begin(); i != dictionary.end(); ++i)
+			// 4. Write the key length index (key head --> lengths of the keys) as a second CDB++ chunk.
+			write_key_length_index(ofs, dictionary);
+
+			// 5. Write the n-gram size and the n-gram index (n-gram --> key ids, key id --> key) if any.
+			db_ngram_size = (ngram_size > 0) ? ngram_size : 0;
+			ofs.write( reinterpret_cast<char *>( &db_ngram_size ), sizeof(int) );
+			if (db_ngram_size > 0)
 			{
-				const string& key = (*i).first;
-				vector<int>& value = (*i).second;
-				for (size_t j = 0; j < value.size(); ++j)
-				{
-					classes_to_store[j] = value[j];
-				}
-				dbw.put(key.c_str(), key.length(), classes_to_store, sizeof(int) * value.size());
+				write_ngram_index(ofs, dictionary, db_ngram_size);
 			}
-			delete [] classes_to_store;
 		}
 		catch (const cdbpp::builder_exception& e) {
 			// Abort if something went wrong...
 			throw nersuite_exception(string("ERROR: ") + e.what());
 		}
-		ifs.close();
 		ofs.close();
 	}
 
+	void Dictionary::add_delta(const char* delta_dbname)
+	{
+		delta_paths.push_back(delta_dbname);
+	}
+
 	void Dictionary::open()
 	{
 		db_ifs.open(db_path.c_str(), ios_base::binary );
@@ -223,12 +349,560 @@ namespace NER
 
 		load_header_info();
 		load_index_mapping();
+		update_class_columns();
+		if (db_has_class_sets)
+		{
+			load_class_sets();
+		}
 
 		db_reader.open(db_ifs);
 		if (!db_reader.is_open())
 		{
 			throw nersuite_exception("ERROR: failed to open CDBPP for input.");
 		}
+
+		if (db_has_index)
+		{
+			db_index_reader.open(db_ifs);
+			if (!db_index_reader.is_open())
+			{
+				throw nersuite_exception("ERROR: failed to open the key length index for input.");
+			}
+		}
+
+		if (db_has_ngram_size)
+		{
+			db_ifs.read( reinterpret_cast<char *>( &db_ngram_size ), sizeof(int) );
+			if (db_ifs.fail())
+			{
+				throw nersuite_exception("ERROR: failed to read the n-gram size.");
+			}
+			if (db_ngram_size > 0)
+			{
+				db_ngram_reader.open(db_ifs);
+				db_key_reader.open(db_ifs);
+				if (!db_ngram_reader.is_open() || !db_key_reader.is_open())
+				{
+					throw nersuite_exception("ERROR: failed to open the n-gram index for input.");
+				}
+			}
+		}
+
+		load_deltas();
+	}
+
+	void Dictionary::load_deltas()
+	{
+		if (delta_paths.empty())
+		{
+			return;
+		}
+
+		// 0. Open the deltas
+		for (vector<string>::const_iterator i = delta_paths.begin(); i != delta_paths.end(); ++i)
+		{
+			Dictionary	*delta = new Dictionary(i->c_str());
+			deltas.push_back(delta);
+			delta->open();
+
+			if (delta->get_normalization_type() != db_normalization_type)
+			{
+				throw nersuite_exception("ERROR: normalization type of the delta dictionary " + *i + " does not match the base.");
+			}
+
+			// Approximate matching needs an n-gram index of the same size in all layers
+			if (!delta->has_ngram_index() || delta->db_ngram_size != db_ngram_size)
+			{
+				db_ngram_reader.close();
+			}
+		}
+
+		// 1. Append the classes new to the base to the class table
+		map<string, int>	map_name2idx;
+		for (map< int, string >::const_iterator i = map_idx2name.begin(); i != map_idx2name.end(); ++i)
+		{
+			map_name2idx[i->second] = i->first;
+		}
+
+		vector< vector<int> >	class_maps(deltas.size());	// class index of a delta --> merged class index
+		for (size_t i_delta = 0; i_delta < deltas.size(); ++i_delta)
+		{
+			const Dictionary&	delta = *deltas[i_delta];
+			for (map< int, string >::const_iterator i = delta.map_idx2name.begin(); i != delta.map_idx2name.end(); ++i)
+			{
+				map<string, int>::iterator	found = map_name2idx.find(i->second);
+				int		idx;
+				if (found != map_name2idx.end())
+				{
+					idx = found->second;
+				}
+				else
+				{
+					idx = (int) map_idx2name.size();
+					map_idx2name[idx] = i->second;
+					map_name2idx[i->second] = idx;
+				}
+				if (class_maps[i_delta].size() <= (size_t) i->first)
+				{
+					class_maps[i_delta].resize(i->first + 1, -1);
+				}
+				class_maps[i_delta][i->first] = idx;
+			}
+		}
+		update_class_columns();
+
+		// 2. Merge the classes of each delta key: the classes in the base
+		// first, then the new ones of each delta in turn
+		map< string, vector<int> >	overlay;
+		for (size_t i_delta = 0; i_delta < deltas.size(); ++i_delta)
+		{
+			map< string, vector<int> >	delta_entries;
+			EntryCollector	collector(delta_entries, class_maps[i_delta], deltas[i_delta]);
+			deltas[i_delta]->db_reader.for_each(collector);
+
+			for (map< string, vector<int> >::const_iterator i = delta_entries.begin(); i != delta_entries.end(); ++i)
+			{
+				pair< map< string, vector<int> >::iterator, bool >	ret = overlay.insert(make_pair(i->first, vector<int>()));
+				vector<int>&	current_value = ret.first->second;
+				if (ret.second)
+				{
+					size_t		count;
+					const int*	classes = get_db_classes(i->first.data(), i->first.length(), &count);
+					current_value.assign(classes, classes + count);
+				}
+				for (vector<int>::const_iterator c = i->second.begin(); c != i->second.end(); ++c)
+				{
+					if (find(current_value.begin(), current_value.end(), *c) == current_value.end())
+					{
+						current_value.push_back(*c);
+					}
+				}
+			}
+		}
+
+		// 3. Merge the key lengths of the key heads of the delta keys
+		map< string, vector<int> >	overlay_index;
+		if (db_index_reader.is_open())
+		{
+			for (map< string, vector<int> >::const_iterator i = overlay.begin(); i != overlay.end(); ++i)
+			{
+				const string&	key = i->first;
+				size_t			head_len = key_head_length(key.c_str(), key.length());
+
+				pair< map< string, vector<int> >::iterator, bool >	ret = overlay_index.insert(make_pair(key.substr(0, head_len), vector<int>()));
+				vector<int>&	lengths = ret.first->second;
+				if (ret.second)
+				{
+					size_t		count;
+					const int*	base_lengths = (const int*)db_index_reader.get(key.data(), head_len, &count);
+					lengths.assign(base_lengths, base_lengths + count / sizeof(int));
+				}
+				lengths.push_back((int) key.length());
+			}
+			for (map< string, vector<int> >::iterator i = overlay_index.begin(); i != overlay_index.end(); ++i)
+			{
+				vector<int>&	lengths = i->second;
+				sort(lengths.begin(), lengths.end());
+				lengths.erase(unique(lengths.begin(), lengths.end()), lengths.end());
+			}
+		}
+
+		// 4. Keep both as CDB++ images in memory
+		open_in_memory(overlay_reader, overlay);
+		if (db_index_reader.is_open())
+		{
+			open_in_memory(overlay_index_reader, overlay_index);
+		}
+	}
+
+	void Dictionary::open_in_memory(cdbpp::cdbpp& reader, const map< string, vector<int> >& records)
+	{
+		ostringstream	oss(ios_base::binary);
+		{
+			cdbpp::builder dbw(oss, needs_offset64(records));
+			for (map< string, vector<int> >::const_iterator i = records.begin(); i != records.end(); ++i)
+			{
+				const vector<int>&	value = i->second;
+				const int*			ints = value.empty() ? NULL : &value[0];
+				dbw.put(i->first.c_str(), i->first.length(), ints, sizeof(int) * value.size());
+			}
+		}
+
+		const string&	image = oss.str();
+		uint8_t*		block = new uint8_t[image.length()];
+		memcpy(block, image.data(), image.length());
+		reader.open(block, image.length(), true);
+	}
+
+	void Dictionary::update_class_columns()
+	{
+		// Class names are ordered as std::map orders them when building
+		map<string, int>	map_name2idx;
+		for (map< int, string >::const_iterator i = map_idx2name.begin(); i != map_idx2name.end(); ++i)
+		{
+			map_name2idx[i->second] = i->first;
+		}
+
+		class_columns.assign(map_idx2name.size(), 0);
+		int		column = 0;
+		for (map<string, int>::const_iterator i = map_name2idx.begin(); i != map_name2idx.end(); ++i)
+		{
+			class_columns[i->second] = column++;
+		}
+	}
+
+	void Dictionary::write_class_sets(ofstream& ofs, const map< string, vector<int> >& dictionary, map< vector<int>, int >& set_ids)
+	{
+		// Number the distinct class lists in the order they first appear
+		vector<int>		offsets(1, 0);
+		vector<int>		classes;
+		for (map< string, vector<int> >::const_iterator i = dictionary.begin(); i != dictionary.end(); ++i)
+		{
+			const vector<int>&	value = (*i).second;
+			if (set_ids.insert(make_pair(value, (int) set_ids.size())).second)
+			{
+				classes.insert(classes.end(), value.begin(), value.end());
+				offsets.push_back((int) classes.size());
+			}
+		}
+
+		int		n_sets = (int) set_ids.size();
+		ofs.write( reinterpret_cast<char *>( &n_sets ), sizeof(int) );
+		ofs.write( reinterpret_cast<char *>( &offsets[0] ), sizeof(int) * offsets.size() );
+		if (!classes.empty())
+		{
+			ofs.write( reinterpret_cast<char *>( &classes[0] ), sizeof(int) * classes.size() );
+		}
+	}
+
+	void Dictionary::write_key_length_index(ofstream& ofs, const map< string, vector<int> >& dictionary)
+	{
+		map< string, vector<int> >	index;
+		for (map< string, vector<int> >::const_iterator i = dictionary.begin(); i != dictionary.end(); ++i)
+		{
+			const string&	key = (*i).first;
+			size_t			head_len = key_head_length(key.c_str(), key.length());
+
+			index[key.substr(0, head_len)].push_back((int) key.length());
+		}
+
+		cdbpp::builder dbw(ofs, needs_offset64(index));
+		for (map< string, vector<int> >::iterator i = index.begin(); i != index.end(); ++i)
+		{
+			vector<int>&	lengths = (*i).second;
+			sort(lengths.begin(), lengths.end());
+			lengths.erase(unique(lengths.begin(), lengths.end()), lengths.end());
+
+			dbw.put((*i).first.c_str(), (*i).first.length(), &lengths[0], sizeof(int) * lengths.size());
+		}
+	}
+
+	void Dictionary::write_ngram_index(ofstream& ofs, const map< string, vector<int> >& dictionary, int ngram_size)
+	{
+		// Keys are numbered in the dictionary order; the postings of each
+		// (feature size, n-gram) pair are then sorted by construction
+		map< string, vector<int> >	postings;
+		V1_STR		features;
+		string		posting_key;
+		int			key_id = 0;
+		for (map< string, vector<int> >::const_iterator i = dictionary.begin(); i != dictionary.end(); ++i, ++key_id)
+		{
+			const string&	key = (*i).first;
+			make_ngram_features(key.c_str(), key.length(), ngram_size, features);
+
+			// The feature size alone lists all keys of the size
+			int		feature_size = (int) features.size();
+			posting_key.assign(reinterpret_cast<const char *>( &feature_size ), sizeof(int));
+			postings[posting_key].push_back(key_id);
+
+			for (V1_STR::const_iterator f = features.begin(); f != features.end(); ++f)
+			{
+				posting_key.assign(reinterpret_cast<const char *>( &feature_size ), sizeof(int));
+				posting_key += *f;
+				postings[posting_key].push_back(key_id);
+			}
+		}
+
+		{
+			cdbpp::builder dbw(ofs, needs_offset64(postings));
+			for (map< string, vector<int> >::iterator i = postings.begin(); i != postings.end(); ++i)
+			{
+				vector<int>&	ids = (*i).second;
+				dbw.put((*i).first.c_str(), (*i).first.length(), &ids[0], sizeof(int) * ids.size());
+			}
+		}
+
+		uint64_t	kvsize = 0;
+		for (map< string, vector<int> >::const_iterator i = dictionary.begin(); i != dictionary.end(); ++i)
+		{
+			kvsize += sizeof(int) + (*i).first.length();
+		}
+		cdbpp::builder dbw(ofs, cdbpp::builder::needs_offset64(dictionary.size(), kvsize));
+		key_id = 0;
+		for (map< string, vector<int> >::const_iterator i = dictionary.begin(); i != dictionary.end(); ++i, ++key_id)
+		{
+			dbw.put(&key_id, sizeof(int), (*i).first.c_str(), (*i).first.length());
+		}
+	}
+
+	void Dictionary::make_ngram_features(const char* key, size_t key_len, int ngram_size, V1_STR& features)
+	{
+		// Pad the key with n-1 marks at both ends, so that a key of L bytes
+		// has L+n-1 n-grams.  A repeated n-gram is told apart from the
+		// earlier ones by appending its occurrence count.
+		features.clear();
+
+		string	padded(ngram_size - 1, '\x01');
+		padded.append(key, key_len);
+		padded.append(ngram_size - 1, '\x01');
+
+		for (size_t i = 0; i + ngram_size <= padded.length(); ++i)
+		{
+			string	feature = padded.substr(i, ngram_size);
+
+			size_t	occurrence = 1;
+			for (size_t j = 0; j < i; ++j)
+			{
+				if (padded.compare(j, ngram_size, feature) == 0)
+				{
+					++occurrence;
+				}
+			}
+			if (occurrence > 1)
+			{
+				feature += (char) occurrence;
+			}
+			features.push_back(feature);
+		}
+	}
+
+	namespace
+	{
+		// The most similar first, then in the key order
+		struct SimilarKeyOrder
+		{
+			bool operator()(const SimilarKey& a, const SimilarKey& b) const
+			{
+				if (a.sim != b.sim)
+				{
+					return a.sim > b.sim;
+				}
+				int		cmp = memcmp(a.key, b.key, (a.key_len < b.key_len) ? a.key_len : b.key_len);
+				return (cmp != 0) ? (cmp < 0) : (a.key_len < b.key_len);
+			}
+		};
+
+		struct SameKey
+		{
+			bool operator()(const SimilarKey& a, const SimilarKey& b) const
+			{
+				return a.key_len == b.key_len && memcmp(a.key, b.key, a.key_len) == 0;
+			}
+		};
+	}
+
+	size_t Dictionary::get_similar_keys(const char* nkey, size_t nkey_len, int measure, double threshold, vector<SimilarKey>& results) const
+	{
+		if (!db_ngram_reader.is_open())
+		{
+			throw nersuite_exception("ERROR: the dictionary has no n-gram index.");
+		}
+		results.clear();
+		search_ngram_index(nkey, nkey_len, measure, threshold, results);
+		if (deltas.empty())
+		{
+			return results.size();
+		}
+
+		// Search each delta as well; a key may be found in several layers
+		for (vector<Dictionary*>::const_iterator i = deltas.begin(); i != deltas.end(); ++i)
+		{
+			(*i)->search_ngram_index(nkey, nkey_len, measure, threshold, results);
+		}
+		sort(results.begin(), results.end(), SimilarKeyOrder());
+		results.erase(unique(results.begin(), results.end(), SameKey()), results.end());
+		return results.size();
+	}
+
+	void Dictionary::search_ngram_index(const char* nkey, size_t nkey_len, int measure, double threshold, vector<SimilarKey>& results) const
+	{
+		if (nkey_len == 0 || threshold <= 0.0)
+		{
+			return;
+		}
+		if (threshold > 1.0)
+		{
+			threshold = 1.0;
+		}
+
+		V1_STR		features;
+		make_ngram_features(nkey, nkey_len, db_ngram_size, features);
+		const int	x_size = (int) features.size();
+		const double	eps = 1e-9;
+
+		// 1) Range of the feature sizes of keys which can reach the threshold
+		int		min_size, max_size;
+		if (measure == SimilarityJaccard)
+		{
+			min_size = (int) ceil(threshold * x_size - eps);
+			max_size = (int) floor(x_size / threshold + eps);
+		}
+		else
+		{
+			min_size = (int) ceil(threshold * threshold * x_size - eps);
+			max_size = (int) floor(x_size / (threshold * threshold) + eps);
+		}
+		if (min_size < db_ngram_size)
+		{
+			min_size = db_ngram_size;		// every key has at least one byte
+		}
+
+		vector< pair<size_t, const int*> >	postings(x_size);	// (length, ids) of each n-gram
+		vector<int>		candidates, counts;
+		vector< pair<double, int> >		found;		// (-similarity, key id)
+
+		// Index keys of the n-grams: the feature size (set for each size) followed by the n-gram
+		for (V1_STR::iterator f = features.begin(); f != features.end(); ++f)
+		{
+			f->insert(0, sizeof(int), '\0');
+		}
+
+		for (int y_size = min_size; y_size <= max_size; ++y_size)
+		{
+			// 2) Minimum count of n-grams shared with a key of this size
+			int		tau;
+			if (measure == SimilarityJaccard)
+			{
+				tau = (int) ceil(threshold * (x_size + y_size) / (1.0 + threshold) - eps);
+			}
+			else
+			{
+				tau = (int) ceil(threshold * sqrt((double) x_size * y_size) - eps);
+			}
+			if (tau < 1)
+			{
+				tau = 1;
+			}
+			if (tau > x_size || tau > y_size)
+			{
+				continue;
+			}
+
+			size_t	n_keys = 0;
+			db_ngram_reader.get(&y_size, sizeof(int), &n_keys);
+			if (n_keys == 0)
+			{
+				continue;		// no key of this size
+			}
+
+			// 3) Fetch the key ids of each n-gram.  A key sharing tau n-grams
+			// appears in any x_size-tau+1 of the lists, so the size is
+			// skipped if the first ones are all empty.
+			const int	n_merged = x_size - tau + 1;
+			bool		any_posting = false;
+			for (int i = 0; i < x_size && (i < n_merged || any_posting); ++i)
+			{
+				string&		posting_key = features[i];
+				posting_key.replace(0, sizeof(int), reinterpret_cast<const char *>( &y_size ), sizeof(int));
+
+				size_t		count = 0;
+				const int*	ids = (const int*)db_ngram_reader.get(posting_key.data(), posting_key.length(), &count);
+				postings[i].first = (ids != NULL) ? count / sizeof(int) : 0;
+				postings[i].second = ids;
+				any_posting = any_posting || (ids != NULL);
+			}
+			if (!any_posting)
+			{
+				continue;
+			}
+			sort(postings.begin(), postings.end());
+
+			// 4) Count the candidates in the x_size-tau+1 shortest lists
+			candidates.clear();
+			for (int i = 0; i < n_merged; ++i)
+			{
+				candidates.insert(candidates.end(), postings[i].second, postings[i].second + postings[i].first);
+			}
+			if (candidates.empty())
+			{
+				continue;
+			}
+			sort(candidates.begin(), candidates.end());
+
+			counts.clear();
+			size_t	n_candidates = 0;
+			for (size_t i = 0; i < candidates.size(); ++i)
+			{
+				if (n_candidates > 0 && candidates[n_candidates - 1] == candidates[i])
+				{
+					++counts[n_candidates - 1];
+				}
+				else
+				{
+					candidates[n_candidates++] = candidates[i];
+					counts.push_back(1);
+				}
+			}
+			candidates.resize(n_candidates);
+
+			// 5) Look the candidates up in the remaining lists, dropping
+			// those which can no longer reach tau
+			for (int i = n_merged; i < x_size; ++i)
+			{
+				const int*	begin = postings[i].second;
+				const int*	end = begin + postings[i].first;
+				size_t		n_kept = 0;
+				for (size_t j = 0; j < candidates.size(); ++j)
+				{
+					int		count = counts[j];
+					if (binary_search(begin, end, candidates[j]))
+					{
+						++count;
+					}
+					if (count + (x_size - i - 1) >= tau)
+					{
+						candidates[n_kept] = candidates[j];
+						counts[n_kept] = count;
+						++n_kept;
+					}
+				}
+				candidates.resize(n_kept);
+				counts.resize(n_kept);
+			}
+
+			// 6) Compute the similarity of each key
+			for (size_t j = 0; j < candidates.size(); ++j)
+			{
+				if (counts[j] < tau)
+				{
+					continue;
+				}
+				double	sim;
+				if (measure == SimilarityJaccard)
+				{
+					sim = (double) counts[j] / (x_size + y_size - counts[j]);
+				}
+				else
+				{
+					sim = counts[j] / sqrt((double) x_size * y_size);
+				}
+				if (sim + eps >= threshold)
+				{
+					found.push_back(make_pair(-sim, candidates[j]));
+				}
+			}
+		}
+
+		// 7) Append the keys, the most similar first
+		sort(found.begin(), found.end());
+		size_t	n_results = results.size();
+		results.resize(n_results + found.size());
+		for (size_t i = 0; i < found.size(); ++i)
+		{
+			SimilarKey&	result = results[n_results + i];
+			result.key = (const char*)db_key_reader.get(&found[i].second, sizeof(int), &result.key_len);
+			result.sim = -found[i].first;
+		}
 	}
 
 	void Dictionary::load_header_info()
@@ -246,7 +920,31 @@ namespace NER
 				db_version_string += read;
 			}
 		}
-		if (db_version_string != VERSION_STRING)
+		if (db_version_string == VERSION_STRING_1_1)
+		{
+			db_has_index = false;
+			db_has_ngram_size = false;
+			db_has_class_sets = false;
+		}
+		else if (db_version_string == VERSION_STRING_1_2)
+		{
+			db_has_index = true;
+			db_has_ngram_size = false;
+			db_has_class_sets = false;
+		}
+		else if (db_version_string == VERSION_STRING_1_3)
+		{
+			db_has_index = true;
+			db_has_ngram_size = true;
+			db_has_class_sets = false;
+		}
+		else if (db_version_string == VERSION_STRING)
+		{
+			db_has_index = true;
+			db_has_ngram_size = true;
+			db_has_class_sets = true;
+		}
+		else
 		{
 			throw nersuite_exception("ERROR: DB version mismatch.");
 		}
@@ -277,13 +975,285 @@ namespace NER
 		}
 	}
 
+	void Dictionary::load_class_sets()
+	{
+		// The table is kept as written: n, n+1 offsets, class indices
+		db_ifs.read( reinterpret_cast<char *>( &n_class_sets ), sizeof(int) );
+		if (db_ifs.fail() || n_class_sets < 0)
+		{
+			throw nersuite_exception("ERROR: failed to read the class list table.");
+		}
+
+		class_sets.resize(n_class_sets + 2);
+		class_sets[0] = n_class_sets;
+		db_ifs.read( reinterpret_cast<char *>( &class_sets[1] ), sizeof(int) * (n_class_sets + 1) );
+		if (db_ifs.fail())
+		{
+			throw nersuite_exception("ERROR: failed to read the class list table.");
+		}
+
+		int		n_classes = class_sets[n_class_sets + 1];
+		class_sets.resize(n_class_sets + 2 + n_classes);
+		if (n_classes > 0)
+		{
+			db_ifs.read( reinterpret_cast<char *>( &class_sets[n_class_sets + 2] ), sizeof(int) * n_classes );
+			if (db_ifs.fail())
+			{
+				throw nersuite_exception("ERROR: failed to read the class list table.");
+			}
+		}
+	}
+
+	const int* Dictionary::resolve_db_value(const void* value, size_t vsize, size_t* count) const
+	{
+		if (value == NULL || !db_has_class_sets)
+		{
+			if (count != NULL)
+			{
+				*count = vsize / sizeof(int);
+			}
+			return (const int*)value;
+		}
+
+		// The value is the id of a class list
+		const int*	offsets = &class_sets[1];
+		int			set_id = *(const int*)value;
+		if (count != NULL)
+		{
+			*count = offsets[set_id + 1] - offsets[set_id];
+		}
+		return &class_sets[0] + (n_class_sets + 2) + offsets[set_id];
+	}
+
+	const int* Dictionary::get_db_classes(const char* nkey, size_t nkey_len, size_t* count) const
+	{
+		size_t		vsize;
+		const void*	value = db_reader.get(nkey, nkey_len, &vsize);
+		return resolve_db_value(value, vsize, count);
+	}
+
 	const int* Dictionary::get_classes(const string& key, int normalize_type, size_t* count) const
+	{
+		return get_normalized_classes(normalize_key(key, normalize_type), count);
+	}
+
+	const int* Dictionary::get_normalized_classes(const string& nkey, size_t* count) const
+	{
+		return get_normalized_classes(nkey.c_str(), nkey.length(), count);
+	}
+
+	const int* Dictionary::get_normalized_classes(const char* nkey, size_t nkey_len, size_t* count) const
+	{
+		if (!db_reader.is_open())
+		{
+			throw nersuite_exception("ERROR: failed to open CDBPP for input.");
+		}
+
+		const int*	result;
+		size_t		n;
+		if (!find_cached(nkey, nkey_len, &result, &n))
+		{
+			// Keys of the deltas have their merged classes in the overlay
+			result = NULL;
+			if (overlay_reader.is_open())
+			{
+				result = (const int*)overlay_reader.get(nkey, nkey_len, &n);
+				n /= sizeof(int);
+			}
+			if (result == NULL)
+			{
+				result = get_db_classes(nkey, nkey_len, &n);
+			}
+			add_cached(nkey, nkey_len, result, n);
+		}
+		if (count != NULL)
+		{
+			*count = n;
+		}
+		return result;
+	}
+
+	void Dictionary::get_normalized_classes_batch(ClassQuery* queries, size_t n_queries) const
 	{
 		if (!db_reader.is_open())
 		{
 			throw nersuite_exception("ERROR: failed to open CDBPP for input.");
 		}
 
+		cdbpp::cdbpp::query_t	window[cdbpp::BATCH_WINDOW];
+		size_t					pending[cdbpp::BATCH_WINDOW];	// query of each lookup in the window
+		bool					cached[cdbpp::BATCH_WINDOW];
+
+		for (size_t beg = 0; beg < n_queries; beg += cdbpp::BATCH_WINDOW)
+		{
+			ClassQuery*	qs = queries + beg;
+			size_t		n = n_queries - beg;
+			if (n > cdbpp::BATCH_WINDOW)
+			{
+				n = cdbpp::BATCH_WINDOW;
+			}
+
+			// Look up the keys not in the cache
+			size_t	n_pending = 0;
+			for (size_t i = 0; i < n; ++i)
+			{
+				cached[i] = find_cached(qs[i].key, qs[i].key_len, &qs[i].classes, &qs[i].count);
+				if (!cached[i])
+				{
+					window[n_pending].key = qs[i].key;
+					window[n_pending].ksize = qs[i].key_len;
+					pending[n_pending] = i;
+					++n_pending;
+				}
+			}
+
+			// Keys of the deltas have their merged classes in the overlay
+			if (overlay_reader.is_open())
+			{
+				overlay_reader.get_batch(window, n_pending);
+				size_t	n_rest = 0;
+				for (size_t i = 0; i < n_pending; ++i)
+				{
+					if (window[i].value != NULL)
+					{
+						qs[pending[i]].classes = (const int*)window[i].value;
+						qs[pending[i]].count = window[i].vsize / sizeof(int);
+					}
+					else
+					{
+						window[n_rest] = window[i];
+						pending[n_rest] = pending[i];
+						++n_rest;
+					}
+				}
+				n_pending = n_rest;
+			}
+
+			db_reader.get_batch(window, n_pending);
+			for (size_t i = 0; i < n_pending; ++i)
+			{
+				qs[pending[i]].classes = resolve_db_value(window[i].value, window[i].vsize, &qs[pending[i]].count);
+			}
+
+			if (n_cache_sets > 0)
+			{
+				for (size_t i = 0; i < n; ++i)
+				{
+					if (!cached[i])
+					{
+						add_cached(qs[i].key, qs[i].key_len, qs[i].classes, qs[i].count);
+					}
+				}
+			}
+		}
+	}
+
+	void Dictionary::enable_cache(size_t n_entries)
+	{
+		delete[] cache_stripes;
+		cache_stripes = NULL;
+
+		CacheEntry	unused;
+		unused.classes = NULL;
+		unused.count = 0;
+		unused.used = false;
+
+		n_cache_sets = (n_entries + 1) / 2;
+		cache.assign(n_cache_sets * 2, unused);
+		cache_recent.assign(n_cache_sets, 0);
+		if (n_cache_sets > 0)
+		{
+			cache_stripes = new CacheStripe[CACHE_STRIPES];
+			for (size_t i = 0; i < CACHE_STRIPES; ++i)
+			{
+				cache_stripes[i].lookups = 0;
+				cache_stripes[i].hits = 0;
+			}
+		}
+	}
+
+	CacheStats Dictionary::get_cache_stats() const
+	{
+		CacheStats	stats;
+		stats.lookups = 0;
+		stats.hits = 0;
+		for (size_t i = 0; i < CACHE_STRIPES && n_cache_sets > 0; ++i)
+		{
+			ScopedLock	lock(cache_stripes[i].lock);
+			stats.lookups += cache_stripes[i].lookups;
+			stats.hits += cache_stripes[i].hits;
+		}
+		return stats;
+	}
+
+	bool Dictionary::find_cached(const char* nkey, size_t nkey_len, const int** classes, size_t* count) const
+	{
+		if (n_cache_sets == 0)
+		{
+			return false;
+		}
+
+		size_t			set = cdbpp::murmurhash2()(nkey, nkey_len) % n_cache_sets;
+		CacheStripe&	stripe = cache_stripes[set % CACHE_STRIPES];
+		ScopedLock		lock(stripe.lock);
+
+		++stripe.lookups;
+		for (unsigned char way = 0; way < 2; ++way)
+		{
+			const CacheEntry&	entry = cache[set * 2 + way];
+			if (entry.used && entry.key.length() == nkey_len && memcmp(entry.key.data(), nkey, nkey_len) == 0)
+			{
+				cache_recent[set] = way;
+				++stripe.hits;
+				*classes = entry.classes;
+				*count = entry.count;
+				return true;
+			}
+		}
+		return false;
+	}
+
+	void Dictionary::add_cached(const char* nkey, size_t nkey_len, const int* classes, size_t count) const
+	{
+		if (n_cache_sets == 0)
+		{
+			return;
+		}
+
+		size_t		set = cdbpp::murmurhash2()(nkey, nkey_len) % n_cache_sets;
+		ScopedLock	lock(cache_stripes[set % CACHE_STRIPES].lock);
+
+		// Another thread may have added the key meanwhile
+		for (unsigned char way = 0; way < 2; ++way)
+		{
+			const CacheEntry&	entry = cache[set * 2 + way];
+			if (entry.used && entry.key.length() == nkey_len && memcmp(entry.key.data(), nkey, nkey_len) == 0)
+			{
+				return;
+			}
+		}
+
+		// Replace an unused entry, or else the one not used last
+		unsigned char	way = 1 - cache_recent[set];
+		if (!cache[set * 2].used)
+		{
+			way = 0;
+		}
+		else if (!cache[set * 2 + 1].used)
+		{
+			way = 1;
+		}
+
+		CacheEntry&	entry = cache[set * 2 + way];
+		entry.key.assign(nkey, nkey_len);
+		entry.classes = classes;
+		entry.count = count;
+		entry.used = true;
+		cache_recent[set] = way;
+	}
+
+	string Dictionary::normalize_key(const string& key, int normalize_type)
+	{
 		string nkey = key;
 		if ((normalize_type & NER::NormalizeNumber) != 0)
 		{
@@ -298,8 +1268,45 @@ namespace NER
 			// lowercase search
 			nkey = make_lowercase(nkey);
 		}
+		return nkey;
+	}
+
+	void Dictionary::append_normalized_key(string& nkey, const string& npiece, int normalize_type)
+	{
+		// Number and symbol normalization squeeze runs of digits and symbols,
+		// so a run continuing across the boundary must be squeezed again
+		size_t	skip = 0;
+		if (!nkey.empty() && !npiece.empty())
+		{
+			char	last = nkey[nkey.length() - 1];
+			if (((normalize_type & NER::NormalizeNumber) != 0) && last == '0' && npiece[0] == '0')
+			{
+				skip = 1;
+			}
+			else if (((normalize_type & NER::NormalizeSymbol) != 0) && last == '_' && npiece[0] == '_')
+			{
+				skip = 1;
+			}
+		}
+		nkey.append(npiece, skip, string::npos);
+	}
+
+	const int* Dictionary::get_key_lengths(const char* head, size_t head_len, size_t* count) const
+	{
+		if (!db_index_reader.is_open())
+		{
+			throw nersuite_exception("ERROR: the dictionary has no key length index.");
+		}
 
-		const int* result = (const int*)db_reader.get(nkey.c_str(), nkey.length(), count);
+		const int* result = NULL;
+		if (overlay_index_reader.is_open())
+		{
+			result = (const int*)overlay_index_reader.get(head, head_len, count);
+		}
+		if (result == NULL)
+		{
+			result = (const int*)db_index_reader.get(head, head_len, count);
+		}
 		if (count != NULL)
 		{
 			*count /= sizeof(int);
@@ -307,6 +1314,25 @@ namespace NER
 		return result;
 	}
 
+	size_t Dictionary::key_head_length(const char* nkey, size_t nkey_len)
+	{
+		if (nkey_len == 0)
+		{
+			return 0;
+		}
+		if (!isalnum(nkey[0]))
+		{
+			return 1;
+		}
+
+		size_t	len = 1;
+		while (len < nkey_len && isalnum(nkey[len]))
+		{
+			++len;
+		}
+		return len;
+	}
+
 	size_t Dictionary::get_class_count() const
 	{
 		return map_idx2name.size();
@@ -336,16 +1362,11 @@ namespace NER
 		if ((normalize_type & NER::NormalizeToken) != 0)
 		{
 			Tokenizer tokenizer;
-			V2_STR	tokens;
-			tokenizer.tokenize(result, tokens);
-			for (V2_STR::iterator i = tokens.begin(); i != tokens.end(); ++i)
+			V1_SPAN	spans;
+			tokenizer.tokenize(result, spans);
+			for (V1_SPAN::const_iterator i = spans.begin(); i != spans.end(); ++i)
 			{
-				V1_STR& token_attrs = *i;
-				if (token_attrs.size() < 3)
-				{
-					throw nersuite_exception("ERROR: unexpected result found while tokenizing: " + result);
-				}
-				normalized_tokens.push_back(token_attrs[2]);
+				normalized_tokens.push_back(result.substr(i->first, i->second - i->first));
 			}
 		}
 		else 
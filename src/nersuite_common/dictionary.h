@@ -37,6 +37,7 @@
 #include <exception>
 #include "../cdbpp-1.1/include/cdbpp.h"
 #include "nersuite_exception.h"
+#include "thread_utils.h"
 #include "ne.h"
 
 typedef std::vector<std::string>		V1_STR;
@@ -79,6 +80,79 @@ namespace NER
 		NormalizeToken = 0x08,
 	};
 
+	/** 
+	* @ingroup NERsuite
+	* Similarity measures for approximate dictionary matching
+	*/
+	enum SimilarityMeasure
+	{
+		/** 
+		* Cosine similarity of the character n-gram sets
+		*/
+		SimilarityCosine = 0,
+		/** 
+		* Jaccard similarity of the character n-gram sets
+		*/
+		SimilarityJaccard = 1,
+	};
+
+	/** 
+	* @ingroup NERsuite
+	* A key retrieved by approximate matching (see Dictionary::get_similar_keys())
+	*/
+	struct SimilarKey
+	{
+		/** The key (normalized as stored in the Dictionary, not null-terminated)
+		*/
+		const char*	key;
+
+		/** Length of the key in bytes
+		*/
+		size_t		key_len;
+
+		/** Similarity of the key to the query
+		*/
+		double		sim;
+	};
+
+	/** 
+	* @ingroup NERsuite
+	* A key looked up by Dictionary::get_normalized_classes_batch()
+	*/
+	struct ClassQuery
+	{
+		/** Normalized key (need not be null-terminated)
+		*/
+		const char*	key;
+
+		/** Length of the key in bytes
+		*/
+		size_t		key_len;
+
+		/** [out] Class indices of the key, or NULL if not found
+		*/
+		const int*	classes;
+
+		/** [out] Count of the class indices
+		*/
+		size_t		count;
+	};
+
+	/** 
+	* @ingroup NERsuite
+	* Counters of the lookup cache of a Dictionary (see Dictionary::enable_cache())
+	*/
+	struct CacheStats
+	{
+		/** Count of the keys looked up while the cache was enabled
+		*/
+		size_t		lookups;
+
+		/** Count of the lookups answered from the cache (including keys not found)
+		*/
+		size_t		hits;
+	};
+
 	/** 
 	* @ingroup NERsuite
 	* External Dictionary Manager Class
@@ -92,12 +166,57 @@ namespace NER
 
 	private:
 		static const char *VERSION_STRING;
+		static const char *VERSION_STRING_1_3;	// with a class list as the value of each key
+		static const char *VERSION_STRING_1_2;	// without the n-gram index
+		static const char *VERSION_STRING_1_1;	// without the key length index
 
 		int db_normalization_type;
+		bool db_has_index;
+		bool db_has_ngram_size;
+		bool db_has_class_sets;
+		int db_ngram_size;
 		std::ifstream	db_ifs;
 		cdbpp::cdbpp	db_reader;
+		cdbpp::cdbpp	db_index_reader;	// key head --> sorted lengths of the keys
+		cdbpp::cdbpp	db_ngram_reader;	// feature size + n-gram --> sorted key ids
+		cdbpp::cdbpp	db_key_reader;		// key id --> key
 		std::map< int, std::string > map_idx2name;
 
+		// Distinct class lists, each key storing the id of its list: the count
+		// of lists n, n+1 offsets into the class indices, and the class indices
+		std::vector<int>	class_sets;
+		int		n_class_sets;
+		std::vector<int>	class_columns;	// class index --> position in the name order
+
+		// Delta Dictionaries layered over this one (see add_delta())
+		std::vector<std::string>	delta_paths;
+		std::vector<Dictionary*>	deltas;
+		cdbpp::cdbpp	overlay_reader;			// key of a delta --> merged classes
+		cdbpp::cdbpp	overlay_index_reader;	// key head of a delta --> merged key lengths
+
+		// Cache of recent lookups (see enable_cache()): two-way set associative,
+		// each set guarded by the lock of its stripe
+		struct CacheEntry
+		{
+			std::string key;
+			const int* classes;		// NULL for a key not found
+			size_t count;
+			bool used;
+		};
+		struct CacheStripe
+		{
+			Mutex lock;
+			size_t lookups;
+			size_t hits;
+		};
+		mutable std::vector<CacheEntry>	cache;
+		mutable std::vector<unsigned char>	cache_recent;	// way used last in each set
+		mutable CacheStripe*	cache_stripes;
+		size_t	n_cache_sets;
+
+		Dictionary(const Dictionary&);
+		Dictionary& operator=(const Dictionary&);
+
 	public:
 		/** Construct a Dictionary object.  The path to the CDBPP database file must be provided.
 		*  @param[in] binary_dbname Path to the CDBPP database.
@@ -108,13 +227,24 @@ namespace NER
 		*/
 		virtual ~Dictionary();
 
-		/** Open the Dictionary for reading.
+		/** Layer a delta Dictionary over this one.  Lookups consult both and merge
+		* the class sets, giving the same results as a Dictionary compiled from
+		* the concatenated text files, so small additions need no full rebuild.
+		* The delta must be compiled with the same normalization type.
+		* @pre Must be called before @ref open.  Deltas are applied in the order added.
+		* @param[in] delta_dbname Path to the CDBPP database of the delta.
+		*/
+		void add_delta(const char* delta_dbname);
+
+		/** Open the Dictionary (and its deltas) for reading.
+		* Dictionaries larger than 4GB are written with 64-bit CDB++ offsets;
+		* the format of each database chunk is detected from its header.
 		*/
 		void open();
 
 		/** Retrieve the normalization type applied when creating the Dictionary.
 		*/
-		int get_normalization_type() { return db_normalization_type; }
+		int get_normalization_type() const { return db_normalization_type; }
 
 		/** Retrieve the array of Classes which match the provided key from the Database.
 		* @pre The Dictionary must be open before calling this function.
@@ -125,6 +255,107 @@ namespace NER
 		*/
 		const int* get_classes(const std::string& key, int normalize_type, size_t* count) const;
 
+		/** Retrieve the array of Classes which match an already normalized key from the Database.
+		* Use this to query several Dictionaries with a key normalized once by @ref normalize_key.
+		* @pre The Dictionary must be open before calling this function.
+		* @param[in] nkey Key string normalized with the normalization type of the query
+		* @param[out] count Match count
+		* @return Returns an array of all class indices which satisfy the given condition
+		*/
+		const int* get_normalized_classes(const std::string& nkey, size_t* count) const;
+
+		/** Retrieve the array of Classes which match an already normalized key from the Database.
+		* @pre The Dictionary must be open before calling this function.
+		* @param[in] nkey Normalized key (need not be null-terminated)
+		* @param[in] nkey_len Length of the key in bytes
+		* @param[out] count Match count
+		* @return Returns an array of all class indices which satisfy the given condition
+		*/
+		const int* get_normalized_classes(const char* nkey, size_t nkey_len, size_t* count) const;
+
+		/** Retrieve the Classes of several normalized keys at once.
+		* The result is the same as calling @ref get_normalized_classes for each key, but
+		* the lookups are interleaved so that their memory accesses overlap, which pays
+		* off when a caller has many keys to look up, e.g. all candidates of a sentence.
+		* @pre The Dictionary must be open before calling this function.
+		* @param[in,out] queries Keys to look up; their classes and count are filled in
+		* @param[in] n_queries Count of the queries
+		*/
+		void get_normalized_classes_batch(ClassQuery* queries, size_t n_queries) const;
+
+		/** Apply the query-time normalization to a key.
+		* @param[in] key Key string
+		* @param[in] normalize_type Combination of all normalization which should be applied before key matching
+		* @return Normalized key
+		*/
+		static std::string normalize_key(const std::string& key, int normalize_type);
+
+		/** Append a normalized string to a normalized key.
+		* The result equals the normalization of the concatenated original strings,
+		* so keys of token sequences can be built from tokens normalized one by one.
+		* @param[in,out] nkey Key normalized by @ref normalize_key
+		* @param[in] npiece String normalized by @ref normalize_key with the same normalization type
+		* @param[in] normalize_type Combination of all normalization applied to nkey and npiece
+		*/
+		static void append_normalized_key(std::string& nkey, const std::string& npiece, int normalize_type);
+
+		/** Keep the results of recent lookups by @ref get_normalized_classes and
+		* @ref get_normalized_classes_batch (found or not) in a cache, so that
+		* frequent keys need no database lookup.  The cache can be shared by threads.
+		* @pre Must not be called while another thread uses the Dictionary.
+		* @param[in] n_entries Maximum count of cached keys (0: disable the cache)
+		*/
+		void enable_cache(size_t n_entries);
+
+		/** Retrieve the counters of the lookup cache.
+		* @return Returns the counts of lookups and cache hits since the cache was enabled
+		*/
+		CacheStats get_cache_stats() const;
+
+		/** Tell whether the Dictionary has a key length index (see @ref get_key_lengths).
+		* Dictionaries compiled by older versions do not have one.
+		* @pre The Dictionary must be open before calling this function.
+		*/
+		bool has_key_length_index() const { return db_index_reader.is_open(); }
+
+		/** Retrieve the lengths of all keys beginning with a given key head.
+		* A key can only match if its length is in the returned set, which
+		* lets a caller skip lookups of candidate keys that cannot match.
+		* @pre The Dictionary must be open and have a key length index.
+		* @param[in] head Key head (see @ref key_head_length)
+		* @param[in] head_len Length of the key head in bytes
+		* @param[out] count Number of lengths
+		* @return Returns the lengths in bytes in ascending order, or NULL if no key has the head
+		*/
+		const int* get_key_lengths(const char* head, size_t head_len, size_t* count) const;
+
+		/** Return the length of the head of a normalized key: the leading run
+		* of alphanumeric characters, or the first character if it is not alphanumeric.
+		* @param[in] nkey Normalized key
+		* @param[in] nkey_len Length of the key in bytes
+		*/
+		static size_t key_head_length(const char* nkey, size_t nkey_len);
+
+		/** Tell whether the Dictionary has a character n-gram index (see @ref get_similar_keys).
+		* The index is built only if requested when compiling the Dictionary.
+		* With deltas, all of them must have an index with the same n-gram size.
+		* @pre The Dictionary must be open before calling this function.
+		*/
+		bool has_ngram_index() const { return db_ngram_reader.is_open(); }
+
+		/** Retrieve all keys whose similarity to a normalized key is at least a threshold.
+		* Keys are compared as sets of character n-grams, and only keys of the sizes
+		* allowed by the threshold are searched (as in SimString).
+		* @pre The Dictionary must be open and have an n-gram index.
+		* @param[in] nkey Normalized key (need not be null-terminated)
+		* @param[in] nkey_len Length of the key in bytes
+		* @param[in] measure Similarity measure (a SimilarityMeasure)
+		* @param[in] threshold Minimum similarity, in (0, 1]
+		* @param[out] results Keys found, the most similar first (ties in key order)
+		* @return Returns the count of keys found
+		*/
+		size_t get_similar_keys(const char* nkey, size_t nkey_len, int measure, double threshold, std::vector<SimilarKey>& results) const;
+
 		/** Retrieve the count of Classes this Dictionary contains.
 		* @pre The Dictionary must be open before calling this function.
 		* @return Size of the Class set.
@@ -138,18 +369,64 @@ namespace NER
 		*/
 		const std::string& get_class_name(int class_index) const;
 
+		/** Retrieve the position of a Class in the name order of all Classes.
+		* This is the class index itself unless a delta added new Classes.
+		* @pre The Dictionary must be open before calling this function.
+		* @param[in] class_index Index of a class (must be smaller than the value returned from @ref get_class_count)
+		* @return Position of the class
+		*/
+		int get_class_column(int class_index) const { return class_columns[class_index]; }
+
 		/** Build up a new CDBPP Dictionary from a text file.
 		* @param[in] txt_dbname Path to an existing text file to be read as the Dictionary source.
 		* @param[in] normalize_type A combination of normalization types which is applied to parse the surface of input Dictioanry entries.
+		* @param[in] ngram_size Size of the character n-grams indexed for approximate matching (0: no n-gram index)
+		*/
+		void build(const char* txt_dbname, int normalize_type, int ngram_size = 0);
+
+		/** Build up a new CDBPP Dictionary by folding delta Dictionaries into a base Dictionary.
+		* The result is the same as building from the concatenated text files.
+		* @param[in] base_dbname Path to the CDBPP database of the base.
+		* @param[in] delta_dbnames Paths to the CDBPP databases of the deltas, in the order they are applied.
 		*/
-		void build(const char* txt_dbname, int normalize_type);
+		void merge(const char* base_dbname, const std::vector<std::string>& delta_dbnames);
 
 	private:
 		void normalize(const std::string& form, int normalize_type, V1_STR& normalized_tokens);
 
+		void write_db(const std::map<std::string, int>& map_name2idx, const std::map< std::string, std::vector<int> >& dictionary, int normalize_type, int ngram_size);
+
+		void write_class_sets(std::ofstream& ofs, const std::map< std::string, std::vector<int> >& dictionary, std::map< std::vector<int>, int >& set_ids);
+
+		void write_key_length_index(std::ofstream& ofs, const std::map< std::string, std::vector<int> >& dictionary);
+
+		void write_ngram_index(std::ofstream& ofs, const std::map< std::string, std::vector<int> >& dictionary, int ngram_size);
+
+		static void make_ngram_features(const char* key, size_t key_len, int ngram_size, V1_STR& features);
+
+		void search_ngram_index(const char* nkey, size_t nkey_len, int measure, double threshold, std::vector<SimilarKey>& results) const;
+
 		void load_header_info();
 
 		void load_index_mapping();
+
+		void load_class_sets();
+
+		const int* get_db_classes(const char* nkey, size_t nkey_len, size_t* count) const;
+
+		const int* resolve_db_value(const void* value, size_t vsize, size_t* count) const;
+
+		struct EntryCollector;
+
+		bool find_cached(const char* nkey, size_t nkey_len, const int** classes, size_t* count) const;
+
+		void add_cached(const char* nkey, size_t nkey_len, const int* classes, size_t count) const;
+
+		void load_deltas();
+
+		static void open_in_memory(cdbpp::cdbpp& reader, const std::map< std::string, std::vector<int> >& records);
+
+		void update_class_columns();
 	};
 }
 #endif
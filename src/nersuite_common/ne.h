@@ -31,8 +31,7 @@
 #ifndef _NE_H
 #define _NE_H
 
-#include <list>
-#include <string>
+#include <cstddef>
 
 namespace NER
 {
@@ -51,11 +50,17 @@ namespace NER
 		*/
 		int						end;
 
-		/** The Class list which this chunk is labelled as
+		/** The indices of the Classes which this chunk is labelled as
+		* (owned by the Dictionary, see Dictionary::get_normalized_classes())
 		*/
-		std::list<std::string>	classes;
+		const int*				classes;
 
-		/** The similarity value (not used and set to 1.0)
+		/** The count of the Classes
+		*/
+		size_t					n_classes;
+
+		/** The similarity of this chunk to the matched dictionary entry
+		* (1.0 for an exact match, see SentenceTagger::set_approximate_matching())
 		*/
 		double					sim;
 	};
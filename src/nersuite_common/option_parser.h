@@ -58,8 +58,26 @@ namespace NER
 	private:
 		V1_PARAM	params;			// All parameters will be stored here.
 		std::vector<const char*>	args;
+		std::vector<std::string>	flags;		// Parameters without a value
+
+		bool is_flag(const char *name) const {
+			for (std::vector<std::string>::const_iterator citr = flags.begin(); citr != flags.end(); ++citr) {
+				if (*citr == name)
+					return true;
+			}
+			return false;
+		}
 
 	public:
+		/**
+		* Declare a parameter that never takes a value, so that the string
+		* following it is not consumed as its value (call before parse())
+		* @param[in] name Name of parameter
+		*/
+		void add_flag(const std::string &name) {
+			flags.push_back(name);
+		}
+
 		/**
 		* Parse input parameters
 		* @param[in] n Number of arguments
@@ -77,7 +95,9 @@ namespace NER
 					++consumed;
 
 					// 2. Get parameter value
-					if ((i+1) < n) {
+					if (is_flag(items[i])) {
+						param.value = "";
+					}else if ((i+1) < n) {
 						if(items[i+1][0] == '-') {
 							param.value = "";
 						}else {
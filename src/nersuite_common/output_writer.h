@@ -0,0 +1,309 @@
+/*
+*      NERSuite
+*      Buffered output writer
+*
+* Copyright (c)
+* All rights reserved.
+*
+* Redistribution and use in source and binary forms, with or without
+* modification, are permitted provided that the following conditions are met:
+*     * Redistributions of source code must retain the above copyright
+*       notice, this list of conditions and the following disclaimer.
+*     * Redistributions in binary form must reproduce the above copyright
+*       notice, this list of conditions and the following disclaimer in the
+*       documentation and/or other materials provided with the distribution.
+*     * Neither the names of the authors nor the names of its contributors
+*       may be used to endorse or promote products derived from this
+*       software without specific prior written permission.
+*
+* THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+* "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+* LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+* A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER
+* OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+* EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+* PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+* PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+* LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+* NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+* SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef		_OUTPUT_WRITER_H
+#define		_OUTPUT_WRITER_H
+
+#include <cstring>
+#include <map>
+#include <ostream>
+#include <string>
+#include <vector>
+
+#include "binary_format.h"
+
+namespace NER
+{
+	/**
+	* @ingroup NERsuite
+	*/
+	/**
+	* Buffered writer of tab-separated output.
+	*
+	* Lines are formatted into a reusable buffer, which is passed to the
+	* underlying stream when it is full, at the end of a document (or of
+	* the input) and, in the line-buffered mode, at the end of every line.
+	* Unlike "<< endl", ending a line does not flush the stream, so a pipe
+	* stage writes its output in large blocks.
+	*
+	* Sentences and comment blocks written with write_sent() and
+	* write_comment() are encoded in the format given at construction
+	* (see DataFormat); the other functions write text as it is.
+	*
+	* A writer is used by one thread at a time.
+	*/
+	class OutputWriter
+	{
+	private:
+		std::ostream		&os;
+		std::vector<char>	buf;
+		size_t				pos;
+		bool				line_buffered;
+		DataFormat			format;
+
+		// FORMAT_BINARY
+		bool				header_written;
+		std::string			record;
+		std::map<std::string, unsigned long>	strings;	// string table of the document
+
+		OutputWriter(const OutputWriter&);
+		OutputWriter& operator=(const OutputWriter&);
+
+		// Pass the buffered output to the stream (without flushing it)
+		void drain()
+		{
+			if (pos > 0) {
+				os.write(&buf[0], pos);
+				pos = 0;
+			}
+		}
+
+		// Format an integer without going through the locale of the stream
+		OutputWriter& write_integer(unsigned long u, bool negative)
+		{
+			char	digits[24];
+			char	*p = digits + sizeof(digits);
+			do {
+				*--p = (char) ('0' + u % 10);
+				u /= 10;
+			} while (u > 0);
+			if (negative)
+				*--p = '-';
+			return write(p, digits + sizeof(digits) - p);
+		}
+
+		void append_string(const std::string &s)
+		{
+			std::map<std::string, unsigned long>::iterator	i = strings.lower_bound(s);
+			if (i != strings.end() && i->first == s) {
+				append_varint(record, i->second);
+			}else {
+				strings.insert(i, std::make_pair(s, (unsigned long) strings.size() + 1));
+				append_varint(record, 0);
+				append_varint(record, s.length());
+				record += s;
+			}
+		}
+
+		// Write the record built in "record"
+		void write_record(char type)
+		{
+			if (!header_written) {
+				write(BINARY_MAGIC, strlen(BINARY_MAGIC));
+				*this << (char) BINARY_VERSION;
+				header_written = true;
+			}
+			*this << type;
+			std::string	length;
+			append_varint(length, record.length());
+			*this << length << record;
+			if (line_buffered)
+				flush();
+		}
+
+	public:
+		enum { DEFAULT_CAPACITY = 1 << 16 };
+
+		/**
+		* @param[in] os Output stream
+		* @param[in] line_buffered If true, the stream is flushed at the end of every line
+		*  (of every sentence in FORMAT_BINARY)
+		* @param[in] format Format of the sentences
+		* @param[in] capacity Size of the buffer in bytes
+		*/
+		explicit OutputWriter(std::ostream &os, bool line_buffered = false, DataFormat format = FORMAT_TSV, size_t capacity = DEFAULT_CAPACITY)
+			: os(os), buf(capacity > 0 ? capacity : 1), pos(0), line_buffered(line_buffered),
+			  format(format), header_written(false)
+		{
+		}
+
+		~OutputWriter() { flush(); }
+
+		OutputWriter& write(const char *s, size_t n)
+		{
+			if (pos + n > buf.size()) {
+				drain();
+				if (n > buf.size()) {
+					os.write(s, n);
+					return *this;
+				}
+			}
+			memcpy(&buf[pos], s, n);
+			pos += n;
+			return *this;
+		}
+
+		OutputWriter& operator<<(const std::string &s) { return write(s.data(), s.size()); }
+		OutputWriter& operator<<(const char *s) { return write(s, strlen(s)); }
+
+		OutputWriter& operator<<(char c)
+		{
+			if (pos == buf.size())
+				drain();
+			buf[pos++] = c;
+			return *this;
+		}
+
+		OutputWriter& operator<<(long n) { return write_integer((n < 0) ? 0UL - (unsigned long) n : (unsigned long) n, n < 0); }
+		OutputWriter& operator<<(unsigned long n) { return write_integer(n, false); }
+		OutputWriter& operator<<(int n) { return *this << (long) n; }
+		OutputWriter& operator<<(unsigned int n) { return write_integer(n, false); }
+
+		/**
+		* Write the columns of a row separated by tabs, and end the line
+		*/
+		void write_row(const std::vector<std::string> &row)
+		{
+			for (std::vector<std::string>::const_iterator i = row.begin(); i != row.end(); ++i) {
+				if (i != row.begin())
+					*this << '\t';
+				*this << *i;
+			}
+			end_line();
+		}
+
+		DataFormat get_format() const { return format; }
+
+		/**
+		* Write a sentence: its rows, and a blank line after them in FORMAT_TSV
+		*/
+		template<typename ROW_ITERATOR>
+		void write_sent(ROW_ITERATOR begin, ROW_ITERATOR end)
+		{
+			if (format == FORMAT_TSV) {
+				for (ROW_ITERATOR i_row = begin; i_row != end; ++i_row)
+					write_row(*i_row);
+				end_line();
+				return;
+			}
+
+			if (strings.size() >= BINARY_MAX_STRINGS)
+				strings.clear();
+
+			size_t	n_rows = 0, n_cols = 0;
+			bool	ragged = false;
+			for (ROW_ITERATOR i_row = begin; i_row != end; ++i_row, ++n_rows) {
+				if (n_rows > 0 && i_row->size() != n_cols)
+					ragged = true;
+				if (i_row->size() > n_cols)
+					n_cols = i_row->size();
+			}
+
+			record.clear();
+			append_varint(record, n_rows);
+			append_varint(record, n_cols);
+			record += (char) ragged;
+			if (ragged) {
+				for (ROW_ITERATOR i_row = begin; i_row != end; ++i_row)
+					append_varint(record, i_row->size());
+			}
+
+			unsigned long	value = 0;
+			for (size_t col = 0; col < n_cols; ++col) {
+				bool	ints = true;
+				for (ROW_ITERATOR i_row = begin; ints && i_row != end; ++i_row) {
+					if (col < i_row->size() && !parse_plain_int((*i_row)[col], value))
+						ints = false;
+				}
+
+				record += ints ? BINARY_COLUMN_INT : BINARY_COLUMN_STRING;
+				for (ROW_ITERATOR i_row = begin; i_row != end; ++i_row) {
+					if (col >= i_row->size())
+						continue;
+					if (ints) {
+						parse_plain_int((*i_row)[col], value);
+						append_varint(record, value);
+					}else {
+						append_string((*i_row)[col]);
+					}
+				}
+			}
+			write_record(BINARY_SENTENCE);
+		}
+
+		void write_sent(const std::vector< std::vector<std::string> > &sent) { write_sent(sent.begin(), sent.end()); }
+
+		/**
+		* Write a block of comment lines (the first column of each row) and end
+		* the document: the output so far is flushed
+		*/
+		template<typename ROW_ITERATOR>
+		void write_comment(ROW_ITERATOR begin, ROW_ITERATOR end)
+		{
+			if (format == FORMAT_TSV) {
+				for (ROW_ITERATOR i_row = begin; i_row != end; ++i_row) {
+					*this << i_row->front();
+					end_line();
+				}
+				end_line();
+			}else {
+				size_t	n_lines = 0;
+				for (ROW_ITERATOR i_row = begin; i_row != end; ++i_row)
+					++n_lines;
+
+				record.clear();
+				append_varint(record, n_lines);
+				for (ROW_ITERATOR i_row = begin; i_row != end; ++i_row) {
+					append_varint(record, i_row->front().length());
+					record += i_row->front();
+				}
+				write_record(BINARY_COMMENT);
+				strings.clear();
+			}
+			end_document();
+		}
+
+		void write_comment(const std::vector< std::vector<std::string> > &comment) { write_comment(comment.begin(), comment.end()); }
+
+		/**
+		* End a line (flushed in the line-buffered mode)
+		*/
+		void end_line()
+		{
+			*this << '\n';
+			if (line_buffered)
+				flush();
+		}
+
+		/**
+		* End a document: the output so far is flushed
+		*/
+		void end_document() { flush(); }
+
+		void flush()
+		{
+			drain();
+			os.flush();
+		}
+	};
+}
+
+#endif
@@ -0,0 +1,180 @@
+/*
+*      A rule-based sentence boundary detector
+*
+* Copyright (c) 
+* All rights reserved.
+*
+* Redistribution and use in source and binary forms, with or without
+* modification, are permitted provided that the following conditions are met:
+*     * Redistributions of source code must retain the above copyright
+*       notice, this list of conditions and the following disclaimer.
+*     * Redistributions in binary form must reproduce the above copyright
+*       notice, this list of conditions and the following disclaimer in the
+*       documentation and/or other materials provided with the distribution.
+*     * Neither the names of the authors nor the names of its contributors
+*       may be used to endorse or promote products derived from this
+*       software without specific prior written permission.
+*
+* THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+* "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+* LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+* A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER
+* OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+* EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+* PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+* PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+* LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+* NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+* SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+#include <fstream>
+
+#include "sentence_splitter.h"
+#include "nersuite_exception.h"
+
+using namespace std;
+
+namespace NER
+{
+	namespace
+	{
+		// Abbreviations that are usually followed by a capitalized word or a number
+		// within a sentence. Words that often end a sentence ("etc", "min", "h") are left out.
+		const char	*BUILTIN_ABBREVIATIONS[] = {
+			"e.g", "i.e", "cf", "vs", "viz", "approx", "ca", "resp", "et al", "al",
+			"Fig", "Figs", "fig", "figs", "Eq", "Eqs", "Ref", "Refs", "Tab", "Suppl",
+			"No", "Nos", "Vol", "vol", "pp", "sp", "spp", "subsp", "var", "nov",
+			"Dr", "Drs", "Mr", "Mrs", "Ms", "Prof", "St", "Inc", "Ltd", "Co", "Corp",
+			"Jan", "Feb", "Mar", "Apr", "Jun", "Jul", "Aug", "Sep", "Sept", "Oct", "Nov", "Dec",
+			0
+		};
+
+		inline bool is_terminal( const string &raw_sent, const TOKEN_SPAN &span )
+		{
+			if( span.second - span.first != 1 )
+				return false;
+			char	c = raw_sent[ span.first ];
+			return ( c == '.' ) || ( c == '?' ) || ( c == '!' );
+		}
+
+		inline bool is_closing( const string &raw_sent, const TOKEN_SPAN &span )
+		{
+			if( span.second - span.first != 1 )
+				return false;
+			char	c = raw_sent[ span.first ];
+			return ( c == ')' ) || ( c == ']' ) || ( c == '}' ) || ( c == '"' ) || ( c == '\'' );
+		}
+	}
+
+	SentenceSplitter::SentenceSplitter()
+	{
+		for( const char **p = BUILTIN_ABBREVIATIONS; *p != 0; ++p ) {
+			abbreviations.insert( *p );
+		}
+	}
+
+	void SentenceSplitter::add_abbreviation( const string &abbreviation )
+	{
+		string	abbr = abbreviation;
+		if( !abbr.empty() && ( abbr[ abbr.length() - 1 ] == '.' ) ) {
+			abbr.resize( abbr.length() - 1 );
+		}
+		if( !abbr.empty() ) {
+			abbreviations.insert( abbr );
+		}
+	}
+
+	void SentenceSplitter::load_abbreviations( const string &filename )
+	{
+		ifstream	ifs( filename.c_str() );
+		if( !ifs ) {
+			throw nersuite_exception( "ERROR: cannot open the abbreviation list: " + filename );
+		}
+
+		string	line;
+		while( getline( ifs, line ) ) {
+			if( !line.empty() && ( line[ line.length() - 1 ] == '\r' ) ) {
+				line.resize( line.length() - 1 );
+			}
+			add_abbreviation( line );
+		}
+	}
+
+	// The word before a period runs back over directly attached tokens
+	// ("e" "." "g" for "e.g.") to the preceding space, less any opening brackets.
+	// "et al." is matched with its preceding word as well.
+	bool SentenceSplitter::is_abbreviation( const string &raw_sent, const V1_SPAN &spans, size_t i_period ) const
+	{
+		if( i_period == 0 || spans[ i_period - 1 ].second != spans[ i_period ].first ) {
+			return false;
+		}
+
+		size_t	i_beg = i_period - 1;
+		while( i_beg > 0 && spans[ i_beg - 1 ].second == spans[ i_beg ].first ) {
+			--i_beg;
+		}
+
+		size_t	beg = spans[ i_beg ].first, end = spans[ i_period ].first;
+		while( beg < end && ( raw_sent[ beg ] == '(' || raw_sent[ beg ] == '[' || raw_sent[ beg ] == '"' ) ) {
+			++beg;
+		}
+
+		string	word( raw_sent, beg, end - beg );
+		if( abbreviations.count( word ) > 0 ) {
+			return true;
+		}
+
+		if( i_beg > 0 ) {
+			size_t	prev_beg = spans[ i_beg - 1 ].first;
+			string	phrase = raw_sent.substr( prev_beg, spans[ i_beg - 1 ].second - prev_beg ) + " " + word;
+			return abbreviations.count( phrase ) > 0;
+		}
+		return false;
+	}
+
+	int SentenceSplitter::split( const string &raw_sent, const V1_SPAN &spans, vector< size_t > &sent_ends ) const
+	{
+		size_t	n_spans = spans.size();
+		int		n_sents = 0;
+
+		for( size_t i = 0; i < n_spans; ++i ) {
+			if( !is_terminal( raw_sent, spans[i] ) ) {
+				continue;
+			}
+
+			// Absorb attached terminals and closing brackets/quotes ("?!", ".)", ".\"")
+			size_t	end = i + 1;
+			while( end < n_spans && spans[ end ].first == spans[ end - 1 ].second
+					&& ( is_terminal( raw_sent, spans[ end ] ) || is_closing( raw_sent, spans[ end ] ) ) ) {
+				++end;
+			}
+
+			if( end == n_spans ) {
+				break;
+			}
+			if( spans[ end ].first == spans[ end - 1 ].second ) {		// "3.5", "e.g", "a.m."
+				i = end - 1;
+				continue;
+			}
+
+			unsigned char	next = (unsigned char) raw_sent[ spans[ end ].first ];
+			bool	boundary = !( next >= 'a' && next <= 'z' );
+			if( boundary && raw_sent[ spans[i].first ] == '.' && is_abbreviation( raw_sent, spans, i ) ) {
+				boundary = false;
+			}
+
+			if( boundary ) {
+				sent_ends.push_back( end );
+				++n_sents;
+			}
+			i = end - 1;
+		}
+
+		if( n_spans > 0 ) {
+			sent_ends.push_back( n_spans );
+			++n_sents;
+		}
+
+		return n_sents;
+	}
+}
@@ -0,0 +1,86 @@
+/*
+*      A rule-based sentence boundary detector
+*
+* Copyright (c) 
+* All rights reserved.
+*
+* Redistribution and use in source and binary forms, with or without
+* modification, are permitted provided that the following conditions are met:
+*     * Redistributions of source code must retain the above copyright
+*       notice, this list of conditions and the following disclaimer.
+*     * Redistributions in binary form must reproduce the above copyright
+*       notice, this list of conditions and the following disclaimer in the
+*       documentation and/or other materials provided with the distribution.
+*     * Neither the names of the authors nor the names of its contributors
+*       may be used to endorse or promote products derived from this
+*       software without specific prior written permission.
+*
+* THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+* "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+* LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+* A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER
+* OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+* EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+* PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+* PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+* LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+* NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+* SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+#ifndef _NERSUITE_SENTENCE_SPLITTER_H
+#define _NERSUITE_SENTENCE_SPLITTER_H
+
+#include <string>
+#include <vector>
+#include <set>
+
+#include "tokenizer.h"
+
+namespace NER
+{
+	/** 
+	* @ingroup NERsuite
+	* Sentence Splitter
+	*
+	* Finds sentence boundaries in a tokenized paragraph in a single pass over
+	* its token spans. A sentence ends at a "." "?" or "!" token that is
+	* followed by white space, together with any closing brackets or quotes
+	* directly attached to it, unless
+	*   - the next token starts with a lowercase letter, or
+	*   - the word ending at a "." is a known abbreviation (e.g. "Fig", "e.g", "et al").
+	* A boundary never crosses the end of the paragraph.
+	*/
+	class SentenceSplitter
+	{
+	private:
+		std::set< std::string >	abbreviations;
+
+		bool is_abbreviation( const std::string &raw_sent, const V1_SPAN &spans, size_t i_period ) const;
+
+	public:
+		/** Construct a splitter with the built-in biomedical abbreviation list
+		*/
+		SentenceSplitter();
+
+		/** Add an abbreviation, written without its final period (e.g. "Fig", "e.g")
+		* @param[in] abbreviation The abbreviation
+		*/
+		void add_abbreviation( const std::string &abbreviation );
+
+		/** Add abbreviations from a file with one abbreviation per line.
+		* A trailing period on an entry is ignored. Throws nersuite_exception if the file cannot be read.
+		* @param[in] filename The file name
+		*/
+		void load_abbreviations( const std::string &filename );
+
+		/** Split a tokenized paragraph into sentences.
+		* @param[in] raw_sent The paragraph text
+		* @param[in] spans Token spans of raw_sent, as produced by Tokenizer::tokenize
+		* @param[in,out] sent_ends Receives the past-the-end token index of each sentence (appended to)
+		* @returns the count of sentences found.
+		*/
+		int split( const std::string &raw_sent, const V1_SPAN &spans, std::vector< size_t > &sent_ends ) const;
+	};
+}
+
+#endif
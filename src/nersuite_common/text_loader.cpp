@@ -29,6 +29,11 @@
 * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 */
 
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <algorithm>
+
 #include "text_loader.h"
 #include "string_utils.h"
 
@@ -36,32 +41,329 @@ using namespace std;
 
 namespace NER
 {
-	// Retrieve one sentence from input stream.
-	// Each line consists of tab-separated columns (label + feature list).
-	//   First column is the label assigned for the feature list.
-	//   The following columns are the feature list.
-	// Sentence must be terminated with an empty line.
-	int get_sent(istream &cin, V2_STR &one_sent)
+	SentenceReader::SentenceReader(istream &is, DataFormat format, size_t block_size)
+		: m_Is(is), m_BlockSize(block_size), m_Beg(0), m_Scan(0), m_End(0), m_Eof(false),
+		  m_Format(format), m_HeaderRead(false)
 	{
-		one_sent.clear();		// clear the container
+		if (m_Format == FORMAT_BINARY && m_BlockSize == 0)
+			m_BlockSize = 1 << 20;
+	}
 
-		int					n_lines = 0;
-		string				line = "";
-		vector<string>		line_items;
+	// Read the next block after the unread data; false if the stream is exhausted.
+	// Only n_needed bytes (at most a block) are waited for: the rest of the block
+	// is what the stream already has, so that a pipe is processed as data arrives.
+	bool SentenceReader::fill(size_t n_needed)
+	{
+		if (m_Beg > 0)
+		{
+			if (m_End > m_Beg)
+				memmove(&m_Buf[0], &m_Buf[m_Beg], m_End - m_Beg);
+			m_Scan -= m_Beg;
+			m_End -= m_Beg;
+			m_Beg = 0;
+		}
+		n_needed = min(n_needed, m_BlockSize);
+		if (m_Buf.size() < m_End + m_BlockSize)
+			m_Buf.resize(m_End + m_BlockSize);	// a line longer than a block
 
-		while(true) 
+		char	*dst = &m_Buf[m_End];
+		size_t	n_read = (size_t) m_Is.readsome(dst, (streamsize) m_BlockSize);
+		if (n_read < n_needed)
 		{
-			getline(cin, line);
-			if(line.empty())						// break if a blank line appears
+			m_Is.read(dst + n_read, (streamsize) (n_needed - n_read));
+			n_read += (size_t) m_Is.gcount();
+			if (n_read == n_needed && n_read < m_BlockSize)
+				n_read += (size_t) m_Is.readsome(dst + n_read, (streamsize) (m_BlockSize - n_read));
+
+			if (m_Format == FORMAT_TSV && n_read == 1 && *dst != '\n' && m_BlockSize > 2)
+			{
+				// The stream does not tell what it has (e.g. cin synchronized with stdio):
+				// read up to the end of the line, as getline would
+				if (m_Is.get(dst + 1, (streamsize) (m_BlockSize - 1), '\n'))
+					n_read += (size_t) m_Is.gcount();
+				else if (!m_Is.eof())
+					m_Is.clear();		// an empty line: nothing extracted
+				if (n_read < m_BlockSize && m_Is.peek() == '\n')
+					dst[n_read++] = (char) m_Is.get();
+			}
+		}
+		m_End += n_read;
+
+		return n_read > 0;
+	}
+
+	// Make n_bytes of unread data available; false if the stream ends before
+	bool SentenceReader::ensure(size_t n_bytes)
+	{
+		while (m_End - m_Beg < n_bytes)
+		{
+			if (!fill(n_bytes - (m_End - m_Beg)))
+				return false;
+		}
+		return true;
+	}
+
+	static void bad_record()
+	{
+		cerr << "Error: Input data format: corrupt binary record" << endl;
+		exit(1);
+	}
+
+	// Check the header of a binary input; false if the input is empty
+	bool SentenceReader::read_header()
+	{
+		if (m_HeaderRead)
+			return true;
+		if (!ensure(1))
+			return false;
+
+		size_t	n_magic = strlen(BINARY_MAGIC);
+		if (!ensure(n_magic + 1) || memcmp(&m_Buf[m_Beg], BINARY_MAGIC, n_magic) != 0)
+		{
+			cerr << "Error: Input data format: not a binary NERsuite input" << endl;
+			exit(1);
+		}
+		if (m_Buf[m_Beg + n_magic] != BINARY_VERSION)
+		{
+			cerr << "Error: Input data format: unsupported binary version " << (int) m_Buf[m_Beg + n_magic] << endl;
+			exit(1);
+		}
+		m_Beg = m_Scan = m_Beg + n_magic + 1;
+		m_HeaderRead = true;
+		return true;
+	}
+
+	int SentenceReader::read_record(V2_STR &one_sent, const string &multidoc_separator, bool &separator_read)
+	{
+		separator_read = false;
+		if (!read_header() || !ensure(1))
+		{
+			m_Eof = true;
+			one_sent.clear();
+			return 0;
+		}
+
+		// 1. Type and length of the record
+		const char		*p, *end;
+		unsigned long	length;
+		while (true)
+		{
+			p = &m_Buf[m_Beg] + 1;
+			end = &m_Buf[0] + m_End;
+			if (read_varint(p, end, length))
 				break;
+			if (m_End - m_Beg > 16 || !fill())
+				bad_record();
+		}
+		size_t	n_head = p - &m_Buf[m_Beg];
+		if (!ensure(n_head + length))
+			bad_record();
 
-			tokenize(line_items, line, "\t");		// tokenize and
-			one_sent.push_back(line_items);			// save it
+		char	type = m_Buf[m_Beg];
+		p = &m_Buf[m_Beg + n_head];
+		end = p + length;
+		m_Beg = m_Scan = m_Beg + n_head + length;
 
-			n_lines++;
+		// 2. Comment block
+		unsigned long	n_rows, n_cols, value;
+		if (type == BINARY_COMMENT)
+		{
+			if (!read_varint(p, end, n_rows) || n_rows > length)
+				bad_record();
+			one_sent.resize(n_rows);
+			for (V2_STR::iterator i_row = one_sent.begin(); i_row != one_sent.end(); ++i_row)
+			{
+				if (!read_varint(p, end, value) || value > (unsigned long) (end - p))
+					bad_record();
+				if (multidoc_separator != "")
+				{
+					i_row->resize(1);
+					i_row->front().assign(p, value);
+				}
+				else
+				{
+					split_columns(p, value, *i_row);
+				}
+				p += value;
+			}
+			if (p != end)
+				bad_record();
+
+			m_Strings.clear();		// a new document begins
+			separator_read = (multidoc_separator != "" && n_rows > 0);
+			return (int) n_rows;
 		}
+		if (type != BINARY_SENTENCE)
+			bad_record();
 
-		return n_lines;
+		// 3. Sentence: the widths of the rows, and then the cells column by column
+		if (m_Strings.size() >= BINARY_MAX_STRINGS)
+			m_Strings.clear();
+
+		if (!read_varint(p, end, n_rows) || !read_varint(p, end, n_cols) || p == end || n_cols > length)
+			bad_record();
+		bool	ragged = (*p++ != 0);
+		if (n_rows > length && (ragged || n_cols > 0))
+			bad_record();
+
+		one_sent.resize(n_rows);
+		for (V2_STR::iterator i_row = one_sent.begin(); i_row != one_sent.end(); ++i_row)
+		{
+			if (ragged && (!read_varint(p, end, value) || value > n_cols))
+				bad_record();
+			i_row->resize(ragged ? value : n_cols);
+		}
+
+		char	digits[24];
+		for (size_t col = 0; col < n_cols; ++col)
+		{
+			if (p == end)
+				bad_record();
+			char	col_type = *p++;
+			if (col_type != BINARY_COLUMN_INT && col_type != BINARY_COLUMN_STRING)
+				bad_record();
+
+			for (V2_STR::iterator i_row = one_sent.begin(); i_row != one_sent.end(); ++i_row)
+			{
+				if (col >= i_row->size())
+					continue;
+				if (!read_varint(p, end, value))
+					bad_record();
+
+				string	&cell = (*i_row)[col];
+				if (col_type == BINARY_COLUMN_INT)
+				{
+					char	*d = digits + sizeof(digits);
+					do {
+						*--d = (char) ('0' + value % 10);
+						value /= 10;
+					} while (value > 0);
+					cell.assign(d, digits + sizeof(digits) - d);
+				}
+				else if (value == 0)
+				{
+					if (!read_varint(p, end, value) || value > (unsigned long) (end - p))
+						bad_record();
+					cell.assign(p, value);
+					p += value;
+					m_Strings.push_back(cell);
+				}
+				else
+				{
+					if (value > m_Strings.size())
+						bad_record();
+					cell = m_Strings[value - 1];
+				}
+			}
+		}
+		if (p != end)
+			bad_record();
+
+		return (int) n_rows;
+	}
+
+	bool SentenceReader::read_line(const char *&line, size_t &len)
+	{
+		if (m_BlockSize == 0)
+		{
+			m_Line.clear();		// not cleared by a failed getline
+			bool	extracted = !getline(m_Is, m_Line).fail();
+			m_Eof = m_Is.eof();
+			line = m_Line.data();
+			len = m_Line.length();
+			return extracted;
+		}
+
+		while (true)
+		{
+			const char	*nl = NULL;		// nothing to scan before the first block
+			if (m_Scan < m_End)
+				nl = (const char *) memchr(&m_Buf[0] + m_Scan, '\n', m_End - m_Scan);
+			if (nl != NULL)
+			{
+				line = &m_Buf[m_Beg];
+				len = nl - line;
+				m_Beg = m_Scan = (nl - &m_Buf[0]) + 1;
+				return true;
+			}
+			m_Scan = m_End;
+
+			if (!fill())
+			{
+				// last line without a newline
+				m_Eof = true;
+				line = m_Buf.empty() ? "" : &m_Buf[m_Beg];
+				len = m_End - m_Beg;
+				m_Beg = m_Scan = m_End;
+				return len > 0;
+			}
+		}
+	}
+
+	bool SentenceReader::at_end()
+	{
+		if (m_BlockSize == 0)
+		{
+			return m_Is.peek() == EOF;
+		}
+		if (m_Format == FORMAT_BINARY && !read_header())
+		{
+			m_Eof = true;
+			return true;
+		}
+
+		if (m_Beg == m_End && !fill())
+		{
+			m_Eof = true;
+			return true;
+		}
+		return false;
+	}
+
+	void split_columns(const char *line, size_t len, vector<string> &row)
+	{
+		const char	*beg = line;
+		const char	*end = line + len;
+		size_t		n_cols = 0;
+
+		while (beg < end)
+		{
+			const char	*tab = (const char *) memchr(beg, '\t', end - beg);
+			if (tab == NULL)
+				tab = end;
+
+			if (n_cols < row.size())
+				row[n_cols].assign(beg, tab - beg);
+			else
+				row.push_back(string(beg, tab - beg));
+
+			beg = tab + 1;
+			++n_cols;
+		}
+		row.resize(n_cols);
+	}
+
+	// Retrieve one sentence from input stream.
+	// Each line consists of tab-separated columns (label + feature list).
+	//   First column is the label assigned for the feature list.
+	//   The following columns are the feature list.
+	// Sentence must be terminated with an empty line.
+	int get_sent(istream &cin, V2_STR &one_sent)
+	{
+		SentenceReader	reader(cin, FORMAT_TSV, 0);
+		return get_sent(reader, one_sent);
+	}
+
+	int get_sent(istream &cin, V2_STR &one_sent, const string &multidoc_separator, bool &separator_read)
+	{
+		SentenceReader	reader(cin, FORMAT_TSV, 0);
+		return get_sent(reader, one_sent, multidoc_separator, separator_read);
+	}
+
+	int get_sent(SentenceReader &reader, V2_STR &one_sent)
+	{
+		bool	separator_read;
+		return get_sent(reader, one_sent, "", separator_read);
 	}
 
 	// Functionality: 
@@ -71,16 +373,18 @@ namespace NER
 	//     - # of lines read regardless input type (sentence or comment)
 	// Input:
 	//     - Lines of comments must be separated from a previous (and next) sentence with a blank line
-	int get_sent(istream &cin, V2_STR &one_sent, const string &multidoc_separator, bool &separator_read)
+	int get_sent(SentenceReader &reader, V2_STR &one_sent, const string &multidoc_separator, bool &separator_read)
 	{
-		one_sent.clear();		// clear the container
+		if (reader.get_format() == FORMAT_BINARY)
+			return reader.read_record(one_sent, multidoc_separator, separator_read);
+
 		separator_read = false;
 
 		int              n_lines = 0;
-		string           line = "";
-		vector<string>   line_items;
+		const char       *line;
+		size_t           len;
 		int              mode = 0;    // 0: initialized, 1: sentence, 2: comment
-		int              nSep = multidoc_separator.length();
+		size_t           nSep = multidoc_separator.length();
 		
 		bool             multidoc_mode = false;
 		if( multidoc_separator != "" )
@@ -88,11 +392,15 @@ namespace NER
 
 		while(true) 
 		{
-			getline(cin, line);
-			if(line.empty())						// break if a blank line appears
+			reader.read_line(line, len);
+			if(len == 0)							// break if a blank line appears
 				break;
 
-			if( multidoc_mode && (line.compare(0, nSep, multidoc_separator) == 0) )
+			if( (size_t) n_lines == one_sent.size() )
+				one_sent.push_back(vector<string>());
+			vector<string>   &line_items = one_sent[n_lines];
+
+			if( multidoc_mode && (multidoc_separator.compare(0, nSep, line, min(len, nSep)) == 0) )
 			{
 				if( mode == 1 ) {
 					cerr << "Error: Input data format: multidoc comment lines must be separated from sentences by a blank line" << endl;
@@ -101,9 +409,8 @@ namespace NER
 					mode = 2;
 				}
 
-				line_items.clear();
-				line_items.push_back( line );
-				one_sent.push_back( line_items );   // Add a comment line as it is
+				line_items.resize(1);
+				line_items[0].assign(line, len);   // Add a comment line as it is
 			}else {
 				if( mode == 2 ) {
 					cerr << "Error: Input data format: sentence part must be separated from comment lines by a blank" << endl;
@@ -112,12 +419,12 @@ namespace NER
 					mode = 1;
 				}
 
-				tokenize(line_items, line, "\t");		// tokenize and
-				one_sent.push_back(line_items);			// save it
+				split_columns(line, len, line_items);	// tokenize and save it
 			}
 		
 			n_lines++;
 		}
+		one_sent.resize(n_lines);
 
 		if( mode == 2 ) {
 			separator_read = true;
@@ -126,7 +433,56 @@ namespace NER
 		return n_lines;
 	}
 
-}
+	void parse_dic_hits(const string &column, DIC_HITS &hits)
+	{
+		hits.clear();
+		if (!is_dic_hit_column(column))
+		{
+			return;
+		}
+
+		size_t	beg = 0;
+		while (beg < column.length())
+		{
+			size_t	end = column.find(DIC_HIT_SEPARATOR, beg);
+			if (end == string::npos)
+			{
+				end = column.length();
+			}
 
+			size_t	sep = column.find(DIC_HIT_COLUMN_SEPARATOR, beg);
+			if (sep == string::npos || sep > end)
+			{
+				cerr << "Error: Input data format: malformed dictionary hit \"" << column.substr(beg, end - beg) << "\"" << endl;
+				exit(1);
+			}
+			hits.push_back(make_pair(atoi(column.c_str() + beg), column.substr(sep + 1, end - sep - 1)));
 
+			beg = end + 1;
+		}
+	}
 
+	string format_dic_hits(const DIC_HITS &hits)
+	{
+		if (hits.empty())
+		{
+			return "O";
+		}
+
+		string	column = "";
+		char	chr_idx[16];
+		for (DIC_HITS::const_iterator i = hits.begin(); i != hits.end(); ++i)
+		{
+			if (i != hits.begin())
+			{
+				column += DIC_HIT_SEPARATOR;
+			}
+			sprintf(chr_idx, "%d", i->first);	// not int2str(): nersuite_gtagger does not link string_utils.cpp
+			column += chr_idx;
+			column += DIC_HIT_COLUMN_SEPARATOR;
+			column += i->second;
+		}
+		return column;
+	}
+
+}
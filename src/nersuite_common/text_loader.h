@@ -39,10 +39,106 @@
 #include <string>
 #include <vector>
 
+#include "binary_format.h"
+
 typedef		std::vector< std::vector<std::string> >		V2_STR;
 
+// Sparse dictionary-hit column: "k:B-Class|k2:I-Class", or "O" for no hit
+#define		DIC_HIT_SEPARATOR			'|'
+#define		DIC_HIT_COLUMN_SEPARATOR	':'
+
 namespace NER
 {
+	/** 
+	* @ingroup NERsuite
+	*/
+	/**
+	* Line reader over a stream of tab-separated sentences.
+	*
+	* The input is read in large blocks and the line ends are found with memchr,
+	* so a line costs no more than a scan and no stream extraction or string copy.
+	* A read takes what the stream already holds, up to a block, and only waits
+	* for more when a line is incomplete: sentences coming through a pipe are
+	* returned as they arrive. A stream that does not tell how much it holds
+	* (std::cin synchronized with stdio) is read up to the next line end.
+	* The eof() and at_end() tests mirror std::istream::eof() and
+	* std::istream::peek() == EOF, so read loops can be converted one to one.
+	*
+	* In FORMAT_BINARY, the blocks are read as records (see DataFormat)
+	* by get_sent(); read_line() is for FORMAT_TSV only.
+	*
+	* The reader consumes the stream beyond the current line; use one reader for
+	* the whole input.
+	*/
+	class SentenceReader
+	{
+	public:
+		/**
+		* @param[in] is Input stream
+		* @param[in] format Format of the input
+		* @param[in] block_size Size of a read. 0 reads line by line with std::getline,
+		*  leaving the stream just after the last line returned (FORMAT_TSV only).
+		*/
+		explicit SentenceReader(std::istream &is, DataFormat format = FORMAT_TSV, size_t block_size = 1 << 20);
+
+		DataFormat get_format() const { return m_Format; }
+
+		/**
+		* Read a line without its newline, as std::getline does.
+		* @param[out] line Beginning of the line, valid until the next call
+		* @param[out] len Length of the line
+		* @returns false if nothing was left to read
+		*/
+		bool read_line(const char *&line, size_t &len);
+
+		/**
+		* Test whether a read has reached the end of the input (std::istream::eof()).
+		*/
+		bool eof() const { return m_Eof; }
+
+		/**
+		* Test whether no input is left (std::istream::peek() == EOF). Sets eof() if so.
+		*/
+		bool at_end();
+
+		/**
+		* Read the next record of a FORMAT_BINARY input (see get_sent()).
+		* A comment block is returned as lines if multidoc_separator is given,
+		* and split into columns otherwise, as it is read from FORMAT_TSV.
+		*/
+		int read_record(V2_STR &one_sent, const std::string &multidoc_separator, bool &separator_read);
+
+	private:
+		bool fill(size_t n_needed = 1);
+		bool ensure(size_t n_bytes);
+		bool read_header();
+
+		std::istream		&m_Is;
+		size_t				m_BlockSize;
+		std::vector<char>	m_Buf;
+		size_t				m_Beg;		// beginning of the unread data
+		size_t				m_Scan;		// end of the data scanned for a newline
+		size_t				m_End;		// end of the data read
+		bool				m_Eof;
+		std::string			m_Line;		// line-by-line mode
+		DataFormat			m_Format;
+		bool				m_HeaderRead;
+		std::vector<std::string>	m_Strings;	// string table of the document (FORMAT_BINARY)
+	};
+
+	/** 
+	* @ingroup NERsuite
+	*/
+	/**
+	* Split a line into tab-separated columns as tokenize() does, reusing the
+	* strings already in the row.
+	*
+	* @param[in] line Beginning of the line
+	* @param[in] len Length of the line
+	* @param[out] row Columns of the line
+	*/
+	extern void split_columns(const char *line, size_t len, std::vector<std::string> &row);
+
 	/** 
 	* @ingroup NERsuite
 	*/
@@ -82,6 +178,72 @@ namespace NER
 	*/
 	extern int get_sent(std::istream &cin, V2_STR &one_sent, const std::string &multidoc_separator, bool &separator_read);
 
+	/** 
+	* @ingroup NERsuite
+	*/
+	/**
+	* Read a sentence with a SentenceReader (see get_sent(std::istream &, V2_STR &)).
+	* The rows of one_sent are reused to save allocations.
+	*/
+	extern int get_sent(SentenceReader &reader, V2_STR &one_sent);
+
+	/** 
+	* @ingroup NERsuite
+	*/
+	/**
+	* Read a sentence or multidoc comment lines with a SentenceReader
+	* (see get_sent(std::istream &, V2_STR &, const std::string &, bool &)).
+	* The rows of one_sent are reused to save allocations.
+	*/
+	extern int get_sent(SentenceReader &reader, V2_STR &one_sent, const std::string &multidoc_separator, bool &separator_read);
+
+	/** 
+	* @ingroup NERsuite
+	*/
+	/**
+	* Dictionary hits of a token: pairs of a dictionary column (0 for the first
+	* class of the first dictionary) and its value (e.g. "B-Gene"), in column order.
+	*/
+	typedef		std::vector< std::pair<int, std::string> >	DIC_HITS;
+
+	/** 
+	* @ingroup NERsuite
+	*/
+	/**
+	* Test whether a column is a sparse dictionary-hit column with at least one hit.
+	* The columns of the dense format (one per class) begin with "B-", "I-" or "O".
+	*
+	* @param[in] column Column value
+	* @returns true if the column lists dictionary hits
+	*/
+	inline bool is_dic_hit_column(const std::string &column)
+	{
+		return !column.empty() && column[0] >= '0' && column[0] <= '9';
+	}
+
+	/** 
+	* @ingroup NERsuite
+	*/
+	/**
+	* Parse a sparse dictionary-hit column.
+	*
+	* @param[in] column Column value ("O" if no hit)
+	* @param[out] hits Dictionary hits in the column.
+	*  Any existing contents are cleared before processing.
+	*/
+	extern void parse_dic_hits(const std::string &column, DIC_HITS &hits);
+
+	/** 
+	* @ingroup NERsuite
+	*/
+	/**
+	* Make a sparse dictionary-hit column.
+	*
+	* @param[in] hits Dictionary hits of a token, in column order
+	* @returns Column value ("O" if no hit)
+	*/
+	extern std::string format_dic_hits(const DIC_HITS &hits);
+
 }
 
 #endif
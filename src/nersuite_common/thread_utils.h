@@ -0,0 +1,190 @@
+/*
+*      NERSuite
+*      Thread utilities
+*
+* Copyright (c)
+* All rights reserved.
+*
+* Redistribution and use in source and binary forms, with or without
+* modification, are permitted provided that the following conditions are met:
+*     * Redistributions of source code must retain the above copyright
+*       notice, this list of conditions and the following disclaimer.
+*     * Redistributions in binary form must reproduce the above copyright
+*       notice, this list of conditions and the following disclaimer in the
+*       documentation and/or other materials provided with the distribution.
+*     * Neither the names of the authors nor the names of its contributors
+*       may be used to endorse or promote products derived from this
+*       software without specific prior written permission.
+*
+* THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+* "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+* LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+* A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER
+* OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+* EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+* PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+* PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+* LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+* NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+* SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef		_THREAD_UTILS_H
+#define		_THREAD_UTILS_H
+
+#ifdef _WIN32
+#include <windows.h>
+#include <process.h>
+#else
+#include <pthread.h>
+#endif
+
+#include <vector>
+
+namespace NER
+{
+	/**
+	* @ingroup NERsuite
+	*/
+	/**
+	* A non-recursive mutex (pthread mutex, or a critical section on Windows).
+	*/
+	class Mutex
+	{
+	private:
+#ifdef _WIN32
+		CRITICAL_SECTION	cs;
+#else
+		pthread_mutex_t		mtx;
+#endif
+
+		Mutex(const Mutex&);
+		Mutex& operator=(const Mutex&);
+
+	public:
+#ifdef _WIN32
+		Mutex() { InitializeCriticalSection(&cs); }
+		~Mutex() { DeleteCriticalSection(&cs); }
+		void lock() { EnterCriticalSection(&cs); }
+		void unlock() { LeaveCriticalSection(&cs); }
+#else
+		Mutex() { pthread_mutex_init(&mtx, NULL); }
+		~Mutex() { pthread_mutex_destroy(&mtx); }
+		void lock() { pthread_mutex_lock(&mtx); }
+		void unlock() { pthread_mutex_unlock(&mtx); }
+#endif
+	};
+
+	/**
+	* @ingroup NERsuite
+	*/
+	/**
+	* Holds a lock on a Mutex for the lifetime of the object.
+	*/
+	class ScopedLock
+	{
+	private:
+		Mutex	&m;
+
+		ScopedLock(const ScopedLock&);
+		ScopedLock& operator=(const ScopedLock&);
+
+	public:
+		explicit ScopedLock(Mutex &mutex) : m(mutex) { m.lock(); }
+		~ScopedLock() { m.unlock(); }
+	};
+
+	/**
+	* @ingroup NERsuite
+	*/
+	/**
+	* Thread entry point. The argument is the pointer given to run_threads().
+	*/
+	typedef void (*THREAD_FUNC)(void *arg);
+
+	namespace detail
+	{
+		struct ThreadStart
+		{
+			THREAD_FUNC		func;
+			void			*arg;
+		};
+
+#ifdef _WIN32
+		inline unsigned __stdcall thread_start(void *p)
+		{
+			ThreadStart *ts = static_cast<ThreadStart*>(p);
+			ts->func(ts->arg);
+			return 0;
+		}
+#else
+		inline void* thread_start(void *p)
+		{
+			ThreadStart *ts = static_cast<ThreadStart*>(p);
+			ts->func(ts->arg);
+			return NULL;
+		}
+#endif
+	}
+
+	/**
+	* @ingroup NERsuite
+	*/
+	/**
+	* Run func(arg) on n_threads threads and wait until all of them return.
+	*
+	* With n_threads <= 1, func is simply called on the current thread.
+	* If a thread cannot be created, its share of the work is run on the
+	* current thread after the others have been started, so the call always
+	* completes the same amount of work.
+	*
+	* @param[in] n_threads Number of threads
+	* @param[in] func Entry point shared by all threads
+	* @param[in] arg Argument passed to every invocation of func
+	*/
+	inline void run_threads(int n_threads, THREAD_FUNC func, void *arg)
+	{
+		if (n_threads <= 1) {
+			func(arg);
+			return;
+		}
+
+		detail::ThreadStart		ts;
+		ts.func = func;
+		ts.arg = arg;
+
+		int		n_failed = 0;
+#ifdef _WIN32
+		std::vector<HANDLE>		threads;
+		for (int i = 0; i < n_threads; ++i) {
+			uintptr_t	h = _beginthreadex(NULL, 0, detail::thread_start, &ts, 0, NULL);
+			if (h == 0)
+				++n_failed;
+			else
+				threads.push_back((HANDLE) h);
+		}
+		for (int i = 0; i < n_failed; ++i)
+			func(arg);
+		for (size_t i = 0; i < threads.size(); ++i) {
+			WaitForSingleObject(threads[i], INFINITE);
+			CloseHandle(threads[i]);
+		}
+#else
+		std::vector<pthread_t>	threads;
+		for (int i = 0; i < n_threads; ++i) {
+			pthread_t	th;
+			if (pthread_create(&th, NULL, detail::thread_start, &ts) != 0)
+				++n_failed;
+			else
+				threads.push_back(th);
+		}
+		for (int i = 0; i < n_failed; ++i)
+			func(arg);
+		for (size_t i = 0; i < threads.size(); ++i)
+			pthread_join(threads[i], NULL);
+#endif
+	}
+}
+
+#endif
+
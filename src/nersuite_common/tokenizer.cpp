@@ -33,108 +33,85 @@ using namespace std;
 
 namespace NER
 {
-	int Tokenizer::tokenize( const string &raw_sent, V2_STR &data, const size_t init_offset ) 
+	namespace
 	{
-		string	trimmed_sent = trim_ws( raw_sent );		
-
-		if( trimmed_sent == "") {
-			return 0;
-		}else {
-			int	n_tokens = splitter( trimmed_sent, data );
-			mark_pos( raw_sent, data, init_offset );
+		enum ByteClass
+		{
+			ByteSpace = 0,		// token separator, never emitted
+			ByteWord,			// ASCII alphanumeric, runs form one token
+			ByteDelim			// anything else, always a token on its own
+		};
+
+		// Byte classification table, equivalent to the former
+		// ' ' / isalnum() tests in the "C" locale
+		struct ByteClassTable
+		{
+			unsigned char	cls[256];
+
+			ByteClassTable()
+			{
+				for( int c = 0; c < 256; ++c ) {
+					cls[c] = ByteDelim;
+				}
+				for( int c = '0'; c <= '9'; ++c ) {
+					cls[c] = ByteWord;
+				}
+				for( int c = 'A'; c <= 'Z'; ++c ) {
+					cls[c] = ByteWord;
+					cls[c - 'A' + 'a'] = ByteWord;
+				}
+				cls[(unsigned char) ' '] = ByteSpace;
+			}
+		};
 
-			return	n_tokens;
-		}
+		const ByteClassTable	byte_class;
 	}
 
-	int Tokenizer::splitter( const string &trimmed_sent, V2_STR &data )
+	int Tokenizer::tokenize( const string &raw_sent, V1_SPAN &spans )
 	{
-		size_t	beg = 0, end = find_token_end( trimmed_sent, 0 ), n_tokens = 0;
+		const unsigned char	*s = (const unsigned char *) raw_sent.data();
+		const unsigned char	*cls = byte_class.cls;
+		size_t	len = raw_sent.length(), i = 0;
+		int		n_tokens = 0;
 
-		V1_STR	one_row;
-		one_row.push_back( "token" );		
+		while( i < len ) {
+			unsigned char	c = cls[ s[i] ];
 
-		while( end != string::npos ) {
-			string	token = trimmed_sent.substr( beg, end - beg );
+			if( c == ByteSpace ) {
+				++i;
+				continue;
+			}
 
-			if( token != " " ) {				// Put all tokens except a space token into the 'data' container
-				one_row.back() = token;
-				data.push_back( one_row );
-				++n_tokens;
+			size_t	beg = i++;
+			if( c == ByteWord ) {
+				while( ( i < len ) && ( cls[ s[i] ] == ByteWord ) )
+					++i;
 			}
 
-			beg = end;
-			end = find_token_end( trimmed_sent, beg );
+			spans.push_back( TOKEN_SPAN( beg, i ) );
+			++n_tokens;
 		}
 
 		return n_tokens;
 	}
 
-	void Tokenizer::mark_pos( const string &raw_sent, V2_STR &data, const size_t init_offset ) 
-	{
-		size_t	beg = 0, end = 0;
-		char	chr_pos[128];
-
-		for( V2_STR::iterator i_row = data.begin(); i_row != data.end(); ++i_row ) {
-			beg = raw_sent.find_first_of( i_row->back(), end );
-			end = beg + i_row->back().length();
-
-			sprintf(chr_pos, "%d", init_offset + beg);
-			i_row->insert( i_row->end() - 1, chr_pos );
-
-			sprintf(chr_pos, "%d", init_offset + end);
-			i_row->insert( i_row->end() - 1, chr_pos );
-		}	
-	}
-
-
-	// Trim left and right hand side spaces, and squeeze all continuous spaces into a single space within a sentence
-	string Tokenizer::trim_ws( const string &raw_sent )
+	int Tokenizer::tokenize( const string &raw_sent, V2_STR &data, const size_t init_offset ) 
 	{
-		string	trimmed_sent = raw_sent;
-		int	idx = 0;
-
-		// 1. Trim LHS spaces
-		int	sent_len = (int) trimmed_sent.length();
-		for(; idx < sent_len; ++idx) {
-			if(trimmed_sent[ idx ] != ' ')
-				break;
-		}
-		if(idx == trimmed_sent.length()) {			// If a string has only space(s)
-			trimmed_sent = "";
-		}else {
-			trimmed_sent = trimmed_sent.substr(idx, string::npos);
-		}
-
-		// 2. Trim RHS spaces
-		sent_len = (int) trimmed_sent.length();
-		if(sent_len > 0) {
-			for(idx = sent_len - 1; idx >= 0; --idx) {
-				if(trimmed_sent[ idx ] != ' ')
-					break;
-			}
-			trimmed_sent = trimmed_sent.substr(0, sent_len + 1);
+		spans.clear();
+		int		n_tokens = tokenize( raw_sent, spans );
+		char	chr_pos[32];
+
+		V1_STR	one_row( 3 );
+		for( V1_SPAN::const_iterator i_span = spans.begin(); i_span != spans.end(); ++i_span ) {
+			sprintf( chr_pos, "%lu", (unsigned long) ( init_offset + i_span->first ) );
+			one_row[0] = chr_pos;
+			sprintf( chr_pos, "%lu", (unsigned long) ( init_offset + i_span->second ) );
+			one_row[1] = chr_pos;
+			one_row[2].assign( raw_sent, i_span->first, i_span->second - i_span->first );
+			data.push_back( one_row );
 		}
 
-		return trimmed_sent;
-	}
-
-	// Find the past the end position for a next token
-	size_t Tokenizer::find_token_end( const string &trimmed_sent, const size_t beg )
-	{
-		size_t	max = trimmed_sent.length();
-
-		if( beg == max ) {										// Case 1. all characters are processed
-			return string::npos;
-		}else if( ( trimmed_sent[ beg ] == ' ' ) || ( isalnum( trimmed_sent[ beg ] ) == 0 ) ) {		// Case 2. the current character is a delimiter character
-			return beg + 1;
-		}else {												// Case 3. find the position of a next delimiter character
-			for( size_t i = beg; i < max; ++i )
-				if( ( trimmed_sent[ i ] == ' ' ) || ( isalnum( trimmed_sent[ i ] ) == 0 ) )
-					return i;
-			return max;
-		}
+		return n_tokens;
 	}
 
 }
-
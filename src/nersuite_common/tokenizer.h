@@ -33,6 +33,7 @@
 #include <iostream>
 #include <string>
 #include <vector>
+#include <utility>
 #include <stdlib.h>
 #include <stdio.h>
 
@@ -41,20 +42,30 @@ namespace NER
 	typedef	std::vector< std::string >	V1_STR;
 	typedef	std::vector< V1_STR >		V2_STR;
 
+	/** (begin_pos, end_pos) byte offsets of a token in the raw sentence */
+	typedef	std::pair< size_t, size_t >	TOKEN_SPAN;
+	typedef	std::vector< TOKEN_SPAN >	V1_SPAN;
+
 	/** 
 	* @ingroup NERsuite
 	* Tokenizer Utility
+	*
+	* A token is either a maximal run of ASCII alphanumeric characters or a
+	* single other character; space characters separate tokens and are
+	* dropped. The raw sentence is scanned once and every byte is classified
+	* through a lookup table, so offsets come out directly and no token
+	* string is built unless the caller asks for one.
 	*/
 	class Tokenizer
 	{
-	private:
-		int splitter( const std::string &trimmed_sent, V2_STR &data );
-		void mark_pos( const std::string &raw_sent, V2_STR &data, size_t init_offset = 0 );
-
-		std::string trim_ws( const std::string &raw_sent );
-		size_t find_token_end( const std::string &trimmed_sent, const size_t beg );
-
 	public:
+		/** Tokenize input text and generate the (begin_pos, end_pos) offsets of each token.
+		* @param[in] raw_sent Input sentence
+		* @param[in,out] spans A vector to store the result (appended to)
+		* @returns the count of tokens generated.
+		*/
+		int tokenize( const std::string &raw_sent, V1_SPAN &spans );
+
 		/** Tokenize input text and generate the (begin_pos, end_pos, token) triplet for each token.
 		* @param[in] raw_sent Input sentence
 		* @param[in,out] data A vector to store the result
@@ -63,6 +74,8 @@ namespace NER
 		*/
 		int tokenize( const std::string &raw_sent, V2_STR &data, size_t init_offset = 0 );
 
+	private:
+		V1_SPAN	spans;
 	};
 }
 
@@ -3,6 +3,8 @@
 
 #include <string>
 #include <fstream>
+#include <iterator>
+#include <math.h>
 #include "../nersuite_common/dictionary.h"
 
 using namespace std;
@@ -266,4 +268,353 @@ void TestDictionaryBuild_TokenizerNormalization()
 
 
 }
+
+void TestDictionary_AppendNormalizedKey()
+{
+	const int	normalize_type = NormalizeCase | NormalizeNumber | NormalizeSymbol;
+	const char*	pieces[] = { "IL", "-", "12", "34", " ", "(", "Alpha", ")", "5" };
+
+	string		raw = "", key = "";
+	for (size_t i = 0; i < sizeof(pieces) / sizeof(pieces[0]); ++i)
+	{
+		raw += pieces[i];
+		Dictionary::append_normalized_key(key, Dictionary::normalize_key(pieces[i], normalize_type), normalize_type);
+	}
+	if (key != Dictionary::normalize_key(raw, normalize_type))
+		throw new TestException("assert failed", __FILE__, __LINE__);
+	if (key != "il_0_alpha_0")
+		throw new TestException("assert failed", __FILE__, __LINE__);
+
+	key = "";
+	Dictionary::append_normalized_key(key, Dictionary::normalize_key("12", NormalizeNone), NormalizeNone);
+	Dictionary::append_normalized_key(key, Dictionary::normalize_key("34", NormalizeNone), NormalizeNone);
+	if (key != "1234")
+		throw new TestException("assert failed", __FILE__, __LINE__);
+}
+void TestDictionary_KeyLengthIndex()
+{
+	PrepareDictionaryTestData(DICTIONARY_TEST_TEXT_FILE);
+	Dictionary dict(DICTIONARY_TEST_DB_FILE);
+	dict.build(DICTIONARY_TEST_TEXT_FILE, NormalizeNone);
+	dict.open();
+
+	if (!dict.has_key_length_index())
+		throw new TestException("assert failed", __FILE__, __LINE__);
+
+	// "SampleEntry" and "SampleEntry SampleEntry1 SampleEntry2"
+	const char*	key = "SampleEntry SampleEntry1";
+	size_t		head_len = Dictionary::key_head_length(key, strlen(key));
+	if (head_len != 11)
+		throw new TestException("assert failed", __FILE__, __LINE__);
+
+	size_t		count;
+	const int*	lengths = dict.get_key_lengths(key, head_len, &count);
+	if (lengths == NULL || count != 2)
+		throw new TestException("assert failed", __FILE__, __LINE__);
+	if (lengths[0] != 11 || lengths[1] != 37)
+		throw new TestException("assert failed", __FILE__, __LINE__);
+
+	// "S_a!m..." begins with a one-character head
+	lengths = dict.get_key_lengths("S_", Dictionary::key_head_length("S_", 2), &count);
+	if (lengths == NULL || count != 1)
+		throw new TestException("assert failed", __FILE__, __LINE__);
+
+	if (dict.get_key_lengths("Sample", 6, &count) != NULL)
+		throw new TestException("assert failed", __FILE__, __LINE__);
+}
+
+void TestDictionary_BatchLookup()
+{
+	PrepareDictionaryTestData(DICTIONARY_TEST_TEXT_FILE);
+	Dictionary dict(DICTIONARY_TEST_DB_FILE);
+	dict.build(DICTIONARY_TEST_TEXT_FILE, NormalizeNone);
+	dict.open();
+
+	// More keys than one batch window, hits and misses mixed
+	const char*	keys[] = {"SampleEntry", "Sample", "S0a1m2p3l4e5E6n7t8r9y", "", "SampleEntry SampleEntry1 SampleEntry2"};
+	vector<ClassQuery>	queries(40);
+	for (size_t i = 0; i < queries.size(); ++i)
+	{
+		queries[i].key = keys[i % 5];
+		queries[i].key_len = strlen(keys[i % 5]);
+	}
+	dict.get_normalized_classes_batch(&queries[0], queries.size());
+
+	for (size_t i = 0; i < queries.size(); ++i)
+	{
+		size_t		count;
+		const int*	classes = dict.get_normalized_classes(queries[i].key, queries[i].key_len, &count);
+		if (queries[i].classes != classes || queries[i].count != count)
+			throw new TestException("assert failed", __FILE__, __LINE__);
+	}
+	if (queries[0].classes == NULL || queries[0].count != 3 || queries[1].classes != NULL || queries[1].count != 0)
+		throw new TestException("assert failed", __FILE__, __LINE__);
+}
+
+void TestDictionary_ClassSets()
+{
+	{
+		ofstream ofs(DICTIONARY_TEST_TEXT_FILE);
+		ofs << "EntryA\tGene\tProtein" << endl;
+		ofs << "EntryB\tGene\tProtein" << endl;
+		ofs << "EntryC\tProtein\tGene" << endl;
+		ofs << "EntryD\tGene" << endl;
+		ofs << "EntryE" << endl;
+	}
+	Dictionary dict(DICTIONARY_TEST_DB_FILE);
+	dict.build(DICTIONARY_TEST_TEXT_FILE, NormalizeNone);
+	dict.open();
+
+	// Keys with the same class list share one copy of it
+	size_t count_a, count_b, count_c, count_d, count_e;
+	const int* classes_a = dict.get_classes("EntryA", NormalizeNone, &count_a);
+	const int* classes_b = dict.get_classes("EntryB", NormalizeNone, &count_b);
+	const int* classes_c = dict.get_classes("EntryC", NormalizeNone, &count_c);
+	const int* classes_d = dict.get_classes("EntryD", NormalizeNone, &count_d);
+	const int* classes_e = dict.get_classes("EntryE", NormalizeNone, &count_e);
+	if (classes_a == NULL || classes_a != classes_b || count_a != 2 || count_b != 2)
+		throw new TestException("assert failed", __FILE__, __LINE__);
+
+	// The order of the classes is kept
+	if (classes_c == NULL || classes_c == classes_a || count_c != 2 || classes_c[0] != classes_a[1] || classes_c[1] != classes_a[0])
+		throw new TestException("assert failed", __FILE__, __LINE__);
+	if (classes_d == NULL || count_d != 1 || dict.get_class_name(classes_d[0]) != "Gene")
+		throw new TestException("assert failed", __FILE__, __LINE__);
+
+	// A key without classes is found, with no class
+	if (classes_e == NULL || count_e != 0)
+		throw new TestException("assert failed", __FILE__, __LINE__);
+	if (dict.get_classes("EntryF", NormalizeNone, &count_e) != NULL)
+		throw new TestException("assert failed", __FILE__, __LINE__);
+}
+
+struct CacheTestArgs
+{
+	const Dictionary*	dict;
+	Mutex				lock;
+	int					n_errors;
+};
+
+void CacheTestThread(void* arg)
+{
+	CacheTestArgs*	args = static_cast<CacheTestArgs*>(arg);
+	const char*		keys[] = {"SampleEntry", "Sample", "S0a1m2p3l4e5E6n7t8r9y", "SampleEntry SampleEntry1 SampleEntry2"};
+	size_t			counts[] = {3, 0, 3, 3};
+
+	int		n_errors = 0;
+	for (int i = 0; i < 10000; ++i)
+	{
+		size_t		count;
+		const int*	classes = args->dict->get_normalized_classes(keys[i % 4], strlen(keys[i % 4]), &count);
+		if ((classes == NULL) != (counts[i % 4] == 0) || count != counts[i % 4])
+			++n_errors;
+	}
+
+	ScopedLock	lock(args->lock);
+	args->n_errors += n_errors;
+}
+
+void TestDictionary_Cache()
+{
+	PrepareDictionaryTestData(DICTIONARY_TEST_TEXT_FILE);
+	Dictionary dict(DICTIONARY_TEST_DB_FILE);
+	dict.build(DICTIONARY_TEST_TEXT_FILE, NormalizeNone);
+	dict.open();
+
+	size_t count;
+	const int* classes = dict.get_classes("SampleEntry", NormalizeNone, &count);
+	CacheStats stats = dict.get_cache_stats();
+	if (stats.lookups != 0 || stats.hits != 0)
+		throw new TestException("assert failed", __FILE__, __LINE__);
+
+	// Found and missing keys are both cached
+	dict.enable_cache(2);
+	if (dict.get_classes("SampleEntry", NormalizeNone, &count) != classes || count != 3)
+		throw new TestException("assert failed", __FILE__, __LINE__);
+	if (dict.get_classes("SampleEntry", NormalizeNone, &count) != classes || count != 3)
+		throw new TestException("assert failed", __FILE__, __LINE__);
+	if (dict.get_classes("Sample", NormalizeNone, &count) != NULL || count != 0)
+		throw new TestException("assert failed", __FILE__, __LINE__);
+	if (dict.get_classes("Sample", NormalizeNone, &count) != NULL || count != 0)
+		throw new TestException("assert failed", __FILE__, __LINE__);
+	stats = dict.get_cache_stats();
+	if (stats.lookups != 4 || stats.hits != 2)
+		throw new TestException("assert failed", __FILE__, __LINE__);
+
+	// Batch lookups use the cache too
+	ClassQuery	queries[2];
+	queries[0].key = "SampleEntry";
+	queries[0].key_len = 11;
+	queries[1].key = "SampleEntry1";
+	queries[1].key_len = 12;
+	dict.get_normalized_classes_batch(queries, 2);
+	if (queries[0].classes != classes || queries[0].count != 3 || queries[1].classes != NULL)
+		throw new TestException("assert failed", __FILE__, __LINE__);
+	stats = dict.get_cache_stats();
+	if (stats.lookups != 6 || stats.hits != 3)
+		throw new TestException("assert failed", __FILE__, __LINE__);
+
+	// Shared by threads
+	dict.enable_cache(16);
+	CacheTestArgs	args;
+	args.dict = &dict;
+	args.n_errors = 0;
+	run_threads(4, CacheTestThread, &args);
+	stats = dict.get_cache_stats();
+	if (args.n_errors != 0 || stats.lookups != 40000 || stats.hits > stats.lookups)
+		throw new TestException("assert failed", __FILE__, __LINE__);
+}
+
+void TestDictionary_Offset64()
+{
+	// The same records in a chunk with 64-bit offsets followed by one with 32-bit offsets
+	{
+		ofstream ofs(DICTIONARY_TEST_DB_FILE, ios_base::binary);
+		for (int offset64 = 1; offset64 >= 0; --offset64)
+		{
+			cdbpp::builder dbw(ofs, offset64 != 0);
+			for (int i = 0; i < 1000; ++i)
+			{
+				string key = "key" + int2str(i);
+				dbw.put(key.c_str(), key.length(), &i, sizeof(int));
+			}
+		}
+	}
+
+	ifstream ifs(DICTIONARY_TEST_DB_FILE, ios_base::binary);
+	cdbpp::cdbpp	wide, narrow;
+	wide.open(ifs);
+	narrow.open(ifs);
+	if (!wide.is_open() || !wide.offset64() || !narrow.is_open() || narrow.offset64())
+		throw new TestException("assert failed", __FILE__, __LINE__);
+	if (wide.size() != 1000 || narrow.size() != 1000)
+		throw new TestException("assert failed", __FILE__, __LINE__);
+
+	for (int i = 0; i < 1000; ++i)
+	{
+		string key = "key" + int2str(i);
+		size_t vsize;
+		const int* value = (const int*)wide.get(key.c_str(), key.length(), &vsize);
+		if (value == NULL || vsize != sizeof(int) || *value != i)
+			throw new TestException("assert failed", __FILE__, __LINE__);
+		value = (const int*)narrow.get(key.c_str(), key.length(), &vsize);
+		if (value == NULL || vsize != sizeof(int) || *value != i)
+			throw new TestException("assert failed", __FILE__, __LINE__);
+	}
+	if (wide.get("key1000", 7, NULL) != NULL)
+		throw new TestException("assert failed", __FILE__, __LINE__);
+
+	if (cdbpp::builder::needs_offset64(1000, 10000) || !cdbpp::builder::needs_offset64(1000, 0x100000000ULL))
+		throw new TestException("assert failed", __FILE__, __LINE__);
+}
+
+void TestDictionary_ApproximateMatching()
+{
+	PrepareDictionaryTestData(DICTIONARY_TEST_TEXT_FILE);
+	Dictionary dict(DICTIONARY_TEST_DB_FILE);
+	dict.build(DICTIONARY_TEST_TEXT_FILE, NormalizeNone, 3);
+	dict.open();
+
+	if (!dict.has_ngram_index())
+		throw new TestException("assert failed", __FILE__, __LINE__);
+
+	vector<SimilarKey> results;
+
+	// An exact key is the most similar one
+	if (dict.get_similar_keys("SampleEntry", 11, SimilarityCosine, 0.5, results) != 1)
+		throw new TestException("assert failed", __FILE__, __LINE__);
+	if (string(results[0].key, results[0].key_len) != "SampleEntry" || results[0].sim != 1.0)
+		throw new TestException("assert failed", __FILE__, __LINE__);
+
+	// "SampleEntri" shares 10 of its 13 trigrams with the 13 of "SampleEntry"
+	if (dict.get_similar_keys("SampleEntri", 11, SimilarityCosine, 0.7, results) != 1)
+		throw new TestException("assert failed", __FILE__, __LINE__);
+	if (string(results[0].key, results[0].key_len) != "SampleEntry" || fabs(results[0].sim - 10.0 / 13.0) > 1e-9)
+		throw new TestException("assert failed", __FILE__, __LINE__);
+
+	if (dict.get_similar_keys("SampleEntri", 11, SimilarityJaccard, 0.7, results) != 0)
+		throw new TestException("assert failed", __FILE__, __LINE__);
+	if (dict.get_similar_keys("SampleEntri", 11, SimilarityJaccard, 0.6, results) != 1)
+		throw new TestException("assert failed", __FILE__, __LINE__);
+	if (fabs(results[0].sim - 10.0 / 16.0) > 1e-9)
+		throw new TestException("assert failed", __FILE__, __LINE__);
+
+	if (dict.get_similar_keys("SampleEntri", 11, SimilarityCosine, 0.8, results) != 0)
+		throw new TestException("assert failed", __FILE__, __LINE__);
+
+	// Without the option, no n-gram index is built
+	dict.build(DICTIONARY_TEST_TEXT_FILE, NormalizeNone);
+	Dictionary exact_dict(DICTIONARY_TEST_DB_FILE);
+	exact_dict.open();
+	if (exact_dict.has_ngram_index())
+		throw new TestException("assert failed", __FILE__, __LINE__);
+}
+
+static const char* DICTIONARY_TEST_DELTA_TEXT_FILE = "dictionary_test_delta.txt";
+static const char* DICTIONARY_TEST_DELTA_DB_FILE = "dictionary_test_delta.cdbpp";
+static const char* DICTIONARY_TEST_MERGED_DB_FILE = "dictionary_test_merged.cdbpp";
+
+string ReadDictionaryTestFile(const char* filename)
+{
+	ifstream ifs(filename, ios_base::binary);
+	return string(istreambuf_iterator<char>(ifs), istreambuf_iterator<char>());
+}
+
+void TestDictionary_Delta()
+{
+	PrepareDictionaryTestData(DICTIONARY_TEST_TEXT_FILE);
+	{
+		ofstream ofs(DICTIONARY_TEST_DELTA_TEXT_FILE);
+		ofs << "SampleEntry\tAClass\tClass1" << endl;
+		ofs << "NewEntry\tClass2" << endl;
+	}
+	Dictionary base(DICTIONARY_TEST_DB_FILE);
+	base.build(DICTIONARY_TEST_TEXT_FILE, NormalizeNone);
+	Dictionary delta(DICTIONARY_TEST_DELTA_DB_FILE);
+	delta.build(DICTIONARY_TEST_DELTA_TEXT_FILE, NormalizeNone);
+
+	Dictionary dict(DICTIONARY_TEST_DB_FILE);
+	dict.add_delta(DICTIONARY_TEST_DELTA_DB_FILE);
+	dict.open();
+	size_t count;
+
+	// The new class is added to the class set, in the first column
+	if (dict.get_class_count() != 10)
+		throw new TestException("assert failed", __FILE__, __LINE__);
+
+	const int* classes = dict.get_classes("SampleEntry", NormalizeNone, &count);
+	if (count != 4)
+		throw new TestException("assert failed", __FILE__, __LINE__);
+	if (dict.get_class_name(classes[0]) != "Class1" || dict.get_class_name(classes[2]) != "Class3")
+		throw new TestException("assert failed", __FILE__, __LINE__);
+	if (dict.get_class_name(classes[3]) != "AClass" || dict.get_class_column(classes[3]) != 0)
+		throw new TestException("assert failed", __FILE__, __LINE__);
+	if (dict.get_class_column(classes[0]) != 1)
+		throw new TestException("assert failed", __FILE__, __LINE__);
+
+	classes = dict.get_classes("NewEntry", NormalizeNone, &count);
+	if (count != 1 || dict.get_class_name(classes[0]) != "Class2")
+		throw new TestException("assert failed", __FILE__, __LINE__);
+
+	classes = dict.get_classes("S0a1m2p3l4e5E6n7t8r9y", NormalizeNone, &count);
+	if (count != 3 || dict.get_class_name(classes[1]) != "Class4")
+		throw new TestException("assert failed", __FILE__, __LINE__);
+
+	// The key length index covers the keys of the delta
+	const int* lengths = dict.get_key_lengths("NewEntry", 8, &count);
+	if (lengths == NULL || count != 1 || lengths[0] != 8)
+		throw new TestException("assert failed", __FILE__, __LINE__);
+
+	// Merging gives the same database as building from the concatenated text
+	vector<string> deltas(1, DICTIONARY_TEST_DELTA_DB_FILE);
+	Dictionary merged(DICTIONARY_TEST_MERGED_DB_FILE);
+	merged.merge(DICTIONARY_TEST_DB_FILE, deltas);
+	{
+		ofstream ofs(DICTIONARY_TEST_TEXT_FILE, ios_base::app);
+		ofs << ReadDictionaryTestFile(DICTIONARY_TEST_DELTA_TEXT_FILE);
+	}
+	base.build(DICTIONARY_TEST_TEXT_FILE, NormalizeNone);
+	if (ReadDictionaryTestFile(DICTIONARY_TEST_MERGED_DB_FILE) != ReadDictionaryTestFile(DICTIONARY_TEST_DB_FILE))
+		throw new TestException("assert failed", __FILE__, __LINE__);
+}
 #endif
@@ -7,6 +7,7 @@
 #include "TestUtil.h"
 #include "../nersuite/FExtor.h"
 #include "fext_helper.h"
+#include "../nersuite_common/text_loader.h"
 
 using namespace std;
 using namespace NER;
@@ -693,4 +694,68 @@ void TestFExtorChunkFeature()
 	}
 }
 
+void TestFExtorDicFeature_Sparse()
+{
+	COLUMN_INFO cinfo;
+	SetupColumnInfoHelper(cinfo);
+
+	FeatureExtractor fex(cinfo);
+
+	// Hits of 4 dictionary columns in the dense and the sparse format
+	const char* dense_dics[6][4] = {
+		{ "O", "O", "O", "O" },
+		{ "B-Gene", "O", "O", "B-Chemical" },
+		{ "I-Gene", "O", "O", "O" },
+		{ "O", "O", "O", "O" },
+		{ "O", "O", "O", "O" },
+		{ "O", "O", "B-Gene", "O" },
+	};
+	const char* sparse_dics[6] = { "O", "0:B-Gene|3:B-Chemical", "0:I-Gene", "O", "O", "2:B-Gene" };
+	const char* words[6] = { "The", "IL-2", "gene", "is", "in", "p53" };
+
+	V2_STR dense_sent, sparse_sent;
+	for (int i = 0; i < 6; i++)
+	{
+		dense_sent.push_back(CreateWordHelper("0", "1", words[i], words[i], "NN", "O", dense_dics[i][0]));
+		for (int k = 1; k < 4; k++)
+		{
+			dense_sent.back().push_back(dense_dics[i][k]);
+		}
+		sparse_sent.push_back(CreateWordHelper("0", "1", words[i], words[i], "NN", "O", sparse_dics[i]));
+	}
+
+	V2_STR dense_feats(6), sparse_feats(6);
+	// Test target function
+	fex.ext_DIC_feats(dense_sent, dense_feats, 0);
+	fex.ext_DIC_feats(sparse_sent, sparse_feats, 0);
+
+	// Test result
+	vector<string> dense_str, sparse_str;
+	FeatureToStringHelper(dense_feats, dense_str);
+	FeatureToStringHelper(sparse_feats, sparse_str);
+	if (dense_str != sparse_str)
+	{
+		throw new TestException("assert failed", __FILE__, __LINE__);
+	}
+	if (sparse_str[1].compare(0, 25, "K_DICS=2,DIC0_U_C=B-Gene,") != 0)
+	{
+		throw new TestException("assert failed", __FILE__, __LINE__);
+	}
+	if (sparse_str[4].find("DIC3_") != string::npos || sparse_str[4].find("DIC2_U_R1=B-Gene") == string::npos)
+	{
+		throw new TestException("assert failed", __FILE__, __LINE__);
+	}
+
+	vector<pair<int, string> > hits;
+	parse_dic_hits(sparse_dics[1], hits);
+	if (hits.size() != 2 || hits[1].first != 3 || hits[1].second != "B-Chemical")
+	{
+		throw new TestException("assert failed", __FILE__, __LINE__);
+	}
+	if (format_dic_hits(hits) != sparse_dics[1])
+	{
+		throw new TestException("assert failed", __FILE__, __LINE__);
+	}
+}
+
 #endif
@@ -79,9 +79,10 @@ void TestNERSuite_Tag()
 
 	if (CRFSuiteDummyLog !=
 		"Tagger::Tagger;"
-		"Tagger::open(model.m);"
-		"Tagger::labels;"
+		"Tagger2::Tagger2;"
+		"Tagger2::open(model.m);"
 		"Tagger::tag;"
+		"Tagger2::~Tagger2;"
 		"Tagger::~Tagger;"
 		)
 	{
@@ -10,6 +10,8 @@ using namespace NER;
 
 static const char* SENTENCE_TAGGER_TEST_TEXT_FILE = "sentence_tagger_test.txt";
 static const char* SENTENCE_TAGGER_TEST_DB_FILE = "sentence_tagger_test.cdbpp";
+static const char* SENTENCE_TAGGER_TEST_TEXT_FILE_2 = "sentence_tagger_test2.txt";
+static const char* SENTENCE_TAGGER_TEST_DB_FILE_2 = "sentence_tagger_test2.cdbpp";
 
 
 Dictionary* PrepareDictionaryTestDB(int normalize_type, const char* filename, const char* dbname)
@@ -180,4 +182,90 @@ void TestSentenceTagger_TokenBase()
 	delete pdict;
 }
 
+void TestSentenceTagger_MultipleDictionaries()
+{
+	Dictionary* pdict = PrepareDictionaryTestDB(NormalizeNone, SENTENCE_TAGGER_TEST_TEXT_FILE, SENTENCE_TAGGER_TEST_DB_FILE);
+	pdict->open();
+
+	ofstream ofs(SENTENCE_TAGGER_TEST_TEXT_FILE_2);
+	ofs << "sampleentry\tGene" << endl;
+	ofs << "sampleentry1\tChemical" << endl;
+	ofs.close();
+	Dictionary* pdict2 = new Dictionary(SENTENCE_TAGGER_TEST_DB_FILE_2);
+	pdict2->build(SENTENCE_TAGGER_TEST_TEXT_FILE_2, NormalizeCase);
+	pdict2->open();
+
+	vector<const Dictionary*>	dicts;
+	vector<int>					normalize_types;
+	dicts.push_back(pdict);
+	normalize_types.push_back(NormalizeNone);
+	dicts.push_back(pdict2);
+	normalize_types.push_back(NormalizeCase);
+
+	SentenceTagger	one_sent;
+
+	stringstream ss;
+	ss << "0\t11\tSampleEntry\tSampleEntry\tNN\t-" << endl;
+	ss << "12\t24\tSampleEntry1\tSampleEntry1\tNN\t-" << endl;
+	ss << endl;
+	one_sent.read(ss);
+	one_sent.tag_nes(dicts, normalize_types);
+	if (one_sent[0].size() != 6 + 9 + 2)
+		throw new TestException("assert failed", __FILE__, __LINE__);
+	if (one_sent[0][6] != "B-Class1")
+		throw new TestException("assert failed", __FILE__, __LINE__);
+	if (one_sent[1][6] != "O")
+		throw new TestException("assert failed", __FILE__, __LINE__);
+	if (one_sent[0][15] != "O")
+		throw new TestException("assert failed", __FILE__, __LINE__);
+	if (one_sent[0][16] != "B-Gene")
+		throw new TestException("assert failed", __FILE__, __LINE__);
+	if (one_sent[1][15] != "B-Chemical")
+		throw new TestException("assert failed", __FILE__, __LINE__);
+
+	delete pdict;
+	delete pdict2;
+}
+
+void TestSentenceTagger_POSFilter()
+{
+	Dictionary* pdict = PrepareDictionaryTestDB(NormalizeNone, SENTENCE_TAGGER_TEST_TEXT_FILE, SENTENCE_TAGGER_TEST_DB_FILE);
+	pdict->open();
+
+	SentenceTagger::set_normalize_type(NormalizeNone);
+	SentenceTagger	one_sent;
+
+	stringstream ss;
+	ss << "0\t11\tSampleEntry\tSampleEntry\tJJ\t-" << endl;
+	ss << "12\t23\tSampleEntry1\tSampleEntry1\tNNS\t-" << endl;
+	ss << "24\t35\tSampleEntry2\tSampleEntry2\tVBZ\t-" << endl;
+	ss << endl;
+
+	// The three-token entry contains a required "NN*" token
+	vector<string> require_prefix(1, "NN");
+	SentenceTagger::set_POS_filter(vector<string>(), require_prefix);
+	one_sent.read(ss);
+	one_sent.tag_nes(*pdict);
+	if (one_sent[0][13] != "B-Class8")
+		throw new TestException("assert failed", __FILE__, __LINE__);
+	if (one_sent[2][13] != "I-Class8")
+		throw new TestException("assert failed", __FILE__, __LINE__);
+
+	// ... but no longer matches when "VBZ" is disallowed, and the
+	// single-token entry has no required token
+	vector<string> disallow_exact(1, "VBZ");
+	SentenceTagger::set_POS_filter(vector<string>(), require_prefix, disallow_exact);
+	ss.clear();
+	ss.seekg(0, ios::beg);
+	one_sent.read(ss);
+	one_sent.tag_nes(*pdict);
+	if (one_sent[0][13] != "O")
+		throw new TestException("assert failed", __FILE__, __LINE__);
+	if (one_sent[0][6] != "O")
+		throw new TestException("assert failed", __FILE__, __LINE__);
+
+	SentenceTagger::set_POS_filter();
+	delete pdict;
+}
+
 #endif
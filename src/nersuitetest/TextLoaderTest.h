@@ -0,0 +1,239 @@
+#ifndef _TEXT_LOADER_TEST
+#define _TEXT_LOADER_TEST
+
+#include <string>
+#include <sstream>
+#include <streambuf>
+#include <vector>
+#include <algorithm>
+#include "../nersuite_common/text_loader.h"
+#include "../nersuite_common/output_writer.h"
+
+using namespace std;
+using namespace NER;
+
+// A stream buffer handing out its data in pieces of a given size, as a pipe does.
+// With a piece size of 0, it has no buffer and never tells what is available,
+// as std::cin synchronized with stdio.
+class PieceBuffer : public streambuf
+{
+public:
+	PieceBuffer(const string &data, size_t piece_size)
+		: m_Data(data), m_Pos(0), m_PieceSize(piece_size) {}
+
+	// Number of bytes handed to the stream so far
+	size_t taken() const { return m_Pos; }
+
+protected:
+	int underflow()
+	{
+		if (m_Pos >= m_Data.size())
+			return EOF;
+		if (m_PieceSize == 0)
+			return (unsigned char) m_Data[m_Pos];
+
+		char	*p = &m_Data[m_Pos];
+		size_t	n = min(m_PieceSize, m_Data.size() - m_Pos);
+		setg(p, p, p + n);
+		m_Pos += n;
+		return (unsigned char) *p;
+	}
+
+	int uflow()
+	{
+		if (m_PieceSize > 0)
+			return streambuf::uflow();
+		return (m_Pos < m_Data.size()) ? (unsigned char) m_Data[m_Pos++] : EOF;
+	}
+
+private:
+	string	m_Data;
+	size_t	m_Pos;
+	size_t	m_PieceSize;
+};
+
+// Read all lines of a stream
+static vector<string> ReadLines(istream &is, size_t block_size)
+{
+	SentenceReader	reader(is, FORMAT_TSV, block_size);
+	vector<string>	lines;
+	const char		*line;
+	size_t			len;
+	while (reader.read_line(line, len))
+		lines.push_back(string(line, len));
+	if (!reader.eof())
+		throw new TestException("assert failed", __FILE__, __LINE__);
+	return lines;
+}
+
+// Read all sentences of a stream, one string per sentence
+static vector<string> ReadSentences(istream &is, size_t block_size, const string &multidoc_separator)
+{
+	SentenceReader	reader(is, FORMAT_TSV, block_size);
+	vector<string>	sentences;
+	V2_STR			one_sent;
+	bool			separator_read;
+	while (!reader.at_end())
+	{
+		int		n_lines = get_sent(reader, one_sent, multidoc_separator, separator_read);
+		string	sent = separator_read ? "#" : "";
+		for (int i = 0; i < n_lines; ++i)
+		{
+			for (size_t j = 0; j < one_sent[i].size(); ++j)
+				sent += one_sent[i][j] + "|";
+			sent += "/";
+		}
+		sentences.push_back(sent);
+	}
+	return sentences;
+}
+
+void TestTextLoader_Lines()
+{
+	// An empty line, a line longer than the small blocks, and a last line without a newline
+	string			text = "abc\n\na line longer than a block\nlast";
+	const char*		expected[] = { "abc", "", "a line longer than a block", "last" };
+	vector<string>	expected_lines(expected, expected + 4);
+
+	size_t	block_sizes[] = { 0, 1, 2, 3, 7, 1 << 20 };
+	size_t	piece_sizes[] = { 0, 1, 4, 1 << 20 };
+	for (size_t i = 0; i < sizeof(block_sizes) / sizeof(size_t); ++i)
+	{
+		istringstream	is(text);
+		if (ReadLines(is, block_sizes[i]) != expected_lines)
+			throw new TestException("assert failed", __FILE__, __LINE__);
+
+		for (size_t j = 0; j < sizeof(piece_sizes) / sizeof(size_t); ++j)
+		{
+			PieceBuffer	buffer(text, piece_sizes[j]);
+			istream		is_pieces(&buffer);
+			if (ReadLines(is_pieces, block_sizes[i]) != expected_lines)
+				throw new TestException("assert failed", __FILE__, __LINE__);
+		}
+	}
+
+	istringstream	is_empty("");
+	if (!ReadLines(is_empty, 3).empty())
+		throw new TestException("assert failed", __FILE__, __LINE__);
+}
+
+void TestTextLoader_Sentences()
+{
+	string	text = "##doc1\n##title\n\n0\t3\tThe\n4\t11\tprotein\tNN\n\n\n##doc2\n\n0\t1\tA";
+
+	// The sentences read line by line with std::getline
+	istringstream	is_lines(text);
+	vector<string>	expected = ReadSentences(is_lines, 0, "##");
+	if (expected.size() != 5 || expected[0] != "###doc1|/##title|/" ||
+		expected[1] != "0|3|The|/4|11|protein|NN|/" || expected[2] != "" || expected[4] != "0|1|A|/")
+		throw new TestException("assert failed", __FILE__, __LINE__);
+
+	size_t	block_sizes[] = { 1, 2, 5, 1 << 20 };
+	size_t	piece_sizes[] = { 0, 1, 3, 1 << 20 };
+	for (size_t i = 0; i < sizeof(block_sizes) / sizeof(size_t); ++i)
+	{
+		istringstream	is(text);
+		if (ReadSentences(is, block_sizes[i], "##") != expected)
+			throw new TestException("assert failed", __FILE__, __LINE__);
+
+		for (size_t j = 0; j < sizeof(piece_sizes) / sizeof(size_t); ++j)
+		{
+			PieceBuffer	buffer(text, piece_sizes[j]);
+			istream		is_pieces(&buffer);
+			if (ReadSentences(is_pieces, block_sizes[i], "##") != expected)
+				throw new TestException("assert failed", __FILE__, __LINE__);
+		}
+	}
+}
+
+void TestTextLoader_Streaming()
+{
+	// A sentence is returned as soon as its empty line has arrived:
+	// the reader does not wait for a full block
+	string	text = "0\t3\tThe\n\n4\t11\tprotein\n\n";
+
+	size_t	piece_sizes[] = { 0, 9 };
+	for (size_t i = 0; i < sizeof(piece_sizes) / sizeof(size_t); ++i)
+	{
+		PieceBuffer		buffer(text, piece_sizes[i]);
+		istream			is(&buffer);
+		SentenceReader	reader(is);
+		V2_STR			one_sent;
+		if (get_sent(reader, one_sent) != 1 || one_sent[0][2] != "The" || buffer.taken() != 9)
+			throw new TestException("assert failed", __FILE__, __LINE__);
+		if (get_sent(reader, one_sent) != 1 || one_sent[0][2] != "protein" || !reader.at_end())
+			throw new TestException("assert failed", __FILE__, __LINE__);
+	}
+}
+
+// Read all blocks of a stream and write them again in the given format
+static string ConvertSentences(const string &input, DataFormat in_format, DataFormat out_format, const string &multidoc_separator)
+{
+	istringstream	is(input);
+	ostringstream	os;
+	{
+		SentenceReader	reader(is, in_format);
+		OutputWriter	out(os, false, out_format);
+		V2_STR			one_sent;
+		bool			separator_read;
+		while (!reader.at_end())
+		{
+			get_sent(reader, one_sent, multidoc_separator, separator_read);
+			if (separator_read)
+				out.write_comment(one_sent);
+			else
+				out.write_sent(one_sent);
+		}
+	}
+	return os.str();
+}
+
+void TestTextLoader_BinaryRoundTrip()
+{
+	// Integer and string columns, ragged rows, numbers that must stay strings, and empty blocks
+	string	tsv = "0\t3\tThe\tDT\n4\t11\tprotein\tNN\n\n\n"
+		"007\t-1\tThe\n4294967296\t\tIL-2\tNN\tB-protein\n\n";
+
+	string	binary = ConvertSentences(tsv, FORMAT_TSV, FORMAT_BINARY, "");
+	if (binary.compare(0, 4, "NERB") != 0)
+		throw new TestException("assert failed", __FILE__, __LINE__);
+	if (ConvertSentences(binary, FORMAT_BINARY, FORMAT_TSV, "") != tsv)
+		throw new TestException("assert failed", __FILE__, __LINE__);
+	if (ConvertSentences(binary, FORMAT_BINARY, FORMAT_BINARY, "") != binary)
+		throw new TestException("assert failed", __FILE__, __LINE__);
+
+	// The same sentences are read from both formats
+	istringstream	is_tsv(tsv), is_binary(binary);
+	SentenceReader	reader_tsv(is_tsv), reader_binary(is_binary, FORMAT_BINARY);
+	V2_STR			sent_tsv, sent_binary;
+	while (!reader_tsv.eof())
+	{
+		if (get_sent(reader_tsv, sent_tsv) != get_sent(reader_binary, sent_binary) || sent_tsv != sent_binary)
+			throw new TestException("assert failed", __FILE__, __LINE__);
+		if (reader_tsv.eof() != reader_binary.eof())
+			throw new TestException("assert failed", __FILE__, __LINE__);
+	}
+
+	if (ConvertSentences("", FORMAT_BINARY, FORMAT_TSV, "") != "")
+		throw new TestException("assert failed", __FILE__, __LINE__);
+}
+
+void TestTextLoader_BinaryComment()
+{
+	string	tsv = "##doc1\n##title\n\n0\t3\tThe\n\n##doc2\n\n0\t3\tThe\n\n";
+
+	string	binary = ConvertSentences(tsv, FORMAT_TSV, FORMAT_BINARY, "##");
+	if (ConvertSentences(binary, FORMAT_BINARY, FORMAT_TSV, "##") != tsv)
+		throw new TestException("assert failed", __FILE__, __LINE__);
+
+	istringstream	is(binary);
+	SentenceReader	reader(is, FORMAT_BINARY);
+	V2_STR			one_sent;
+	bool			separator_read;
+	if (get_sent(reader, one_sent, "##", separator_read) != 2 || !separator_read || one_sent[1][0] != "##title")
+		throw new TestException("assert failed", __FILE__, __LINE__);
+	if (get_sent(reader, one_sent, "##", separator_read) != 1 || separator_read || one_sent[0][2] != "The")
+		throw new TestException("assert failed", __FILE__, __LINE__);
+}
+
+#endif
@@ -0,0 +1,95 @@
+#ifndef _TOKENIZER_TEST
+#define _TOKENIZER_TEST
+
+#include <string>
+#include "../nersuite_common/tokenizer.h"
+#include "../nersuite_common/sentence_splitter.h"
+
+using namespace std;
+using namespace NER;
+
+void TestTokenizer_Spans()
+{
+	Tokenizer	tokenizer;
+	V1_SPAN		spans;
+
+	string	sent = "  IL-2 gene(s)  expression\t5.0% ";
+	if (tokenizer.tokenize(sent, spans) != 13)
+		throw new TestException("assert failed", __FILE__, __LINE__);
+
+	const char*	expected[] = { "IL", "-", "2", "gene", "(", "s", ")", "expression", "\t", "5", ".", "0", "%" };
+	size_t		expected_beg[] = { 2, 4, 5, 7, 11, 12, 13, 16, 26, 27, 28, 29, 30 };
+	for (size_t i = 0; i < 13; ++i)
+	{
+		if (spans[i].first != expected_beg[i])
+			throw new TestException("assert failed", __FILE__, __LINE__);
+		if (sent.substr(spans[i].first, spans[i].second - spans[i].first) != expected[i])
+			throw new TestException("assert failed", __FILE__, __LINE__);
+	}
+
+	// Bytes outside ASCII are single-byte delimiters
+	spans.clear();
+	if (tokenizer.tokenize("a\xc3\xa9z", spans) != 4)
+		throw new TestException("assert failed", __FILE__, __LINE__);
+	if (spans[1].first != 1 || spans[1].second != 2 || spans[3].first != 3)
+		throw new TestException("assert failed", __FILE__, __LINE__);
+
+	spans.clear();
+	if (tokenizer.tokenize("   ", spans) != 0 || !spans.empty())
+		throw new TestException("assert failed", __FILE__, __LINE__);
+}
+
+void TestTokenizer_Triplets()
+{
+	Tokenizer	tokenizer;
+	V2_STR		data;
+
+	if (tokenizer.tokenize(" p53 binds", data, 100) != 2)
+		throw new TestException("assert failed", __FILE__, __LINE__);
+	if (data[0].size() != 3 || data[0][0] != "101" || data[0][1] != "104" || data[0][2] != "p53")
+		throw new TestException("assert failed", __FILE__, __LINE__);
+	if (data[1][0] != "105" || data[1][1] != "110" || data[1][2] != "binds")
+		throw new TestException("assert failed", __FILE__, __LINE__);
+}
+
+void TestSentenceSplitter_Split()
+{
+	Tokenizer			tokenizer;
+	SentenceSplitter	splitter;
+	V1_SPAN				spans;
+	vector<size_t>		sent_ends;
+
+	string	para = "Cells were treated (Fig. 1B), e.g. with IL-2. Expression of E. coli lacZ rose to 3.5 fold (n = 4). Why? \"Unknown.\" Smith et al. Nature.";
+	tokenizer.tokenize(para, spans);
+	if (splitter.split(para, spans, sent_ends) != 5)
+		throw new TestException("assert failed", __FILE__, __LINE__);
+
+	const char*	expected_last[] = { ".", ".", "?", "\"" };
+	const char*	expected_next[] = { "Expression", "Why", "\"", "Smith" };
+	for (size_t i = 0; i < 4; ++i)
+	{
+		const TOKEN_SPAN&	last = spans[sent_ends[i] - 1];
+		const TOKEN_SPAN&	next = spans[sent_ends[i]];
+		if (para.substr(last.first, last.second - last.first) != expected_last[i])
+			throw new TestException("assert failed", __FILE__, __LINE__);
+		if (para.substr(next.first, next.second - next.first) != expected_next[i])
+			throw new TestException("assert failed", __FILE__, __LINE__);
+	}
+	if (sent_ends.back() != spans.size())
+		throw new TestException("assert failed", __FILE__, __LINE__);
+
+	spans.clear();
+	sent_ends.clear();
+	para = "Treated for 5 min. Then washed.";
+	tokenizer.tokenize(para, spans);
+	if (splitter.split(para, spans, sent_ends) != 2 || sent_ends[0] != 5)
+		throw new TestException("assert failed", __FILE__, __LINE__);
+
+	// User-supplied abbreviations
+	sent_ends.clear();
+	splitter.add_abbreviation("min.");
+	if (splitter.split(para, spans, sent_ends) != 1)
+		throw new TestException("assert failed", __FILE__, __LINE__);
+}
+
+#endif
@@ -97,6 +97,27 @@ bool Tagger::open(const std::string& name)
 	return true;
 }
 
+Tagger2::Tagger2()
+	: shared(NULL)
+{
+	CRFSuiteDummyLog.append("Tagger2::Tagger2;");
+}
+
+Tagger2::~Tagger2()
+{
+	CRFSuiteDummyLog.append("Tagger2::~Tagger2;");
+}
+
+bool Tagger2::open(const std::string& name)
+{
+	CRFSuiteDummyLog.append("Tagger2::open(" + name + ");");
+	return true;
+}
+
+void Tagger2::close()
+{
+}
+
 StringList Tagger::labels()
 {
 	CRFSuiteDummyLog.append("Tagger::labels;");
@@ -6,6 +6,8 @@
 #include "FExtorTest.h"
 #include "DictionaryTest.h"
 #include "SentenceTaggerTest.h"
+#include "TokenizerTest.h"
+#include "TextLoaderTest.h"
 
 using namespace std;
 
@@ -40,17 +42,36 @@ int main()
 	REGISTER_TESTFUNC(TestFuncTable, TestFExtorPOSFeature);
 	REGISTER_TESTFUNC(TestFuncTable, TestFExtorLemmaPOSFeature);
 	REGISTER_TESTFUNC(TestFuncTable, TestFExtorChunkFeature);
+	REGISTER_TESTFUNC(TestFuncTable, TestFExtorDicFeature_Sparse);
 	REGISTER_TESTFUNC(TestFuncTable, TestDictionaryBuild_NoNormalization);
 	REGISTER_TESTFUNC(TestFuncTable, TestDictionaryBuild_CaseNormalization);
 	REGISTER_TESTFUNC(TestFuncTable, TestDictionaryBuild_CaseAndNumberNormalization);
 	REGISTER_TESTFUNC(TestFuncTable, TestDictionaryBuild_CaseAndNumberAndSymbolNormalization);
 	REGISTER_TESTFUNC(TestFuncTable, TestDictionaryBuild_TokenizerNormalization);
+	REGISTER_TESTFUNC(TestFuncTable, TestDictionary_AppendNormalizedKey);
+	REGISTER_TESTFUNC(TestFuncTable, TestDictionary_KeyLengthIndex);
+	REGISTER_TESTFUNC(TestFuncTable, TestDictionary_BatchLookup);
+	REGISTER_TESTFUNC(TestFuncTable, TestDictionary_ClassSets);
+	REGISTER_TESTFUNC(TestFuncTable, TestDictionary_Cache);
+	REGISTER_TESTFUNC(TestFuncTable, TestDictionary_Offset64);
+	REGISTER_TESTFUNC(TestFuncTable, TestDictionary_ApproximateMatching);
+	REGISTER_TESTFUNC(TestFuncTable, TestDictionary_Delta);
 	REGISTER_TESTFUNC(TestFuncTable, TestSentenceTagger_NormalizeNone);
 	REGISTER_TESTFUNC(TestFuncTable, TestSentenceTagger_NormalizeCase);
 	REGISTER_TESTFUNC(TestFuncTable, TestSentenceTagger_NormalizeNumber);
 	REGISTER_TESTFUNC(TestFuncTable, TestSentenceTagger_NormalizeSymbol);
 	REGISTER_TESTFUNC(TestFuncTable, TestSentenceTagger_TokenBase);
 	REGISTER_TESTFUNC(TestFuncTable, TestSentenceTagger_TokenBase);
+	REGISTER_TESTFUNC(TestFuncTable, TestSentenceTagger_MultipleDictionaries);
+	REGISTER_TESTFUNC(TestFuncTable, TestSentenceTagger_POSFilter);
+	REGISTER_TESTFUNC(TestFuncTable, TestTokenizer_Spans);
+	REGISTER_TESTFUNC(TestFuncTable, TestTokenizer_Triplets);
+	REGISTER_TESTFUNC(TestFuncTable, TestSentenceSplitter_Split);
+	REGISTER_TESTFUNC(TestFuncTable, TestTextLoader_Lines);
+	REGISTER_TESTFUNC(TestFuncTable, TestTextLoader_Sentences);
+	REGISTER_TESTFUNC(TestFuncTable, TestTextLoader_Streaming);
+	REGISTER_TESTFUNC(TestFuncTable, TestTextLoader_BinaryRoundTrip);
+	REGISTER_TESTFUNC(TestFuncTable, TestTextLoader_BinaryComment);
 
 	// Run the Test List
 	size_t ntests = TestFuncTable.size();
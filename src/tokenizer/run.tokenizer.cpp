@@ -7,6 +7,10 @@
 #include <vector>
 
 #include "../nersuite_common/tokenizer.h"
+#include "../nersuite_common/sentence_splitter.h"
+#include "../nersuite_common/nersuite_exception.h"
+#include "../nersuite_common/output_writer.h"
+#include "../nersuite_common/string_utils.h"
 
 
 using namespace std;
@@ -15,18 +19,27 @@ using namespace NER;
 
 int main(int argc, char* argv[])
 {
+	bool line_buffered = false;
 	if( argc >= 2 ) {
 		for( int i=1; i<argc; ++i ) {
 			string arg = argv[i];
 			if( arg == "--help" ) {
-				cerr << "Usage: " << argv[0] << " < a sentence-per-line file" << endl;
+				cerr << "Usage: " << argv[0] << " [-multidoc <separator>] [-split <abbreviation file | builtin>] [-line-buffered] [-of tsv|binary] < a sentence-per-line file" << endl;
+				cerr << "  -split: split each line into sentences; offsets stay relative to the document" << endl;
+				cerr << "  -line-buffered: flush the output at the end of every line, not only of every document" << endl;
+				cerr << "  -of: format of the output, tab-separated text (default) or the NERsuite binary format" << endl;
 				return 0;
+			}else if( arg == "-line-buffered" ) {
+				line_buffered = true;
 			}
 		}
 	}
 
 	bool multidoc_mode = false;
 	string multidoc_separator;
+	bool split_mode = false;
+	string abbreviation_file;
+	DataFormat out_format = FORMAT_TSV;
 	if( argc >= 3 ) {
 		for( int j=1; j<argc-1; ++j ) {
 			string arg = argv[j];
@@ -34,17 +47,40 @@ int main(int argc, char* argv[])
 			if( arg == "-multidoc" ) {
 				multidoc_mode = true;
 				multidoc_separator = val;
+			}else if( arg == "-split" ) {
+				split_mode = true;
+				if( val != "builtin" )
+					abbreviation_file = val;
+			}else if( arg == "-of" ) {
+				if( !parse_data_format( val, out_format ) ) {
+					cerr << "-of option requires tsv or binary." << endl;
+					return 1;
+				}
 			}
 		}
 	}
 
 	Tokenizer	tokenizer;
+	SentenceSplitter	splitter;
+	if( !abbreviation_file.empty() ) {
+		try {
+			splitter.load_abbreviations( abbreviation_file );
+		}catch( nersuite_exception &ex ) {
+			cerr << ex.what() << endl;
+			return 1;
+		}
+	}
 
 	string  line = "";
-	V2_STR  data;
+	V1_SPAN spans;
+	vector<size_t>  sent_ends;
 	int	    n_lines = 1;
 	int     base_offset = 0;
 	bool    prev_comment = false;
+	V2_STR  sent, comment;                     // FORMAT_BINARY
+	if( out_format == FORMAT_BINARY )
+		set_binary_stdio( stdout );
+	OutputWriter  out( cout, line_buffered, out_format );
 
 	while( getline( cin, line ) ) {
 		int sent_len = line.length() + 1;       // Remember the length of the line 
@@ -60,8 +96,13 @@ int main(int argc, char* argv[])
 		
 		// 2. Pass the input line to the output if it is a comment line beginning with the separator
 		if( multidoc_mode && (line.compare(0, multidoc_separator.length(), multidoc_separator) == 0) ) {  
-			cout << line << endl;
-			cout.flush();
+			if( out_format == FORMAT_BINARY ) {
+				comment.push_back( V1_STR( 1, line ) );
+			}else {
+				out << line;
+				out.end_line();
+				out.end_document();
+			}
 			base_offset = 0;
 			prev_comment = true;
 
@@ -69,32 +110,56 @@ int main(int argc, char* argv[])
 		}
 
 		// 3. Tokenize if it is a sentence
-		data.clear();
-		if( tokenizer.tokenize( line, data, base_offset ) == 0 )	{ // Ignore lines that only have spaces
+		spans.clear();
+		if( tokenizer.tokenize( line, spans ) == 0 )	{ // Ignore lines that only have spaces
 			base_offset += sent_len;
 			continue;
-		}else {
-			base_offset += sent_len;
 		}
 
 		// 4. Print a tokenized sentence
 		if( prev_comment ) {
-			cout << endl;
+			if( out_format == FORMAT_BINARY ) {
+				out.write_comment( comment );
+				comment.clear();
+			}else {
+				out.end_line();
+			}
 			prev_comment = false;
 		}
 
-		for( V2_STR::iterator i_row = data.begin(); i_row != data.end(); ++i_row) {
-			for( V1_STR::iterator i_col = i_row->begin(); i_col != i_row->end(); ++i_col) {
-				cout << *i_col;
-				if( (i_col + 1) != i_row->end() )
-					cout << "\t";
+		sent_ends.clear();
+		if( split_mode )
+			splitter.split( line, spans, sent_ends );
+		else
+			sent_ends.push_back( spans.size() );
+
+		size_t  i_span = 0;
+		for( vector<size_t>::const_iterator i_end = sent_ends.begin(); i_end != sent_ends.end(); ++i_end) {
+			if( out_format == FORMAT_BINARY ) {
+				sent.resize( *i_end - i_span );
+				for( V2_STR::iterator i_row = sent.begin(); i_row != sent.end(); ++i_row, ++i_span ) {
+					i_row->resize( 3 );
+					(*i_row)[0] = int2str( (int) (base_offset + spans[i_span].first) );
+					(*i_row)[1] = int2str( (int) (base_offset + spans[i_span].second) );
+					(*i_row)[2].assign( line, spans[i_span].first, spans[i_span].second - spans[i_span].first );
+				}
+				out.write_sent( sent );
+				continue;
+			}
+
+			for( ; i_span < *i_end; ++i_span) {
+				out << base_offset + spans[i_span].first << '\t' << base_offset + spans[i_span].second << '\t';
+				out.write( line.data() + spans[i_span].first, spans[i_span].second - spans[i_span].first );
+				out.end_line();
 			}
-			cout << endl;
+			out.end_line();
 		}
-		cout << endl;
+		base_offset += sent_len;
 
 		++n_lines;
 	}
+	if( !comment.empty() )
+		out.write_comment( comment );
 	
 	return n_lines;
 }